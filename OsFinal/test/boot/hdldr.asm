@@ -128,6 +128,14 @@ LABEL_START:			; <--- 从这里开始 *************
 	add	bx, [fs:SB_DIR_ENT_INODE_OFF]
 	mov	eax, [es:bx]		; eax <- inode nr of kernel
 	call	get_inode		; eax <- start sector nr of kernel
+	;; kernel.bin is read SECT_BUF_SIZE bytes a time, the last read
+	;; ends below LOADER_PHY_ADDR only if i_size < KERNEL_VALID_SPACE
+	cmp	ecx, KERNEL_VALID_SPACE
+	jb	.size_ok
+	mov	dh, 4			; "Too Large"
+	call	real_mode_disp_str
+	jmp	$
+.size_ok:
 	mov	dword [disk_address_packet +  8], eax
 load_kernel:
 	call	read_sector
@@ -330,6 +338,7 @@ LABEL_PM_START:
 	shl	eax, 4
 	add	eax, KERNEL_FILE_OFF
 	mov	[BOOT_PARAM_ADDR + 8], eax			; BootParam[2] = KernelFilePhyAddr;
+	mov	dword [BOOT_PARAM_ADDR + 12], BOOT_HZ		; BootParam[3] = Hz;
 
 	;***************************************************************
 	jmp	SelectorFlatC:KRNL_ENT_PT_PHY_ADDR	; 正式进入内核 *
@@ -364,10 +373,10 @@ LABEL_PM_START:
 	;       9FC00h ┃□□extended BIOS data area (EBDA)□┃
 	;              ┣━━━━━━━━━━━━━━━━━━┫
 	;              ┃■■■■■■■■■■■■■■■■■■┃
-	;       90000h ┃■■■■■■■LOADER.BIN■■■■■■┃ somewhere in LOADER ← esp
+	;       98000h ┃■■■■■■■LOADER.BIN■■■■■■┃ somewhere in LOADER ← esp
 	;              ┣━━━━━━━━━━━━━━━━━━┫
 	;              ┃■■■■■■■■■■■■■■■■■■┃
-	;       80000h ┃■■■■■■■KERNEL.BIN■■■■■■┃
+	;       70000h ┃■■■■■■■KERNEL.BIN■■■■■■┃
 	;              ┣━━━━━━━━━━━━━━━━━━┫
 	;              ┃■■■■■■■■■■■■■■■■■■┃
 	;       30000h ┃■■■■■■■■KERNEL■■■■■■■┃ 30400h ← KERNEL 入口 (KRNL_ENT_PT_PHY_ADDR)
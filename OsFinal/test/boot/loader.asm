@@ -433,6 +433,7 @@ LABEL_PM_START:
 	shl	eax, 4
 	add	eax, KERNEL_FILE_OFF
 	mov	[BOOT_PARAM_ADDR + 8], eax ; phy-addr of kernel.bin
+	mov	dword [BOOT_PARAM_ADDR + 12], BOOT_HZ ; clock ticks per second
 
 	;***************************************************************
 	jmp	SelectorFlatC:KRNL_ENT_PT_PHY_ADDR	; 正式进入内核 *
@@ -477,7 +478,7 @@ LABEL_PM_START:
 	;       9FC00h ┃□□extended BIOS data area (EBDA)□┃
 	;              ┣━━━━━━━━━━━━━━━━━━┫
 	;              ┃■■■■■■■■■■■■■■■■■■┃
-	;       90000h ┃■■■■■■■LOADER.BIN■■■■■■┃ somewhere in LOADER ← esp
+	;       98000h ┃■■■■■■■LOADER.BIN■■■■■■┃ somewhere in LOADER ← esp
 	;              ┣━━━━━━━━━━━━━━━━━━┫
 	;              ┃■■■■■■■■■■■■■■■■■■┃
 	;              ┃■■■■■■■■■■■■■■■■■■┃
@@ -0,0 +1,28 @@
+#include "type.h"
+#include "stdio.h"
+
+int main(int argc, char * argv[])
+{
+	char buf[512];
+	int n;
+
+	if (argc == 1) {	/* copy stdin, e.g. the read end of a pipe */
+		while ((n = read(0, buf, sizeof(buf))) > 0)
+			write(1, buf, n);
+		return 0;
+	}
+
+	int i;
+	for (i = 1; i < argc; i++) {
+		int fd = open(argv[i], O_RDWR);
+		if (fd == -1) {
+			printf("cat: %s: no such file\n", argv[i]);
+			continue;
+		}
+		while ((n = read(fd, buf, sizeof(buf))) > 0)
+			write(1, buf, n);
+		close(fd);
+	}
+
+	return 0;
+}
@@ -50,11 +50,11 @@
 /* 	char buf[STR_DEFAULT_LEN]; */
 
 /* 	/\* get parameters from the message *\/ */
-/* 	int str_len = fs_msg.CNT;	/\* length of filename *\/ */
-/* 	int src = fs_msg.source;	/\* caller proc nr. *\/ */
+/* 	int str_len = fs_cur->msg.CNT;	/\* length of filename *\/ */
+/* 	int src = fs_cur->msg.source;	/\* caller proc nr. *\/ */
 /* 	assert(str_len < STR_DEFAULT_LEN); */
 /* 	phys_copy((void*)va2la(TASK_FS, buf),    /\* to   *\/ */
-/* 		  (void*)va2la(src, fs_msg.BUF), /\* from *\/ */
+/* 		  (void*)va2la(src, fs_cur->msg.BUF), /\* from *\/ */
 /* 		  str_len); */
 /* 	buf[str_len] = 0;	/\* terminate the string *\/ */
 
@@ -77,49 +77,12 @@ PUBLIC int disklog(char * logstr)
 
 	static int pos = 0;
 	if (!pos) { /* first time invoking this routine */
-
-#ifdef SET_LOG_SECT_SMAP_AT_STARTUP
-		/*
-		 * set sector-map so that other files cannot use the log sectors
-		 */
-
-		int bits_per_sect = SECTOR_SIZE * 8; /* 4096 */
-
-		int smap_blk0_nr = 1 + 1 + sb->nr_imap_sects; /* 3 */
-		int sect_nr  = smap_blk0_nr + nr_log_blk0_nr / bits_per_sect; /* 3+9=12 */
-		int byte_off = (nr_log_blk0_nr % bits_per_sect) / 8; /* 168 */
-		int bit_off  = (nr_log_blk0_nr % bits_per_sect) % 8; /* 1 */
-		int sect_cnt = NR_SECTS_FOR_LOG / bits_per_sect + 2; /* 1 */
-		int bits_left= NR_SECTS_FOR_LOG; /* 2048 */
-
-		int i;
-		for (i = 0; i < sect_cnt; i++) {
-			DISKLOG_RD_SECT(device, sect_nr + i); /* DISKLOG_RD_SECT(?, 12) */
-
-			for (; byte_off < SECTOR_SIZE && bits_left > 0; byte_off++) {
-				for (; bit_off < 8; bit_off++) { /* repeat till enough bits are set */
-					assert(((logdiskbuf[byte_off] >> bit_off) & 1) == 0);
-					logdiskbuf[byte_off] |= (1 << bit_off);
-					if (--bits_left  == 0)
-						break;
-				}
-				bit_off = 0;
-			}
-			byte_off = 0;
-			bit_off = 0;
-
-			DISKLOG_WR_SECT(device, sect_nr + i);
-
-			if (bits_left == 0)
-				break;
-		}
-		assert(bits_left == 0);
-#endif /* SET_LOG_SECT_SMAP_AT_STARTUP */
-
+		/* the log sectors were claimed in the sector-map by init_fs() */
 		pos = 0x40;
 
 #ifdef MEMSET_LOG_SECTS
 		/* write padding stuff to log sectors */
+		int i;
 		int chunk = min(MAX_IO_BYTES, LOGDISKBUF_SIZE >> SECTOR_SIZE_SHIFT);
 		assert(chunk == 256);
 		int sects_left = NR_SECTS_FOR_LOG;
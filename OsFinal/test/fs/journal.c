@@ -0,0 +1,284 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   journal.c
+ * @brief  Write-ahead journal for FS metadata.
+ *
+ * Every RD_SECT()/WR_SECT() of FS lands here. Once the journal is up, a
+ * written sector is not sent to the disk but kept in the running
+ * transaction, and later reads of that sector are served from there. Several
+ * requests share one transaction, so the imap, smap, i-node and dir sectors
+ * they all touch are written once per commit instead of once per request.
+ *
+ * A commit writes the header and all blocks to the journal region with one
+ * sequential write, then writes each block home and clears the header.
+ * After a crash, whatever the header still describes is written home again
+ * at mount.
+ *
+ * A request never straddles two transactions: the running one is committed
+ * before a request starts if it cannot take JOURNAL_OP_MAX_SECTS more
+ * sectors, and a request which may dirty more calls journal_reserve() before
+ * its first write.
+ *
+ * @author Forrest Y. Yu
+ * @date   2008
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "config.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "keyboard.h"
+#include "proto.h"
+
+PRIVATE u32 journal_checksum();
+PRIVATE int journal_lookup(int sect_nr);
+
+/* the running transaction: header sector followed by the blocks */
+PRIVATE u8 jbuf[JOURNAL_NR_SECTS * SECTOR_SIZE];
+PRIVATE struct journal_header * jhdr = (struct journal_header *)jbuf;
+
+PRIVATE int jdev = NO_DEV;	/* NO_DEV: journal is off */
+PRIVATE int j1st_sect;		/* 1st sector of the journal region */
+PRIVATE int jnr_ops;		/* requests in the running transaction */
+
+/*****************************************************************************
+ *                                journal_init
+ *****************************************************************************/
+/**
+ * Locate the journal region of a device, replay the last transaction found
+ * there and turn the journal on.
+ *
+ * The region is claimed in the sector-map the first time. If it is taken by
+ * a file (an FS made before the journal existed), the journal stays off and
+ * metadata is written through as before.
+ *
+ * @param dev  The device, its super block must have been read.
+ *****************************************************************************/
+PUBLIC void journal_init(int dev)
+{
+	struct super_block * sb = get_super_block(dev);
+	int start = sb->nr_sects - NR_SECTS_FOR_LOG - JOURNAL_NR_SECTS;
+
+	assert(jdev == NO_DEV);
+
+	rw_sector(DEV_READ, dev, (u64)start * SECTOR_SIZE,
+		  JOURNAL_NR_SECTS * SECTOR_SIZE, TASK_FS, jbuf);
+
+	if (jhdr->magic != JOURNAL_MAGIC) {
+		if (!smap_run_free(dev, start, JOURNAL_NR_SECTS)) {
+			printl("{FS} journal region is in use, journal off\n");
+			return;
+		}
+		set_smap_bits(dev, start, JOURNAL_NR_SECTS, 1);
+
+		memset(jbuf, 0, SECTOR_SIZE);
+		jhdr->magic = JOURNAL_MAGIC;
+		rw_sector(DEV_WRITE, dev, (u64)start * SECTOR_SIZE,
+			  SECTOR_SIZE, TASK_FS, jbuf);
+	}
+	else if (jhdr->nr_blocks > 0 &&
+		 jhdr->nr_blocks <= JOURNAL_MAX_BLOCKS &&
+		 jhdr->checksum == journal_checksum()) {
+		int i;
+		for (i = 0; i < jhdr->nr_blocks; i++)
+			rw_sector(DEV_WRITE, dev,
+				  (u64)jhdr->sects[i] * SECTOR_SIZE,
+				  SECTOR_SIZE, TASK_FS,
+				  jbuf + (i + 1) * SECTOR_SIZE);
+		printl("{FS} journal: replayed %d sectors of transaction %d\n",
+		       jhdr->nr_blocks, jhdr->seq);
+
+		/* do not replay it again at the next mount */
+		jhdr->nr_blocks = 0;
+		rw_sector(DEV_WRITE, dev, (u64)start * SECTOR_SIZE,
+			  SECTOR_SIZE, TASK_FS, jbuf);
+	}
+
+	jhdr->nr_blocks = 0;
+	jnr_ops = 0;
+	j1st_sect = start;
+	jdev = dev;
+}
+
+/*****************************************************************************
+ *                                journal_reserve
+ *****************************************************************************/
+/**
+ * Make room in the running transaction for a request which may dirty more
+ * than JOURNAL_OP_MAX_SECTS sectors. Must be called before the request
+ * writes any sector, since it may commit the running transaction.
+ *
+ * @param nr_sects  How many sectors the request may dirty at most.
+ *
+ * @return Zero if they fit, -1 if they never will and the request must fail.
+ *****************************************************************************/
+PUBLIC int journal_reserve(int nr_sects)
+{
+	if (jdev == NO_DEV)
+		return 0;
+
+	if (nr_sects > JOURNAL_MAX_BLOCKS) {
+		printl("{FS} journal: %d sectors in one request, max %d\n",
+		       nr_sects, JOURNAL_MAX_BLOCKS);
+		return -1;
+	}
+
+	if (jhdr->nr_blocks + nr_sects > JOURNAL_MAX_BLOCKS)
+		journal_commit();
+
+	return 0;
+}
+
+/*****************************************************************************
+ *                                journal_rd_sect
+ *****************************************************************************/
+/**
+ * Read a sector into fsbuf, from the running transaction if it is there.
+ *
+ * @param dev      Device nr.
+ * @param sect_nr  Sector nr.
+ *****************************************************************************/
+PUBLIC void journal_rd_sect(int dev, int sect_nr)
+{
+	int i = dev == jdev ? journal_lookup(sect_nr) : -1;
+
+	if (i >= 0)
+		memcpy(fsbuf, jbuf + (i + 1) * SECTOR_SIZE, SECTOR_SIZE);
+	else
+		rw_sector(DEV_READ, dev, (u64)sect_nr * SECTOR_SIZE,
+			  SECTOR_SIZE, TASK_FS, fsbuf);
+}
+
+/*****************************************************************************
+ *                                journal_wr_sect
+ *****************************************************************************/
+/**
+ * Write fsbuf to a sector. With the journal on, the sector is only put into
+ * the running transaction.
+ *
+ * @param dev      Device nr.
+ * @param sect_nr  Sector nr.
+ *****************************************************************************/
+PUBLIC void journal_wr_sect(int dev, int sect_nr)
+{
+	if (dev != jdev) {
+		rw_sector(DEV_WRITE, dev, (u64)sect_nr * SECTOR_SIZE,
+			  SECTOR_SIZE, TASK_FS, fsbuf);
+		return;
+	}
+
+	int i = journal_lookup(sect_nr);
+	if (i < 0) {
+		/**
+		 * Committing here would split the request across two
+		 * transactions: it dirtied more than it reserved.
+		 */
+		assert(jhdr->nr_blocks < JOURNAL_MAX_BLOCKS);
+		if (jhdr->nr_blocks == 0)
+			journal_countdown = JOURNAL_COMMIT_TICKS;
+		i = jhdr->nr_blocks++;
+		jhdr->sects[i] = sect_nr;
+	}
+	memcpy(jbuf + (i + 1) * SECTOR_SIZE, fsbuf, SECTOR_SIZE);
+}
+
+/*****************************************************************************
+ *                                journal_end_op
+ *****************************************************************************/
+/**
+ * Called by task_fs() after each request. Commit the running transaction if
+ * enough requests have joined it, or if the next one might not fit.
+ *****************************************************************************/
+PUBLIC void journal_end_op()
+{
+	if (jdev == NO_DEV || jhdr->nr_blocks == 0)
+		return;
+
+	if (++jnr_ops >= JOURNAL_BATCH_OPS ||
+	    jhdr->nr_blocks > JOURNAL_MAX_BLOCKS - JOURNAL_OP_MAX_SECTS)
+		journal_commit();
+}
+
+/*****************************************************************************
+ *                                journal_commit
+ *****************************************************************************/
+/**
+ * Write the running transaction to the journal, then write every block to
+ * its home sector.
+ *****************************************************************************/
+PUBLIC void journal_commit()
+{
+	journal_countdown = 0;
+
+	if (jdev == NO_DEV || jhdr->nr_blocks == 0)
+		return;
+
+	int n = jhdr->nr_blocks;
+
+	jhdr->seq++;
+	jhdr->checksum = journal_checksum();
+	rw_sector(DEV_WRITE, jdev, (u64)j1st_sect * SECTOR_SIZE,
+		  (n + 1) * SECTOR_SIZE, TASK_FS, jbuf);
+
+	int i;
+	for (i = 0; i < n; i++)
+		rw_sector(DEV_WRITE, jdev, (u64)jhdr->sects[i] * SECTOR_SIZE,
+			  SECTOR_SIZE, TASK_FS, jbuf + (i + 1) * SECTOR_SIZE);
+
+	/* checkpointed, the next mount has nothing to replay */
+	jhdr->nr_blocks = 0;
+	rw_sector(DEV_WRITE, jdev, (u64)j1st_sect * SECTOR_SIZE,
+		  SECTOR_SIZE, TASK_FS, jbuf);
+
+	jnr_ops = 0;
+}
+
+/*****************************************************************************
+ *                                journal_lookup
+ *****************************************************************************/
+/**
+ * Find a sector in the running transaction.
+ *
+ * @param sect_nr  Sector nr.
+ *
+ * @return The block index, or -1 if the sector is not there.
+ *****************************************************************************/
+PRIVATE int journal_lookup(int sect_nr)
+{
+	int i;
+	for (i = 0; i < jhdr->nr_blocks; i++)
+		if (jhdr->sects[i] == sect_nr)
+			return i;
+	return -1;
+}
+
+/*****************************************************************************
+ *                                journal_checksum
+ *****************************************************************************/
+/**
+ * Checksum of the transaction in jbuf: seq, nr_blocks, sects[] and blocks.
+ *
+ * @return The checksum.
+ *****************************************************************************/
+PRIVATE u32 journal_checksum()
+{
+	u32 sum = jhdr->seq ^ jhdr->nr_blocks;
+	u32 * p = jhdr->sects;
+	u32 * end = (u32*)(jbuf + (jhdr->nr_blocks + 1) * SECTOR_SIZE);
+	u32 * blk0 = (u32*)(jbuf + SECTOR_SIZE);
+
+	for (; p < jhdr->sects + jhdr->nr_blocks; p++)
+		sum = ((sum << 1) | (sum >> 31)) + *p;
+	for (p = blk0; p < end; p++)
+		sum = ((sum << 1) | (sum >> 31)) + *p;
+
+	return sum;
+}
@@ -37,11 +37,11 @@ PUBLIC int do_unlink()
 	char pathname[MAX_PATH];
 
 	/* get parameters from the message */
-	int name_len = fs_msg.NAME_LEN;	/* length of filename */
-	int src = fs_msg.source;	/* caller proc nr. */
+	int name_len = fs_cur->msg.NAME_LEN;	/* length of filename */
+	int src = fs_cur->msg.source;	/* caller proc nr. */
 	assert(name_len < MAX_PATH);
 	phys_copy((void*)va2la(TASK_FS, pathname),
-		  (void*)va2la(src, fs_msg.PATHNAME),
+		  (void*)va2la(src, fs_cur->msg.PATHNAME),
 		  name_len);
 	pathname[name_len] = 0;
 
@@ -64,9 +64,10 @@ PUBLIC int do_unlink()
 
 	struct inode * pin = get_inode(dir_inode->i_dev, inode_nr);
 
-	if (pin->i_mode != I_REGULAR) { /* can only remove regular files */
+	/* can only remove regular files and FIFOs */
+	if (pin->i_mode != I_REGULAR && pin->i_mode != I_NAMED_PIPE) {
 		printl("{FS} cannot remove file %s, because "
-		       "it is not a regular file.\n",
+		       "it is not a regular file or a FIFO.\n",
 		       pathname);
 		return -1;
 	}
@@ -77,6 +78,18 @@ PUBLIC int do_unlink()
 		return -1;
 	}
 
+	/* a parked read may still be filling a buffer from the file */
+	lock_inode(pin);
+
+	/* i-map, s-map, the i-node and the dir entry */
+	if (journal_reserve(1 + smap_nr_sects(pin->i_dev, pin->i_start_sect,
+					      pin->i_nr_sects) +
+			    1 + 1) != 0) {
+		unlock_inode(pin);
+		put_inode(pin);
+		return -1;
+	}
+
 	struct super_block * sb = get_super_block(pin->i_dev);
 
 	/*************************/
@@ -156,6 +169,7 @@ PUBLIC int do_unlink()
 	pin->i_start_sect = 0;
 	pin->i_nr_sects = 0;
 	sync_inode(pin);
+	unlock_inode(pin);
 	/* release slot in inode_table[] */
 	put_inode(pin);
 
@@ -208,3 +222,96 @@ PUBLIC int do_unlink()
 
 	return 0;
 }
+
+/*****************************************************************************
+ *                                do_rename
+ *****************************************************************************/
+/**
+ * Rename a file.
+ *
+ * Only the name in the directory entry is rewritten; the i-node and the data
+ * sectors are left where they are, so renaming an opened file is fine.
+ * 
+ * @return On success, zero is returned.  On error, -1 is returned.
+ *****************************************************************************/
+PUBLIC int do_rename()
+{
+	char old_path[MAX_PATH];
+	char new_path[MAX_PATH];
+
+	/* get parameters from the message */
+	int old_len = fs_cur->msg.NAME_LEN;	/* length of old pathname */
+	int new_len = fs_cur->msg.BUF_LEN;	/* length of new pathname */
+	int src = fs_cur->msg.source;	/* caller proc nr. */
+	assert(old_len < MAX_PATH);
+	assert(new_len < MAX_PATH);
+	phys_copy((void*)va2la(TASK_FS, old_path),
+		  (void*)va2la(src, fs_cur->msg.PATHNAME),
+		  old_len);
+	old_path[old_len] = 0;
+	phys_copy((void*)va2la(TASK_FS, new_path),
+		  (void*)va2la(src, fs_cur->msg.BUF),
+		  new_len);
+	new_path[new_len] = 0;
+
+	if (strcmp(old_path, "/") == 0) {
+		printl("{FS} FS::do_rename():: cannot rename the root\n");
+		return -1;
+	}
+
+	int inode_nr = search_file(old_path);
+	if (inode_nr == INVALID_INODE) {	/* file not found */
+		printl("{FS} FS::do_rename():: search_file() returns "
+			"invalid inode: %s\n", old_path);
+		return -1;
+	}
+
+	if (search_file(new_path) != INVALID_INODE) {
+		printl("{FS} FS::do_rename():: %s already exists\n",
+		       new_path);
+		return -1;
+	}
+
+	char filename[MAX_PATH];
+	struct inode * dir_inode;
+	if (strip_path(filename, new_path, &dir_inode) != 0 ||
+	    filename[0] == 0)
+		return -1;
+
+	/*************************************/
+	/* rewrite the name in the dir entry */
+	/*************************************/
+	int dir_blk0_nr = dir_inode->i_start_sect;
+	int nr_dir_blks = (dir_inode->i_size + SECTOR_SIZE - 1) / SECTOR_SIZE;
+	int nr_dir_entries = dir_inode->i_size / DIR_ENTRY_SIZE;
+	int m = 0;
+	struct dir_entry * pde;
+
+	int i, j;
+	for (i = 0; i < nr_dir_blks; i++) {
+		RD_SECT(dir_inode->i_dev, dir_blk0_nr + i);
+
+		pde = (struct dir_entry *)fsbuf;
+		for (j = 0; j < SECTOR_SIZE / DIR_ENTRY_SIZE; j++,pde++) {
+			if (++m > nr_dir_entries)
+				break;
+
+			if (pde->inode_nr == inode_nr) {
+				/* filename may fill the whole field
+				 * without a trailing '\0' */
+				memset(pde->name, 0, MAX_FILENAME_LEN);
+				memcpy(pde->name, filename,
+				       min(strlen(filename), MAX_FILENAME_LEN));
+				WR_SECT(dir_inode->i_dev, dir_blk0_nr + i);
+				return 0;
+			}
+		}
+
+		if (m > nr_dir_entries) /* all entries have been iterated */
+			break;
+	}
+
+	/* search_file() found it, so the entry must be there */
+	assert(0);
+	return -1;
+}
@@ -27,6 +27,7 @@ PRIVATE void mkfs();
 PRIVATE void read_super_block(int dev);
 PRIVATE int fs_fork();
 PRIVATE int fs_exit();
+PRIVATE struct fs_req * get_fs_req();
 
 /*****************************************************************************
  *                                task_fs
@@ -42,55 +43,119 @@ PUBLIC void task_fs()
 	init_fs();
 
 	while (1) {
-		send_recv(RECEIVE, ANY, &fs_msg);
+		fs_cur = get_fs_req();
+		send_recv(RECEIVE, ANY, &fs_cur->msg);
 
-		int msgtype = fs_msg.type;
-		int src = fs_msg.source;
-		pcaller = &proc_table[src];
+		int msgtype = fs_cur->msg.type;
+		int src = fs_cur->msg.source;
+		if (src == NOTIFICATION) /* FS takes no notify() bits */
+			continue;
+		fs_cur->caller = &proc_table[src];
 
 		switch (msgtype) {
+		case HARD_INT:
+			/* clock_handler: the transaction is old enough */
+			journal_commit();
+			continue;
+		case DEV_READ:
+			/* the driver has finished a parked read */
+			assert(src == dd_map[MAJOR(ROOT_DEV)].driver_nr);
+			disk_done();
+			continue;
 		case OPEN:
-			fs_msg.FD = do_open();
+			fs_cur->msg.FD = do_open();
 			break;
 		case CLOSE:
-			fs_msg.RETVAL = do_close();
+			fs_cur->msg.RETVAL = do_close();
 			break;
 		case READ:
 		case WRITE:
-			fs_msg.CNT = do_rdwt();
+		case PREAD:
+		case PWRITE:
+			fs_cur->msg.CNT = do_rdwt();
+			break;
+		case READV:
+		case WRITEV:
+			fs_cur->msg.CNT = do_rdwtv();
 			break;
 		case UNLINK:
-			fs_msg.RETVAL = do_unlink();
+			fs_cur->msg.RETVAL = do_unlink();
+			break;
+		case RENAME:
+			fs_cur->msg.RETVAL = do_rename();
+			break;
+		case COPY_RANGE:
+			fs_cur->msg.CNT = do_copy_range();
+			break;
+		case FTRUNCATE:
+			fs_cur->msg.RETVAL = do_ftruncate();
+			break;
+		case FALLOCATE:
+			fs_cur->msg.RETVAL = do_fallocate();
+			break;
+		case MMAP:
+			fs_cur->msg.BUF = do_mmap();
+			break;
+		case MUNMAP:
+			fs_cur->msg.RETVAL = do_munmap();
+			break;
+		case PIPE:
+			fs_cur->msg.RETVAL = do_pipe();
+			break;
+		case MKFIFO:
+			fs_cur->msg.RETVAL = do_mkfifo();
+			break;
+		case DUP:
+			fs_cur->msg.RETVAL = do_dup();
+			break;
+		case IOCTL:
+			fs_cur->msg.RETVAL = do_ioctl();
 			break;
 		case RESUME_PROC:
-			src = fs_msg.PROC_NR;
+			src = fs_cur->msg.PROC_NR;
 			break;
 		case FORK:
-			fs_msg.RETVAL = fs_fork();
+			fs_cur->msg.RETVAL = fs_fork();
 			break;
 		case EXIT:
-			fs_msg.RETVAL = fs_exit();
+			fs_cur->msg.RETVAL = fs_exit();
 			break;
 		case LSEEK:
-			fs_msg.OFFSET = do_lseek();
+			fs_cur->msg.OFFSET = do_lseek();
 			break;
 		case STAT:
-			fs_msg.RETVAL = do_stat();
+			fs_cur->msg.RETVAL = do_stat();
 			break;
 		default:
-			dump_msg("FS::unknown message:", &fs_msg);
+			dump_msg("FS::unknown message:", &fs_cur->msg);
 			assert(0);
 			break;
 		}
 
+		journal_end_op();
+
 #ifdef ENABLE_DISK_LOG
 		char * msg_name[128];
 		msg_name[OPEN]   = "OPEN";
 		msg_name[CLOSE]  = "CLOSE";
 		msg_name[READ]   = "READ";
 		msg_name[WRITE]  = "WRITE";
+		msg_name[PREAD]  = "PREAD";
+		msg_name[PWRITE] = "PWRITE";
+		msg_name[READV]  = "READV";
+		msg_name[WRITEV] = "WRITEV";
 		msg_name[LSEEK]  = "LSEEK";
 		msg_name[UNLINK] = "UNLINK";
+		msg_name[RENAME] = "RENAME";
+		msg_name[COPY_RANGE] = "COPY_RANGE";
+		msg_name[FTRUNCATE] = "FTRUNCATE";
+		msg_name[FALLOCATE] = "FALLOCATE";
+		msg_name[MMAP]   = "MMAP";
+		msg_name[MUNMAP] = "MUNMAP";
+		msg_name[PIPE]   = "PIPE";
+		msg_name[MKFIFO] = "MKFIFO";
+		msg_name[DUP]    = "DUP";
+		msg_name[IOCTL]  = "IOCTL";
 		msg_name[FORK]   = "FORK";
 		msg_name[EXIT]   = "EXIT";
 		msg_name[STAT]   = "STAT";
@@ -104,6 +169,20 @@ PUBLIC void task_fs()
 		case CLOSE:
 		case READ:
 		case WRITE:
+		case PREAD:
+		case PWRITE:
+		case READV:
+		case WRITEV:
+		case RENAME:
+		case COPY_RANGE:
+		case FTRUNCATE:
+		case FALLOCATE:
+		case MMAP:
+		case MUNMAP:
+		case PIPE:
+		case MKFIFO:
+		case DUP:
+		case IOCTL:
 		case FORK:
 		case EXIT:
 		case LSEEK:
@@ -117,13 +196,37 @@ PUBLIC void task_fs()
 #endif
 
 		/* reply */
-		if (fs_msg.type != SUSPEND_PROC) {
-			fs_msg.type = SYSCALL_RET;
-			send_recv(SEND, src, &fs_msg);
+		if (fs_cur->msg.type != SUSPEND_PROC) {
+			fs_cur->msg.type = SYSCALL_RET;
+			send_recv(SEND, src, &fs_cur->msg);
 		}
 	}
 }
 
+/*****************************************************************************
+ *                                get_fs_req
+ *****************************************************************************/
+/**
+ * <Ring 1> Find a slot in fs_req_table[] for the next request.
+ *
+ * If every slot is parked, the disk is waited for until one is free. FS
+ * does not RECEIVE meanwhile, so further callers just stay blocked in
+ * send_recv() like they did before requests could be parked.
+ * 
+ * @return  A slot whose request is not parked.
+ *****************************************************************************/
+PRIVATE struct fs_req * get_fs_req()
+{
+	struct fs_req * r;
+	while (1) {
+		for (r = fs_req_table; r < &fs_req_table[NR_FS_REQS]; r++)
+			if (!r->parked)
+				return r;
+
+		disk_drain();
+	}
+}
+
 /*****************************************************************************
  *                                init_fs
  *****************************************************************************/
@@ -143,6 +246,10 @@ PRIVATE void init_fs()
 	for (i = 0; i < NR_INODE; i++)
 		memset(&inode_table[i], 0, sizeof(struct inode));
 
+	/* fs_req_table[] */
+	for (i = 0; i < NR_FS_REQS; i++)
+		memset(&fs_req_table[i], 0, sizeof(struct fs_req));
+
 	/* super_block[] */
 	struct super_block * sb = super_block;
 	for (; sb < &super_block[NR_SUPER_BLOCK]; sb++)
@@ -158,10 +265,12 @@ PRIVATE void init_fs()
 	/* read the super block of ROOT DEVICE */
 	RD_SECT(ROOT_DEV, 1);
 
+	int fresh = 0;
 	sb = (struct super_block *)fsbuf;
 	if (sb->magic != MAGIC_V1) {
 		printl("{FS} mkfs\n");
 		mkfs(); /* make FS */
+		fresh = 1;
 	}
 
 	/* load super block of ROOT */
@@ -170,6 +279,28 @@ PRIVATE void init_fs()
 	sb = get_super_block(ROOT_DEV);
 	assert(sb->magic == MAGIC_V1);
 
+	/**
+	 * The sectors of cmd.tar are marked with set_smap_bits(), the routine
+	 * which frees them when fallocate() moves the file, so both map a
+	 * sector to the same bit.
+	 */
+	if (fresh)
+		set_smap_bits(ROOT_DEV, INSTALL_START_SECT, INSTALL_NR_SECTS, 1);
+
+	/* replay the metadata journal, if any */
+	journal_init(ROOT_DEV);
+
+#ifdef SET_LOG_SECT_SMAP_AT_STARTUP
+	/**
+	 * Set sector-map so that other files cannot use the log sectors. This
+	 * goes through the journal like every other sector-map write; the log
+	 * text itself is file data and is written by disklog() directly.
+	 */
+	int log_1st_sect = sb->nr_sects - NR_SECTS_FOR_LOG;
+	if (smap_run_free(ROOT_DEV, log_1st_sect, NR_SECTS_FOR_LOG))
+		set_smap_bits(ROOT_DEV, log_1st_sect, NR_SECTS_FOR_LOG, 1);
+#endif
+
 	root_inode = get_inode(ROOT_DEV, ROOT_INODE);
 }
 
@@ -181,10 +312,12 @@ PRIVATE void init_fs()
  *          - Write a super block to sector 1.
  *          - Create three special files: dev_tty0, dev_tty1, dev_tty2
  *          - Create a file cmd.tar
+ *          - Create a special file for the serial line: dev_ttyS0
  *          - Create the inode map
  *          - Create the sector map
  *          - Create the inodes of the files
  *          - Create `/', the root directory
+ *          - Clear the journal header
  *****************************************************************************/
 PRIVATE void mkfs()
 {
@@ -246,18 +379,19 @@ PRIVATE void mkfs()
 	/*       inode map      */
 	/************************/
 	memset(fsbuf, 0, SECTOR_SIZE);
-	for (i = 0; i < (NR_CONSOLES + 3); i++)
+	for (i = 0; i < (NR_TTYS + 3); i++)
 		fsbuf[0] |= 1 << i;
 
-	assert(fsbuf[0] == 0x3F);/* 0011 1111 :
-				  *   || ||||
-				  *   || |||`--- bit 0 : reserved
-				  *   || ||`---- bit 1 : the first inode,
-				  *   || ||              which indicates `/'
-				  *   || |`----- bit 2 : /dev_tty0
-				  *   || `------ bit 3 : /dev_tty1
-				  *   |`-------- bit 4 : /dev_tty2
-				  *   `--------- bit 5 : /cmd.tar
+	assert(fsbuf[0] == 0x7F);/* 0111 1111 :
+				  *  ||| ||||
+				  *  ||| |||`--- bit 0 : reserved
+				  *  ||| ||`---- bit 1 : the first inode,
+				  *  ||| ||              which indicates `/'
+				  *  ||| |`----- bit 2 : /dev_tty0
+				  *  ||| `------ bit 3 : /dev_tty1
+				  *  ||`-------- bit 4 : /dev_tty2
+				  *  |`--------- bit 5 : /cmd.tar
+				  *  `---------- bit 6 : /dev_ttyS0
 				  */
 	WR_SECT(ROOT_DEV, 2);
 
@@ -284,29 +418,10 @@ PRIVATE void mkfs()
 		WR_SECT(ROOT_DEV, 2 + sb.nr_imap_sects + i);
 
 	/* cmd.tar */
-	/* make sure it'll not be overwritten by the disk log */
+	/* make sure it'll not be overwritten by the journal or the disk log */
 	assert(INSTALL_START_SECT + INSTALL_NR_SECTS < 
-	       sb.nr_sects - NR_SECTS_FOR_LOG);
-	int bit_offset = INSTALL_START_SECT -
-		sb.n_1st_sect + 1; /* sect M <-> bit (M - sb.n_1stsect + 1) */
-	int bit_off_in_sect = bit_offset % (SECTOR_SIZE * 8);
-	int bit_left = INSTALL_NR_SECTS;
-	int cur_sect = bit_offset / (SECTOR_SIZE * 8);
-	RD_SECT(ROOT_DEV, 2 + sb.nr_imap_sects + cur_sect);
-	while (bit_left) {
-		int byte_off = bit_off_in_sect / 8;
-		/* this line is ineffecient in a loop, but I don't care */
-		fsbuf[byte_off] |= 1 << (bit_off_in_sect % 8);
-		bit_left--;
-		bit_off_in_sect++;
-		if (bit_off_in_sect == (SECTOR_SIZE * 8)) {
-			WR_SECT(ROOT_DEV, 2 + sb.nr_imap_sects + cur_sect);
-			cur_sect++;
-			RD_SECT(ROOT_DEV, 2 + sb.nr_imap_sects + cur_sect);
-			bit_off_in_sect = 0;
-		}
-	}
-	WR_SECT(ROOT_DEV, 2 + sb.nr_imap_sects + cur_sect);
+	       sb.nr_sects - NR_SECTS_FOR_LOG - JOURNAL_NR_SECTS);
+	/* its sectors are marked by init_fs() once the super block is loaded */
 
 	/************************/
 	/*       inodes         */
@@ -315,10 +430,10 @@ PRIVATE void mkfs()
 	memset(fsbuf, 0, SECTOR_SIZE);
 	struct inode * pi = (struct inode*)fsbuf;
 	pi->i_mode = I_DIRECTORY;
-	pi->i_size = DIR_ENTRY_SIZE * 5; /* 5 files:
+	pi->i_size = DIR_ENTRY_SIZE * 6; /* 6 files:
 					  * `.',
 					  * `dev_tty0', `dev_tty1', `dev_tty2',
-					  * `cmd.tar'
+					  * `cmd.tar', `dev_ttyS0'
 					  */
 	pi->i_start_sect = sb.n_1st_sect;
 	pi->i_nr_sects = NR_DEFAULT_FILE_SECTS;
@@ -336,6 +451,15 @@ PRIVATE void mkfs()
 	pi->i_size = INSTALL_NR_SECTS * SECTOR_SIZE;
 	pi->i_start_sect = INSTALL_START_SECT;
 	pi->i_nr_sects = INSTALL_NR_SECTS;
+	/* inode of `/dev_ttyS0', after cmd.tar to keep its inode_nr */
+	for (i = 0; i < NR_SERIALS; i++) {
+		pi = (struct inode*)(fsbuf +
+				     (INODE_SIZE * (NR_CONSOLES + 2 + i)));
+		pi->i_mode = I_CHAR_SPECIAL;
+		pi->i_size = 0;
+		pi->i_start_sect = MAKE_DEV(DEV_CHAR_TTY, NR_CONSOLES + i);
+		pi->i_nr_sects = 0;
+	}
 	WR_SECT(ROOT_DEV, 2 + sb.nr_imap_sects + sb.nr_smap_sects);
 
 	/************************/
@@ -355,7 +479,20 @@ PRIVATE void mkfs()
 	}
 	(++pde)->inode_nr = NR_CONSOLES + 2;
 	sprintf(pde->name, "cmd.tar", i);
+	/* dir entries of `/dev_ttyS0' */
+	for (i = 0; i < NR_SERIALS; i++) {
+		pde++;
+		pde->inode_nr = NR_CONSOLES + 3 + i;
+		sprintf(pde->name, "dev_ttyS%d", i);
+	}
 	WR_SECT(ROOT_DEV, sb.n_1st_sect);
+
+	/************************/
+	/*       journal        */
+	/************************/
+	/* a transaction left by the old FS must not be replayed */
+	memset(fsbuf, 0, SECTOR_SIZE);
+	WR_SECT(ROOT_DEV, sb.nr_sects - NR_SECTS_FOR_LOG - JOURNAL_NR_SECTS);
 }
 
 /*****************************************************************************
@@ -378,6 +515,9 @@ PUBLIC int rw_sector(int io_type, int dev, u64 pos, int bytes, int proc_nr,
 {
 	MESSAGE driver_msg;
 
+	/* the driver takes one request at a time */
+	disk_drain();
+
 	driver_msg.type		= io_type;
 	driver_msg.DEVICE	= MINOR(dev);
 	driver_msg.POSITION	= pos;
@@ -525,6 +665,37 @@ PUBLIC void put_inode(struct inode * pinode)
 	pinode->i_cnt--;
 }
 
+/*****************************************************************************
+ *                                lock_inode
+ *****************************************************************************/
+/**
+ * Take an i-node for the current request (fs_cur).
+ *
+ * Only a parked request can hold an i-node across messages, so waiting for
+ * the holder means waiting for the disk.
+ * 
+ * @param pinode I-node ptr.
+ *****************************************************************************/
+PUBLIC void lock_inode(struct inode * pinode)
+{
+	while (pinode->i_lock && pinode->i_lock != fs_cur)
+		disk_drain();
+	pinode->i_lock = fs_cur;
+}
+
+/*****************************************************************************
+ *                                unlock_inode
+ *****************************************************************************/
+/**
+ * Release an i-node taken by lock_inode().
+ * 
+ * @param pinode I-node ptr.
+ *****************************************************************************/
+PUBLIC void unlock_inode(struct inode * pinode)
+{
+	pinode->i_lock = 0;
+}
+
 /*****************************************************************************
  *                                sync_inode
  *****************************************************************************/
@@ -562,7 +733,7 @@ PUBLIC void sync_inode(struct inode * p)
 PRIVATE int fs_fork()
 {
 	int i;
-	struct proc* child = &proc_table[fs_msg.PID];
+	struct proc* child = &proc_table[fs_cur->msg.PID];
 	for (i = 0; i < NR_FILES; i++) {
 		if (child->filp[i]) {
 			child->filp[i]->fd_cnt++;
@@ -585,9 +756,17 @@ PRIVATE int fs_fork()
 PRIVATE int fs_exit()
 {
 	int i;
-	struct proc* p = &proc_table[fs_msg.PID];
+	struct proc* p = &proc_table[fs_cur->msg.PID];
+
+	mmap_exit(fs_cur->msg.PID);
+
 	for (i = 0; i < NR_FILES; i++) {
 		if (p->filp[i]) {
+			/* wake whoever waits on the other end of a pipe */
+			if (p->filp[i]->fd_cnt == 1 &&
+			    (p->filp[i]->fd_inode->i_mode & I_TYPE_MASK) ==
+			    I_NAMED_PIPE)
+				pipe_close(p->filp[i]);
 			/* release the inode */
 			p->filp[i]->fd_inode->i_cnt--;
 			/* release the file desc slot */
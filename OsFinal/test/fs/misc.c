@@ -37,11 +37,11 @@ PUBLIC int do_stat()
 	char filename[MAX_PATH]; /* directory has been stipped */
 
 	/* get parameters from the message */
-	int name_len = fs_msg.NAME_LEN;	/* length of filename */
-	int src = fs_msg.source;	/* caller proc nr. */
+	int name_len = fs_cur->msg.NAME_LEN;	/* length of filename */
+	int src = fs_cur->msg.source;	/* caller proc nr. */
 	assert(name_len < MAX_PATH);
 	phys_copy((void*)va2la(TASK_FS, pathname),    /* to   */
-		  (void*)va2la(src, fs_msg.PATHNAME), /* from */
+		  (void*)va2la(src, fs_cur->msg.PATHNAME), /* from */
 		  name_len);
 	pathname[name_len] = 0;	/* terminate the string */
 
@@ -73,7 +73,7 @@ PUBLIC int do_stat()
 
 	put_inode(pin);
 
-	phys_copy((void*)va2la(src, fs_msg.BUF), /* to   */
+	phys_copy((void*)va2la(src, fs_cur->msg.BUF), /* to   */
 		  (void*)va2la(TASK_FS, &s),	 /* from */
 		  sizeof(struct stat));
 
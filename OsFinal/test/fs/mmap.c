@@ -0,0 +1,346 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   mmap.c
+ * @brief  mmap() / munmap() over the FS page cache.
+ *
+ * A mapping is a run of pages in pcache holding a range of a file. MAP_SHARED
+ * mappings of the same range share their pages. The two ways into the file
+ * agree with each other:
+ *   - write() copies what it writes into the shared mappings, mmap_update();
+ *   - read() takes the bytes of a shared mapping from pcache rather than from
+ *     the disk, mmap_fetch(), since stores through the mapping reach the
+ *     disk only when munmap() writes it back.
+ *
+ * Processes are not paged, so the pages are filled when the mapping is made
+ * rather than on first touch, and only the native procs (whose segments
+ * cover the whole memory) can reach pcache at all.
+ *
+ * @author Forrest Y. Yu
+ * @date   2008
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "keyboard.h"
+#include "proto.h"
+
+/**
+ * @struct pcache_map
+ * @brief  A file range held in pcache.
+ */
+PRIVATE struct pcache_map {
+	struct inode *	pin;	/**< The file, 0: free slot */
+	int	pos;		/**< File offset of the 1st byte */
+	int	len;		/**< How many bytes are mapped */
+	int	page0;		/**< 1st page in pcache */
+	int	nr_pages;	/**< How many pages */
+	int	prot;		/**< PROT_READ | PROT_WRITE */
+	int	flags;		/**< MAP_SHARED or MAP_PRIVATE */
+	int	cnt;		/**< How many mmap() share it */
+} map_table[NR_PCACHE_MAPS];
+
+/**
+ * @struct map_ref
+ * @brief  One mmap() of one proc.
+ */
+PRIVATE struct map_ref {
+	int			pid;	/**< Who called mmap() */
+	struct pcache_map *	map;	/**< 0: free slot */
+} ref_table[NR_MAP_REFS];
+
+PRIVATE u8 page_used[NR_PCACHE_PAGES];
+
+PRIVATE int alloc_pages(int nr_pages);
+PRIVATE void drop_ref(struct map_ref * ref);
+
+/*****************************************************************************
+ *                                do_mmap
+ *****************************************************************************/
+/**
+ * Handle the message MMAP.
+ *
+ * @return The address of the mapping in the caller, or MAP_FAILED.
+ *****************************************************************************/
+PUBLIC void * do_mmap()
+{
+	int fd = fs_cur->msg.FD;
+	int len = fs_cur->msg.CNT;
+	int pos = (int)fs_cur->msg.POSITION;
+	int prot = fs_cur->msg.MMAP_PROT;
+	int flags = fs_cur->msg.MMAP_FLAGS;
+	int src = fs_cur->msg.source;
+
+	if (src >= NR_TASKS + NR_NATIVE_PROCS) {
+		printl("{FS} FS::do_mmap():: pcache is out of reach of proc %d\n",
+		       src);
+		return MAP_FAILED;
+	}
+
+	if (fd < 0 || fd >= NR_FILES || !fs_cur->caller->filp[fd])
+		return MAP_FAILED;
+
+	struct inode * pin = fs_cur->caller->filp[fd]->fd_inode;
+
+	if (pin->i_mode != I_REGULAR || len <= 0 || pos < 0 ||
+	    pos % PCACHE_PAGE_SIZE != 0 ||
+	    pos + len > pin->i_nr_sects * SECTOR_SIZE ||
+	    (flags != MAP_SHARED && flags != MAP_PRIVATE))
+		return MAP_FAILED;
+
+	struct map_ref * ref;
+	for (ref = ref_table; ref < &ref_table[NR_MAP_REFS]; ref++)
+		if (!ref->map)
+			break;
+	if (ref == &ref_table[NR_MAP_REFS])
+		return MAP_FAILED;
+
+	struct pcache_map * map = 0;
+	struct pcache_map * m;
+	if (flags == MAP_SHARED) {
+		for (m = map_table; m < &map_table[NR_PCACHE_MAPS]; m++) {
+			if (m->pin == pin && m->pos == pos && m->len == len &&
+			    m->flags == MAP_SHARED) {
+				map = m;
+				map->prot |= prot;
+				map->cnt++;
+				break;
+			}
+		}
+	}
+
+	if (!map) {
+		for (m = map_table; m < &map_table[NR_PCACHE_MAPS]; m++)
+			if (!m->pin)
+				break;
+		if (m == &map_table[NR_PCACHE_MAPS])
+			return MAP_FAILED;
+
+		int nr_pages = (len + PCACHE_PAGE_SIZE - 1) / PCACHE_PAGE_SIZE;
+		int page0 = alloc_pages(nr_pages);
+		if (page0 < 0)
+			return MAP_FAILED;
+
+		map = m;
+		map->pin	= pin;
+		map->pos	= pos;
+		map->len	= len;
+		map->page0	= page0;
+		map->nr_pages	= nr_pages;
+		map->prot	= prot;
+		map->flags	= flags;
+		map->cnt	= 1;
+		pin->i_cnt++;	/* keep the file while it is mapped */
+
+		/* bytes past the end of the file read as zero */
+		u8 * p = pcache + page0 * PCACHE_PAGE_SIZE;
+		memset(p, 0, nr_pages * PCACHE_PAGE_SIZE);
+		rdwt_file(pin, READ, pos, min(len, pin->i_size - pos),
+			  TASK_FS, p, 0);
+	}
+
+	ref->pid = src;
+	ref->map = map;
+
+	/* native procs are flat: the linear address is the virtual one */
+	return pcache + map->page0 * PCACHE_PAGE_SIZE;
+}
+
+/*****************************************************************************
+ *                                do_munmap
+ *****************************************************************************/
+/**
+ * Handle the message MUNMAP.
+ *
+ * @return Zero if success, otherwise -1.
+ *****************************************************************************/
+PUBLIC int do_munmap()
+{
+	u8 * addr = fs_cur->msg.BUF;
+	int src = fs_cur->msg.source;
+
+	struct map_ref * ref;
+	for (ref = ref_table; ref < &ref_table[NR_MAP_REFS]; ref++) {
+		if (ref->map && ref->pid == src &&
+		    pcache + ref->map->page0 * PCACHE_PAGE_SIZE == addr) {
+			drop_ref(ref);
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+/*****************************************************************************
+ *                                mmap_exit
+ *****************************************************************************/
+/**
+ * Unmap everything a proc has mapped, called when it exits.
+ *
+ * @param pid  The proc.
+ *****************************************************************************/
+PUBLIC void mmap_exit(int pid)
+{
+	struct map_ref * ref;
+	for (ref = ref_table; ref < &ref_table[NR_MAP_REFS]; ref++)
+		if (ref->map && ref->pid == pid)
+			drop_ref(ref);
+}
+
+/*****************************************************************************
+ *                                mmap_update
+ *****************************************************************************/
+/**
+ * Copy bytes just written to a file into its shared mappings, so that the
+ * mappings see what write() did.
+ *
+ * @param pin  I-node of the file.
+ * @param pos  File offset of the bytes.
+ * @param len  How many bytes.
+ * @param src  Proc nr of the buffer.
+ * @param buf  The bytes.
+ *****************************************************************************/
+PUBLIC void mmap_update(struct inode * pin, int pos, int len,
+			int src, void * buf)
+{
+	struct pcache_map * m;
+	for (m = map_table; m < &map_table[NR_PCACHE_MAPS]; m++) {
+		if (m->pin != pin || m->flags != MAP_SHARED)
+			continue;
+
+		int lo = max(pos, m->pos);
+		int hi = min(pos + len, m->pos + m->len);
+		if (lo >= hi)
+			continue;
+
+		phys_copy(pcache + m->page0 * PCACHE_PAGE_SIZE + (lo - m->pos),
+			  (void*)va2la(src, buf + (lo - pos)),
+			  hi - lo);
+	}
+}
+
+/*****************************************************************************
+ *                                mmap_shared
+ *****************************************************************************/
+/**
+ * Check whether some bytes of a file are in a shared mapping.
+ *
+ * @param pin  I-node of the file.
+ * @param pos  File offset of the bytes.
+ * @param len  How many bytes.
+ *
+ * @return Non-zero if any of them is.
+ *****************************************************************************/
+PUBLIC int mmap_shared(struct inode * pin, int pos, int len)
+{
+	struct pcache_map * m;
+	for (m = map_table; m < &map_table[NR_PCACHE_MAPS]; m++)
+		if (m->pin == pin && m->flags == MAP_SHARED &&
+		    max(pos, m->pos) < min(pos + len, m->pos + m->len))
+			return 1;
+
+	return 0;
+}
+
+/*****************************************************************************
+ *                                mmap_fetch
+ *****************************************************************************/
+/**
+ * Copy the shared mappings of a file over bytes just read from the disk, so
+ * that read() sees the stores made through the mappings.
+ *
+ * @param pin  I-node of the file.
+ * @param pos  File offset of the bytes.
+ * @param len  How many bytes.
+ * @param src  Proc nr of the buffer.
+ * @param buf  The bytes.
+ *****************************************************************************/
+PUBLIC void mmap_fetch(struct inode * pin, int pos, int len,
+		       int src, void * buf)
+{
+	struct pcache_map * m;
+	for (m = map_table; m < &map_table[NR_PCACHE_MAPS]; m++) {
+		if (m->pin != pin || m->flags != MAP_SHARED)
+			continue;
+
+		int lo = max(pos, m->pos);
+		int hi = min(pos + len, m->pos + m->len);
+		if (lo >= hi)
+			continue;
+
+		phys_copy((void*)va2la(src, buf + (lo - pos)),
+			  pcache + m->page0 * PCACHE_PAGE_SIZE + (lo - m->pos),
+			  hi - lo);
+	}
+}
+
+/*****************************************************************************
+ *                                drop_ref
+ *****************************************************************************/
+/**
+ * Undo one mmap(). A writable shared mapping is written back; the pages are
+ * freed when nobody maps them any more.
+ *
+ * @param ref  The mmap() to undo.
+ *****************************************************************************/
+PRIVATE void drop_ref(struct map_ref * ref)
+{
+	struct pcache_map * map = ref->map;
+	struct inode * pin = map->pin;
+	u8 * p = pcache + map->page0 * PCACHE_PAGE_SIZE;
+
+	ref->map = 0;
+
+	if (map->flags == MAP_SHARED && (map->prot & PROT_WRITE) &&
+	    map->pos < pin->i_size) {
+		lock_inode(pin);
+		rdwt_file(pin, WRITE, map->pos,
+			  min(map->len, pin->i_size - map->pos),
+			  TASK_FS, p, 0);
+		unlock_inode(pin);
+	}
+
+	if (--map->cnt)
+		return;
+
+	memset(&page_used[map->page0], 0, map->nr_pages);
+	put_inode(pin);
+	map->pin = 0;
+}
+
+/*****************************************************************************
+ *                                alloc_pages
+ *****************************************************************************/
+/**
+ * Find a run of free pages in pcache and mark them used.
+ *
+ * @param nr_pages  How many pages.
+ *
+ * @return The 1st page of the run, or -1 if there is no such run.
+ *****************************************************************************/
+PRIVATE int alloc_pages(int nr_pages)
+{
+	int i;
+	int run = 0;
+	for (i = 0; i < NR_PCACHE_PAGES; i++) {
+		if (page_used[i]) {
+			run = 0;
+			continue;
+		}
+		if (++run == nr_pages) {
+			int page0 = i - nr_pages + 1;
+			memset(&page_used[page0], 1, nr_pages);
+			return page0;
+		}
+	}
+
+	return -1;
+}
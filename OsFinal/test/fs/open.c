@@ -5,6 +5,8 @@
  *   - do_open()
  *   - do_close()
  *   - do_lseek()
+ *   - do_dup()
+ *   - do_mkfifo()
  *   - create_file()
  * @author Forrest Yu
  * @date   2007
@@ -25,10 +27,12 @@
 #include "proto.h"
 
 PRIVATE struct inode * create_file(char * path, int flags);
+PRIVATE void close_fd(int fd);
 PRIVATE int alloc_imap_bit(int dev);
 PRIVATE int alloc_smap_bit(int dev, int nr_sects_to_alloc);
 PRIVATE struct inode * new_inode(int dev, int inode_nr, int start_sect);
 PRIVATE void new_dir_entry(struct inode * dir_inode, int inode_nr, char * filename);
+PRIVATE int find_free_extent(int dev, int nr_sects);
 
 /*****************************************************************************
  *                                do_open
@@ -45,32 +49,33 @@ PUBLIC int do_open()
 	char pathname[MAX_PATH];
 
 	/* get parameters from the message */
-	int flags = fs_msg.FLAGS;	/* access mode */
-	int name_len = fs_msg.NAME_LEN;	/* length of filename */
-	int src = fs_msg.source;	/* caller proc nr. */
+	int flags = fs_cur->msg.FLAGS;	/* access mode */
+	int name_len = fs_cur->msg.NAME_LEN;	/* length of filename */
+	int src = fs_cur->msg.source;	/* caller proc nr. */
 	assert(name_len < MAX_PATH);
 	phys_copy((void*)va2la(TASK_FS, pathname),
-		  (void*)va2la(src, fs_msg.PATHNAME),
+		  (void*)va2la(src, fs_cur->msg.PATHNAME),
 		  name_len);
 	pathname[name_len] = 0;
 
 	/* find a free slot in PROCESS::filp[] */
 	int i;
 	for (i = 0; i < NR_FILES; i++) {
-		if (pcaller->filp[i] == 0) {
+		if (fs_cur->caller->filp[i] == 0) {
 			fd = i;
 			break;
 		}
 	}
 	if ((fd < 0) || (fd >= NR_FILES))
-		panic("filp[] is full (PID:%d)", proc2pid(pcaller));
+		panic("filp[] is full (PID:%d)", proc2pid(fs_cur->caller));
 
 	/* find a free slot in f_desc_table[] */
 	for (i = 0; i < NR_FILE_DESC; i++)
 		if (f_desc_table[i].fd_inode == 0)
 			break;
 	if (i >= NR_FILE_DESC)
-		panic("f_desc_table[] is full (PID:%d)", proc2pid(pcaller));
+		panic("f_desc_table[] is full (PID:%d)",
+		      proc2pid(fs_cur->caller));
 
 	int inode_nr = search_file(pathname);
 
@@ -85,6 +90,18 @@ PUBLIC int do_open()
 			return -1;
 		}
 	}
+	else if (flags == O_RDONLY || flags == O_WRONLY) { /* FIFO exists */
+		char filename[MAX_PATH];
+		struct inode * dir_inode;
+		if (strip_path(filename, pathname, &dir_inode) != 0)
+			return -1;
+		pin = get_inode(dir_inode->i_dev, inode_nr);
+		if (pin->i_mode != I_NAMED_PIPE) {
+			printl("{FS} not a FIFO: %s\n", pathname);
+			put_inode(pin);
+			return -1;
+		}
+	}
 	else if (flags & O_RDWR) { /* file exists */
 		if ((flags & O_CREAT) && (!(flags & O_TRUNC))) {
 			assert(flags == (O_RDWR | O_CREAT));
@@ -100,6 +117,12 @@ PUBLIC int do_open()
 		if (strip_path(filename, pathname, &dir_inode) != 0)
 			return -1;
 		pin = get_inode(dir_inode->i_dev, inode_nr);
+		if (pin->i_mode == I_NAMED_PIPE) {
+			printl("{FS} open FIFO %s with O_RDONLY or O_WRONLY\n",
+			       pathname);
+			put_inode(pin);
+			return -1;
+		}
 	}
 	else { /* file exists, no O_RDWR flag */
 		printl("{FS} file exists: %s\n", pathname);
@@ -114,7 +137,7 @@ PUBLIC int do_open()
 
 	if (pin) {
 		/* connects proc with file_descriptor */
-		pcaller->filp[fd] = &f_desc_table[i];
+		fs_cur->caller->filp[fd] = &f_desc_table[i];
 
 		/* connects file_descriptor with inode */
 		f_desc_table[i].fd_inode = pin;
@@ -139,6 +162,15 @@ PUBLIC int do_open()
 		else if (imode == I_DIRECTORY) {
 			assert(pin->i_num == ROOT_INODE);
 		}
+		else if (imode == I_NAMED_PIPE) {
+			if (pipe_open(pin, &f_desc_table[i]) != 0) {
+				printl("{FS} no free pipe for %s\n", pathname);
+				f_desc_table[i].fd_inode = 0;
+				fs_cur->caller->filp[fd] = 0;
+				put_inode(pin);
+				return -1;
+			}
+		}
 		else {
 			assert(pin->i_mode == I_REGULAR);
 		}
@@ -171,9 +203,14 @@ PRIVATE struct inode * create_file(char * path, int flags)
 	if (strip_path(filename, path, &dir_inode) != 0)
 		return 0;
 
-	int inode_nr = alloc_imap_bit(dir_inode->i_dev);
 	int free_sect_nr = alloc_smap_bit(dir_inode->i_dev,
 					  NR_DEFAULT_FILE_SECTS);
+	if (!free_sect_nr) {
+		printl("{FS} no free extent for %s\n", path);
+		return 0;
+	}
+
+	int inode_nr = alloc_imap_bit(dir_inode->i_dev);
 	struct inode *newino = new_inode(dir_inode->i_dev, inode_nr,
 					 free_sect_nr);
 
@@ -192,11 +229,100 @@ PRIVATE struct inode * create_file(char * path, int flags)
  *****************************************************************************/
 PUBLIC int do_close()
 {
-	int fd = fs_msg.FD;
-	put_inode(pcaller->filp[fd]->fd_inode);
-	if (--pcaller->filp[fd]->fd_cnt == 0)
-		pcaller->filp[fd]->fd_inode = 0;
-	pcaller->filp[fd] = 0;
+	close_fd(fs_cur->msg.FD);
+
+	return 0;
+}
+
+/*****************************************************************************
+ *                                close_fd
+ *****************************************************************************/
+/**
+ * Drop a fd of the caller, and its desc if nobody else shares it.
+ * 
+ * @param fd  The fd, must be open.
+ *****************************************************************************/
+PRIVATE void close_fd(int fd)
+{
+	struct file_desc * f = fs_cur->caller->filp[fd];
+
+	if (f->fd_cnt == 1 &&
+	    (f->fd_inode->i_mode & I_TYPE_MASK) == I_NAMED_PIPE)
+		pipe_close(f);
+
+	put_inode(f->fd_inode);
+	if (--f->fd_cnt == 0)
+		f->fd_inode = 0;
+	fs_cur->caller->filp[fd] = 0;
+}
+
+/*****************************************************************************
+ *                                do_dup
+ *****************************************************************************/
+/**
+ * Handle the message DUP: make FD_OUT refer to the same desc as FD, closing
+ * whatever FD_OUT referred to before.
+ * 
+ * @return FD_OUT if success, otherwise -1.
+ *****************************************************************************/
+PUBLIC int do_dup()
+{
+	int fd = fs_cur->msg.FD;
+	int newfd = fs_cur->msg.FD_OUT;
+
+	if (fd < 0 || fd >= NR_FILES || !fs_cur->caller->filp[fd] ||
+	    newfd < 0 || newfd >= NR_FILES)
+		return -1;
+
+	if (newfd == fd)
+		return newfd;
+
+	if (fs_cur->caller->filp[newfd])
+		close_fd(newfd);
+
+	fs_cur->caller->filp[newfd] = fs_cur->caller->filp[fd];
+	fs_cur->caller->filp[newfd]->fd_cnt++;
+	fs_cur->caller->filp[newfd]->fd_inode->i_cnt++;
+
+	return newfd;
+}
+
+/*****************************************************************************
+ *                                do_mkfifo
+ *****************************************************************************/
+/**
+ * Handle the message MKFIFO: create a FIFO.
+ *
+ * The FIFO is made by create_file() and keeps the extent it gets there, so
+ * that unlink() treats it like a regular file. Its data never goes there
+ * though, see fs/pipe.c.
+ * 
+ * @return Zero if success, otherwise -1.
+ *****************************************************************************/
+PUBLIC int do_mkfifo()
+{
+	char pathname[MAX_PATH];
+
+	int name_len = fs_cur->msg.NAME_LEN;	/* length of filename */
+	int src = fs_cur->msg.source;	/* caller proc nr. */
+	assert(name_len < MAX_PATH);
+	phys_copy((void*)va2la(TASK_FS, pathname),
+		  (void*)va2la(src, fs_cur->msg.PATHNAME),
+		  name_len);
+	pathname[name_len] = 0;
+
+	if (search_file(pathname) != INVALID_INODE) {
+		printl("{FS} file exists: %s\n", pathname);
+		return -1;
+	}
+
+	struct inode * pin = create_file(pathname, 0);
+	if (!pin)
+		return -1;
+
+	pin->i_mode = I_NAMED_PIPE;
+	sync_inode(pin);
+	put_inode(pin);
 
 	return 0;
 }
@@ -212,12 +338,12 @@ PUBLIC int do_close()
  *****************************************************************************/
 PUBLIC int do_lseek()
 {
-	int fd = fs_msg.FD;
-	int off = fs_msg.OFFSET;
-	int whence = fs_msg.WHENCE;
+	int fd = fs_cur->msg.FD;
+	int off = fs_cur->msg.OFFSET;
+	int whence = fs_cur->msg.WHENCE;
 
-	int pos = pcaller->filp[fd]->fd_pos;
-	int f_size = pcaller->filp[fd]->fd_inode->i_size;
+	int pos = fs_cur->caller->filp[fd]->fd_pos;
+	int f_size = fs_cur->caller->filp[fd]->fd_inode->i_size;
 
 	switch (whence) {
 	case SEEK_SET:
@@ -236,10 +362,103 @@ PUBLIC int do_lseek()
 	if ((pos > f_size) || (pos < 0)) {
 		return -1;
 	}
-	pcaller->filp[fd]->fd_pos = pos;
+	fs_cur->caller->filp[fd]->fd_pos = pos;
 	return pos;
 }
 
+/*****************************************************************************
+ *                                do_fallocate
+ *****************************************************************************/
+/**
+ * Handle the message FALLOCATE.
+ *
+ * Make sure the file owns a contiguous extent of at least CNT bytes. The
+ * extent is grown in place if the sectors behind it are free, otherwise a new
+ * extent is allocated, the data is moved there and the old one is released.
+ * The file size is not changed.
+ * 
+ * @return Zero if success, otherwise -1.
+ *****************************************************************************/
+PUBLIC int do_fallocate()
+{
+	int fd = fs_cur->msg.FD;
+	int len = fs_cur->msg.CNT;
+
+	if (fd < 0 || fd >= NR_FILES || !fs_cur->caller->filp[fd])
+		return -1;
+
+	if (!(fs_cur->caller->filp[fd]->fd_mode & O_RDWR))
+		return -1;
+
+	struct inode * pin = fs_cur->caller->filp[fd]->fd_inode;
+	if (pin->i_mode != I_REGULAR || len < 0)
+		return -1;
+
+	/* len + SECTOR_SIZE - 1 could overflow */
+	int nr_sects = (len >> SECTOR_SIZE_SHIFT) + ((len & (SECTOR_SIZE - 1)) != 0);
+	if (nr_sects > get_super_block(pin->i_dev)->nr_sects)
+		return -1;
+	if (nr_sects <= pin->i_nr_sects)
+		return 0;
+
+	int dev = pin->i_dev;
+	int end = pin->i_start_sect + pin->i_nr_sects;
+	int more = nr_sects - pin->i_nr_sects;
+
+	lock_inode(pin);
+
+	/* grow in place */
+	if (smap_run_free(dev, end, more)) {
+		/* the s-map and the i-node */
+		if (journal_reserve(smap_nr_sects(dev, end, more) + 1) != 0) {
+			unlock_inode(pin);
+			return -1;
+		}
+		set_smap_bits(dev, end, more, 1);
+		pin->i_nr_sects = nr_sects;
+		sync_inode(pin);
+		unlock_inode(pin);
+		return 0;
+	}
+
+	/* move to a new extent */
+	int new_start = find_free_extent(dev, nr_sects);
+	if (!new_start) {
+		printl("{FS} FS::do_fallocate():: no free extent of %d sectors\n",
+		       nr_sects);
+		unlock_inode(pin);
+		return -1;
+	}
+	/* the new and the old run in s-map, and the i-node */
+	if (journal_reserve(smap_nr_sects(dev, new_start, nr_sects) +
+			    smap_nr_sects(dev, pin->i_start_sect,
+					  pin->i_nr_sects) + 1) != 0) {
+		unlock_inode(pin);
+		return -1;
+	}
+	set_smap_bits(dev, new_start, nr_sects, 1);
+
+	int used = (pin->i_size + SECTOR_SIZE - 1) >> SECTOR_SIZE_SHIFT;
+	int i;
+	for (i = 0; i < used; i += DIRECT_IO_MAX_SECTS) {
+		int n = min(used - i, DIRECT_IO_MAX_SECTS);
+		rw_sector(DEV_READ, dev, (u64)(pin->i_start_sect + i) * SECTOR_SIZE,
+			  n * SECTOR_SIZE, TASK_FS, fsbuf);
+		rw_sector(DEV_WRITE, dev, (u64)(new_start + i) * SECTOR_SIZE,
+			  n * SECTOR_SIZE, TASK_FS, fsbuf);
+	}
+
+	set_smap_bits(dev, pin->i_start_sect, pin->i_nr_sects, 0);
+
+	pin->i_start_sect = new_start;
+	pin->i_nr_sects = nr_sects;
+	sync_inode(pin);
+
+	unlock_inode(pin);
+
+	return 0;
+}
+
 /*****************************************************************************
  *                                alloc_imap_bit
  *****************************************************************************/
@@ -288,57 +507,24 @@ PRIVATE int alloc_imap_bit(int dev)
  *                                alloc_smap_bit
  *****************************************************************************/
 /**
- * Allocate a bit in sector-map.
+ * Allocate a run of sectors in sector-map.
+ *
+ * Files no longer sit back to back: fallocate() and unlink() leave holes of
+ * any length. The run is therefore found by find_free_extent(), which skips
+ * holes that are too short, instead of being taken from the first free bit.
  * 
  * @param dev  In which device the sector-map is located.
  * @param nr_sects_to_alloc  How many sectors are allocated.
  * 
- * @return  The 1st sector nr allocated.
+ * @return  The 1st sector nr allocated, or zero if there is no free run
+ *          that long.
  *****************************************************************************/
 PRIVATE int alloc_smap_bit(int dev, int nr_sects_to_alloc)
 {
-	/* int nr_sects_to_alloc = NR_DEFAULT_FILE_SECTS; */
-
-	int i; /* sector index */
-	int j; /* byte index */
-	int k; /* bit index */
-
-	struct super_block * sb = get_super_block(dev);
-
-	int smap_blk0_nr = 1 + 1 + sb->nr_imap_sects;
-	int free_sect_nr = 0;
-
-	for (i = 0; i < sb->nr_smap_sects; i++) { /* smap_blk0_nr + i :
-						     current sect nr. */
-		RD_SECT(dev, smap_blk0_nr + i);
-
-		/* byte offset in current sect */
-		for (j = 0; j < SECTOR_SIZE && nr_sects_to_alloc > 0; j++) {
-			k = 0;
-			if (!free_sect_nr) {
-				/* loop until a free bit is found */
-				if (fsbuf[j] == 0xFF) continue;
-				for (; ((fsbuf[j] >> k) & 1) != 0; k++) {}
-				free_sect_nr = (i * SECTOR_SIZE + j) * 8 +
-					k - 1 + sb->n_1st_sect;
-			}
-
-			for (; k < 8; k++) { /* repeat till enough bits are set */
-				assert(((fsbuf[j] >> k) & 1) == 0);
-				fsbuf[j] |= (1 << k);
-				if (--nr_sects_to_alloc == 0)
-					break;
-			}
-		}
+	int free_sect_nr = find_free_extent(dev, nr_sects_to_alloc);
 
-		if (free_sect_nr) /* free bit found, write the bits to smap */
-			WR_SECT(dev, smap_blk0_nr + i);
-
-		if (nr_sects_to_alloc == 0)
-			break;
-	}
-
-	assert(nr_sects_to_alloc == 0);
+	if (free_sect_nr)
+		set_smap_bits(dev, free_sect_nr, nr_sects_to_alloc, 1);
 
 	return free_sect_nr;
 }
@@ -431,3 +617,139 @@ PRIVATE void new_dir_entry(struct inode *dir_inode,int inode_nr,char *filename)
 	/* update dir inode */
 	sync_inode(dir_inode);
 }
+
+/*****************************************************************************
+ *                                smap_run_free
+ *****************************************************************************/
+/**
+ * Check whether a run of sectors is free in sector-map.
+ * 
+ * @param dev         In which device the sector-map is located.
+ * @param start_sect  The 1st sector of the run.
+ * @param nr_sects    How many sectors in the run.
+ * 
+ * @return  Non-zero if every sector of the run is inside the partition and
+ *          free.
+ *****************************************************************************/
+PUBLIC int smap_run_free(int dev, int start_sect, int nr_sects)
+{
+	struct super_block * sb = get_super_block(dev);
+	int smap_blk0_nr = 1 + 1 + sb->nr_imap_sects;
+
+	/* sect M <-> bit (M - sb->n_1st_sect + 1) */
+	int bit = start_sect - sb->n_1st_sect + 1;
+	if (bit + nr_sects > (int)(sb->nr_sects - sb->n_1st_sect + 1))
+		return 0;
+
+	int cur = -1;
+	for (; nr_sects > 0; nr_sects--, bit++) {
+		int s = bit / (SECTOR_SIZE * 8);
+		if (s != cur) {
+			RD_SECT(dev, smap_blk0_nr + s);
+			cur = s;
+		}
+		if ((fsbuf[(bit / 8) % SECTOR_SIZE] >> (bit % 8)) & 1)
+			return 0;
+	}
+
+	return 1;
+}
+
+/*****************************************************************************
+ *                                find_free_extent
+ *****************************************************************************/
+/**
+ * Find the first run of free sectors which is long enough.
+ *
+ * It does not assume the free sectors follow the first free bit, so it works
+ * on a fragmented sector-map. Nothing is marked.
+ * 
+ * @param dev       In which device the sector-map is located.
+ * @param nr_sects  How many sectors are wanted.
+ * 
+ * @return  The 1st sector nr of the run, or zero if there is no such run.
+ *****************************************************************************/
+PRIVATE int find_free_extent(int dev, int nr_sects)
+{
+	struct super_block * sb = get_super_block(dev);
+	int smap_blk0_nr = 1 + 1 + sb->nr_imap_sects;
+	int nr_bits = sb->nr_sects - sb->n_1st_sect + 1;
+
+	int run = 0;
+	int cur = -1;
+	int bit;
+	for (bit = 1; bit < nr_bits; bit++) {
+		int s = bit / (SECTOR_SIZE * 8);
+		if (s != cur) {
+			RD_SECT(dev, smap_blk0_nr + s);
+			cur = s;
+		}
+		if ((fsbuf[(bit / 8) % SECTOR_SIZE] >> (bit % 8)) & 1)
+			run = 0;
+		else if (++run == nr_sects)
+			return bit - nr_sects + sb->n_1st_sect;
+	}
+
+	return 0;
+}
+
+/*****************************************************************************
+ *                                smap_nr_sects
+ *****************************************************************************/
+/**
+ * How many sectors of sector-map hold the bits of a run of sectors.
+ * 
+ * @param dev         In which device the sector-map is located.
+ * @param start_sect  The 1st sector of the run.
+ * @param nr_sects    How many sectors in the run.
+ * 
+ * @return  The number of sector-map sectors set_smap_bits() would write.
+ *****************************************************************************/
+PUBLIC int smap_nr_sects(int dev, int start_sect, int nr_sects)
+{
+	if (nr_sects <= 0)
+		return 0;
+
+	struct super_block * sb = get_super_block(dev);
+	int bit = start_sect - sb->n_1st_sect + 1;
+
+	return (bit + nr_sects - 1) / (SECTOR_SIZE * 8) -
+		bit / (SECTOR_SIZE * 8) + 1;
+}
+
+/*****************************************************************************
+ *                                set_smap_bits
+ *****************************************************************************/
+/**
+ * Set or clear the bits of a run of sectors in sector-map.
+ * 
+ * @param dev         In which device the sector-map is located.
+ * @param start_sect  The 1st sector of the run.
+ * @param nr_sects    How many sectors in the run.
+ * @param val         1 to allocate the sectors, 0 to free them.
+ *****************************************************************************/
+PUBLIC void set_smap_bits(int dev, int start_sect, int nr_sects, int val)
+{
+	struct super_block * sb = get_super_block(dev);
+	int smap_blk0_nr = 1 + 1 + sb->nr_imap_sects;
+	int bit = start_sect - sb->n_1st_sect + 1;
+
+	int cur = -1;
+	for (; nr_sects > 0; nr_sects--, bit++) {
+		int s = bit / (SECTOR_SIZE * 8);
+		if (s != cur) {
+			if (cur != -1)
+				WR_SECT(dev, smap_blk0_nr + cur);
+			RD_SECT(dev, smap_blk0_nr + s);
+			cur = s;
+		}
+		int byte = (bit / 8) % SECTOR_SIZE;
+		assert(((fsbuf[byte] >> (bit % 8)) & 1) == !val);
+		if (val)
+			fsbuf[byte] |= (1 << (bit % 8));
+		else
+			fsbuf[byte] &= ~(1 << (bit % 8));
+	}
+	if (cur != -1)
+		WR_SECT(dev, smap_blk0_nr + cur);
+}
@@ -0,0 +1,350 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   pipe.c
+ * @brief  pipe() and FIFOs: ring buffers kept in TASK_FS.
+ *
+ * A pipe is a ring buffer in FS memory; nothing of it ever reaches the disk.
+ * pipe() makes an i-node that lives only in inode_table[], a FIFO is an
+ * i-node on the disk whose ring buffer is made when it is first opened.
+ *
+ * A read of an empty pipe or a write to a full one is parked: fs_cur->msg.type
+ * is set to SUSPEND_PROC so that task_fs() won't reply, and the caller gets
+ * its reply from pipe_pump() as soon as the other end has made room or data.
+ * Every read/write is parked first and then pumped, so the callers that can
+ * be served at once are answered the same way as the ones that waited.
+ * Callers parked on the same end of a pipe are queued and served in order.
+ *
+ * @author Forrest Y. Yu
+ * @date   2008
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "keyboard.h"
+#include "proto.h"
+
+/**
+ * @struct pipe_wait
+ * @brief  A read or write parked on a pipe.
+ *
+ * A proc waits for one call at a time, so there is one per proc.
+ */
+PRIVATE struct pipe_wait {
+	int	proc;		/**< Caller proc nr */
+	u8 *	buf;		/**< Caller's buffer, advanced as bytes move */
+	int	left;		/**< Bytes still to move */
+	int	done;		/**< Bytes moved so far */
+	struct pipe_wait *	next;	/**< Next one parked on the same end */
+} pipe_wait_table[NR_TASKS + NR_PROCS];
+
+/**
+ * @struct pipe
+ * @brief  Ring buffer of a pipe or an open FIFO.
+ */
+PRIVATE struct pipe {
+	struct inode *	pin;		/**< The i-node, 0: free slot */
+	u8	buf[PIPE_BUF_SIZE];
+	int	head;			/**< Index of the 1st unread byte */
+	int	count;			/**< Unread bytes */
+	int	readers;		/**< Read-end descs open */
+	int	writers;		/**< Write-end descs open */
+	int	wr_seen;		/**< Has ever had a writer */
+	struct pipe_wait *	rd;	/**< Parked readers, 1st is served */
+	struct pipe_wait *	wr;	/**< Parked writers, 1st is served */
+} pipe_table[NR_PIPES];
+
+PRIVATE struct pipe * alloc_pipe(struct inode * pin);
+PRIVATE void pipe_pump(struct pipe * p);
+PRIVATE void pipe_reply(struct pipe_wait * w, int cnt);
+
+/*****************************************************************************
+ *                                do_pipe
+ *****************************************************************************/
+/**
+ * Handle the message PIPE: make a pipe and open both ends for the caller.
+ *
+ * The two fds are written to the int[2] at BUF, the read end first.
+ *
+ * @return Zero if success, otherwise -1.
+ *****************************************************************************/
+PUBLIC int do_pipe()
+{
+	int fd[2];
+	struct file_desc * f[2];
+	int i, k;
+
+	for (k = 0, i = 0; k < 2 && i < NR_FILES; i++)
+		if (fs_cur->caller->filp[i] == 0)
+			fd[k++] = i;
+	if (k < 2)
+		return -1;
+
+	for (k = 0, i = 0; k < 2 && i < NR_FILE_DESC; i++)
+		if (f_desc_table[i].fd_inode == 0)
+			f[k++] = &f_desc_table[i];
+	if (k < 2)
+		return -1;
+
+	struct inode * pin;
+	for (pin = inode_table; pin < &inode_table[NR_INODE]; pin++)
+		if (pin->i_cnt == 0)
+			break;
+	if (pin == &inode_table[NR_INODE]) {
+		printl("{FS} FS::do_pipe():: the inode table is full\n");
+		return -1;
+	}
+
+	struct pipe * p = alloc_pipe(pin);
+	if (!p)
+		return -1;
+
+	/* an i-node not on any device: get_inode() never finds it */
+	memset(pin, 0, sizeof(struct inode));
+	pin->i_mode = I_NAMED_PIPE;
+	pin->i_dev = NO_DEV;
+	pin->i_num = INVALID_INODE;
+	pin->i_cnt = 2;
+	pin->i_pipe = p;
+
+	for (k = 0; k < 2; k++) {
+		f[k]->fd_inode = pin;
+		f[k]->fd_mode = k == 0 ? O_RDONLY : O_WRONLY;
+		f[k]->fd_cnt = 1;
+		f[k]->fd_pos = 0;
+		fs_cur->caller->filp[fd[k]] = f[k];
+	}
+
+	p->readers = 1;
+	p->writers = 1;
+	p->wr_seen = 1;
+
+	phys_copy((void*)va2la(fs_cur->msg.source, fs_cur->msg.BUF),
+		  (void*)va2la(TASK_FS, fd),
+		  sizeof(fd));
+
+	return 0;
+}
+
+/*****************************************************************************
+ *                                pipe_open
+ *****************************************************************************/
+/**
+ * Attach a new desc to a FIFO, making its ring buffer if it has none.
+ *
+ * @param pin  I-node of the FIFO.
+ * @param f    The desc, fd_mode is O_RDONLY or O_WRONLY.
+ *
+ * @return Zero if success, -1 if all pipes are in use.
+ *****************************************************************************/
+PUBLIC int pipe_open(struct inode * pin, struct file_desc * f)
+{
+	struct pipe * p = pin->i_pipe;
+
+	if (!p) {
+		p = alloc_pipe(pin);
+		if (!p)
+			return -1;
+		pin->i_pipe = p;
+	}
+
+	if (f->fd_mode & O_WRONLY) {
+		p->writers++;
+		p->wr_seen = 1;
+	}
+	else {
+		p->readers++;
+	}
+
+	return 0;
+}
+
+/*****************************************************************************
+ *                                pipe_close
+ *****************************************************************************/
+/**
+ * Called when the last reference to a pipe desc goes away. The peers parked
+ * on the pipe are told about EOF or a broken pipe, and the ring buffer is
+ * freed once both ends are closed.
+ *
+ * @param f  The desc.
+ *****************************************************************************/
+PUBLIC void pipe_close(struct file_desc * f)
+{
+	struct inode * pin = f->fd_inode;
+	struct pipe * p = pin->i_pipe;
+
+	assert(p);
+
+	if (f->fd_mode & O_WRONLY)
+		p->writers--;
+	else
+		p->readers--;
+
+	pipe_pump(p);
+
+	if (p->readers == 0 && p->writers == 0) {
+		assert(p->rd == 0 && p->wr == 0);
+		p->pin = 0;
+		pin->i_pipe = 0;
+	}
+}
+
+/*****************************************************************************
+ *                                pipe_rdwt
+ *****************************************************************************/
+/**
+ * Read/write a pipe.
+ *
+ * A read returns as soon as there is some data, or 0 at EOF: the pipe is
+ * empty and has no writer left. A write returns when all bytes are in the
+ * pipe, or -1 if nobody is left to read them. A read or write which finds
+ * another one parked on its end is queued behind it.
+ *
+ * @param f        The desc.
+ * @param io_type  READ or WRITE.
+ * @param src      Caller proc nr.
+ * @param buf      Caller's buffer.
+ * @param len      How many bytes to read/write.
+ *
+ * @return -1 on error. Otherwise the caller has been parked and
+ *         fs_cur->msg.type is SUSPEND_PROC.
+ *****************************************************************************/
+PUBLIC int pipe_rdwt(struct file_desc * f, int io_type, int src,
+		     void * buf, int len)
+{
+	struct pipe * p = f->fd_inode->i_pipe;
+
+	if (!(f->fd_mode & (io_type == READ ? O_RDONLY : O_WRONLY)) || len < 0)
+		return -1;
+
+	struct pipe_wait * w = &pipe_wait_table[src];
+	w->proc = src;
+	w->buf = buf;
+	w->left = len;
+	w->done = 0;
+	w->next = 0;
+
+	struct pipe_wait ** q = io_type == READ ? &p->rd : &p->wr;
+	while (*q)
+		q = &(*q)->next;
+	*q = w;
+	fs_cur->msg.type = SUSPEND_PROC;
+
+	pipe_pump(p);
+
+	return 0;
+}
+
+/*****************************************************************************
+ *                                pipe_pump
+ *****************************************************************************/
+/**
+ * Move bytes from the 1st parked writer into the ring and from the ring to
+ * the 1st parked reader until neither can go on, replying to whoever is
+ * done. The next one in the queue is served as soon as its forerunner has
+ * got its reply.
+ *
+ * @param p  The pipe.
+ *****************************************************************************/
+PRIVATE void pipe_pump(struct pipe * p)
+{
+	int moved;
+
+	do {
+		moved = 0;
+
+		struct pipe_wait * w = p->wr;
+		while (w && w->left && p->count < PIPE_BUF_SIZE) {
+			int tail = (p->head + p->count) % PIPE_BUF_SIZE;
+			int n = min(w->left, min(PIPE_BUF_SIZE - p->count,
+						 PIPE_BUF_SIZE - tail));
+			phys_copy((void*)va2la(TASK_FS, p->buf + tail),
+				  (void*)va2la(w->proc, w->buf),
+				  n);
+			p->count += n;
+			w->buf += n;
+			w->left -= n;
+			w->done += n;
+			moved = 1;
+		}
+
+		struct pipe_wait * r = p->rd;
+		while (r && r->left && p->count) {
+			int n = min(r->left, min(p->count,
+						 PIPE_BUF_SIZE - p->head));
+			phys_copy((void*)va2la(r->proc, r->buf),
+				  (void*)va2la(TASK_FS, p->buf + p->head),
+				  n);
+			p->head = (p->head + n) % PIPE_BUF_SIZE;
+			p->count -= n;
+			r->buf += n;
+			r->left -= n;
+			r->done += n;
+			moved = 1;
+		}
+
+		if (r && (r->done || r->left == 0 ||
+			  (p->writers == 0 && p->wr_seen))) {
+			p->rd = r->next;
+			pipe_reply(r, r->done);
+			moved = 1;
+		}
+
+		if (w && (p->readers == 0 || w->left == 0)) {
+			p->wr = w->next;
+			pipe_reply(w, p->readers == 0 && !w->done ? -1 : w->done);
+			moved = 1;
+		}
+	} while (moved);
+}
+
+/*****************************************************************************
+ *                                pipe_reply
+ *****************************************************************************/
+/**
+ * Send the reply of a parked read/write, like task_fs() would have done.
+ *
+ * @param w    The parked read/write.
+ * @param cnt  Byte count to report.
+ *****************************************************************************/
+PRIVATE void pipe_reply(struct pipe_wait * w, int cnt)
+{
+	MESSAGE msg;
+	msg.type = SYSCALL_RET;
+	msg.CNT = cnt;
+	send_recv(SEND, w->proc, &msg);
+}
+
+/*****************************************************************************
+ *                                alloc_pipe
+ *****************************************************************************/
+/**
+ * Take a free slot of pipe_table[].
+ *
+ * @param pin  I-node the pipe belongs to.
+ *
+ * @return The pipe, or 0 if all are in use.
+ *****************************************************************************/
+PRIVATE struct pipe * alloc_pipe(struct inode * pin)
+{
+	struct pipe * p;
+	for (p = pipe_table; p < &pipe_table[NR_PIPES]; p++)
+		if (!p->pin)
+			break;
+	if (p == &pipe_table[NR_PIPES])
+		return 0;
+
+	memset(p, 0, sizeof(struct pipe));
+	p->pin = pin;
+
+	return p;
+}
@@ -20,6 +20,34 @@
 #include "keyboard.h"
 #include "proto.h"
 
+PRIVATE int rdwt_dev(struct inode * pin, int io_type, int src,
+		     void * buf, int len);
+PRIVATE int rw_cached(struct inode * pin, int io_type, int pos, int len,
+		      int src, void * buf);
+PRIVATE int read_direct(struct inode * pin, int pos, int len,
+			int src, void * buf);
+PRIVATE void park_direct(struct inode * pin, int pos, int len,
+			 int src, void * buf, int cnt);
+PRIVATE void disk_issue();
+
+/**
+ * @struct disk_req
+ * @brief  A direct read parked while the disk driver works on it.
+ *
+ * TASK_HD serves one request at a time, so there is at most one such read
+ * in flight. A second large read waits in park_direct() until the first is
+ * complete, then it is parked in turn.
+ */
+PRIVATE struct disk_req {
+	struct fs_req *	req;	/**< the parked request, 0: none */
+	struct inode *	pin;	/**< i-node being read, locked by req */
+	int	cnt;		/**< bytes to report to the caller */
+	int	dev;		/**< device to read from */
+	int	sect;		/**< 1st sector of the chunk in flight */
+	int	nr_sects;	/**< sectors left, including the chunk */
+	int	chunk;		/**< sectors of the chunk in flight */
+	void *	buf;		/**< where the chunk goes */
+} dreq;
 
 /*****************************************************************************
  *                                do_rdwt
@@ -29,107 +57,687 @@
  *
  * Sector map is not needed to update, since the sectors for the file have been
  * allocated and the bits are set when the file was created.
+ *
+ * PREAD/PWRITE take the file offset from the message and leave fd_pos alone.
+ *
+ * A large read of a regular file does not wait for the disk: its body is
+ * handed to the driver, fs_cur->msg.type is set to SUSPEND_PROC so that
+ * task_fs() won't reply, and the caller gets its reply from disk_done().
+ *
+ * Pipes are served by pipe_rdwt(), which parks the caller the same way.
  * 
  * @return How many bytes have been read/written.
  *****************************************************************************/
 PUBLIC int do_rdwt()
 {
-	int fd = fs_msg.FD;	/**< file descriptor. */
-	void * buf = fs_msg.BUF;/**< r/w buffer */
-	int len = fs_msg.CNT;	/**< r/w bytes */
+	int fd = fs_cur->msg.FD;	/**< file descriptor. */
+	void * buf = fs_cur->msg.BUF;/**< r/w buffer */
+	int len = fs_cur->msg.CNT;	/**< r/w bytes */
+
+	int src = fs_cur->msg.source;		/* caller proc nr. */
 
-	int src = fs_msg.source;		/* caller proc nr. */
+	int positional = (fs_cur->msg.type == PREAD ||
+			  fs_cur->msg.type == PWRITE);
+	int io_type = (fs_cur->msg.type == READ || fs_cur->msg.type == PREAD) ?
+		READ : WRITE;
 
-	assert((pcaller->filp[fd] >= &f_desc_table[0]) &&
-	       (pcaller->filp[fd] < &f_desc_table[NR_FILE_DESC]));
+	assert((fs_cur->caller->filp[fd] >= &f_desc_table[0]) &&
+	       (fs_cur->caller->filp[fd] < &f_desc_table[NR_FILE_DESC]));
 
-	if (!(pcaller->filp[fd]->fd_mode & O_RDWR))
+	struct inode * pin = fs_cur->caller->filp[fd]->fd_inode;
+
+	assert(pin >= &inode_table[0] && pin < &inode_table[NR_INODE]);
+
+	int imode = pin->i_mode & I_TYPE_MASK;
+
+	if (imode == I_NAMED_PIPE)
+		return positional ? -1 :
+			pipe_rdwt(fs_cur->caller->filp[fd], io_type, src,
+				  buf, len);
+
+	if (!(fs_cur->caller->filp[fd]->fd_mode & O_RDWR))
 		return 0;
 
-	int pos = pcaller->filp[fd]->fd_pos;
+	int pos = positional ? (int)fs_cur->msg.POSITION :
+		fs_cur->caller->filp[fd]->fd_pos;
+
+	if (imode == I_CHAR_SPECIAL)
+		return rdwt_dev(pin, io_type, src, buf, len);
+
+	assert(pin->i_mode == I_REGULAR || pin->i_mode == I_DIRECTORY);
+
+	if (pos < 0)
+		return -1;
+
+	/* dir blocks may be waiting in the journal */
+	if (pin->i_mode == I_DIRECTORY)
+		journal_commit();
+
+	if (io_type == WRITE)
+		lock_inode(pin);
+
+	int parked = 0;
+	int bytes_rw = rdwt_file(pin, io_type, pos, len, src, buf, &parked);
+
+	if (parked)
+		fs_cur->msg.type = SUSPEND_PROC;
+
+	if (!positional)
+		fs_cur->caller->filp[fd]->fd_pos += bytes_rw;
+
+	if (pos + bytes_rw > pin->i_size) {
+		/* update inode::size */
+		pin->i_size = pos + bytes_rw;
+		/* write the updated i-node back to disk */
+		sync_inode(pin);
+	}
+
+	if (io_type == WRITE) {
+		mmap_update(pin, pos, bytes_rw, src, buf);
+		unlock_inode(pin);
+	}
+
+	return bytes_rw;
+}
+
+/*****************************************************************************
+ *                                do_rdwtv
+ *****************************************************************************/
+/**
+ * Scatter/gather version of do_rdwt(), serves READV and WRITEV.
+ *
+ * The caller's iovec array is copied into FS once, then the segments are
+ * transferred in order from the current fd_pos. A short transfer ends the
+ * whole request, just like it would end a loop of read()/write() calls.
+ *
+ * For a char device only the first non-empty segment is read, since TTY
+ * replies to the caller by itself when a line is ready. A pipe moves only
+ * the first non-empty segment either way, as pipe_rdwt() replies by itself.
+ * 
+ * @return How many bytes have been read/written in total, -1 on error.
+ *****************************************************************************/
+PUBLIC int do_rdwtv()
+{
+	int fd = fs_cur->msg.FD;		/**< file descriptor. */
+	int iovcnt = fs_cur->msg.CNT;	/**< how many segments */
+	int src = fs_cur->msg.source;	/* caller proc nr. */
+	int io_type = fs_cur->msg.type == READV ? READ : WRITE;
+
+	struct iovec iov[IOV_MAX];
+
+	assert((fs_cur->caller->filp[fd] >= &f_desc_table[0]) &&
+	       (fs_cur->caller->filp[fd] < &f_desc_table[NR_FILE_DESC]));
+
+	if (iovcnt <= 0 || iovcnt > IOV_MAX)
+		return -1;
 
-	struct inode * pin = pcaller->filp[fd]->fd_inode;
+	phys_copy((void*)va2la(TASK_FS, iov),
+		  (void*)va2la(src, fs_cur->msg.BUF),
+		  iovcnt * sizeof(struct iovec));
+
+	struct inode * pin = fs_cur->caller->filp[fd]->fd_inode;
 
 	assert(pin >= &inode_table[0] && pin < &inode_table[NR_INODE]);
 
 	int imode = pin->i_mode & I_TYPE_MASK;
+	int total = 0;
+	int i;
+
+	if (imode == I_NAMED_PIPE) {
+		for (i = 0; i < iovcnt; i++)
+			if (iov[i].iov_len > 0)
+				return pipe_rdwt(fs_cur->caller->filp[fd],
+						 io_type, src, iov[i].iov_base,
+						 iov[i].iov_len);
+		return 0;
+	}
+
+	if (!(fs_cur->caller->filp[fd]->fd_mode & O_RDWR))
+		return 0;
 
 	if (imode == I_CHAR_SPECIAL) {
-		int t = fs_msg.type == READ ? DEV_READ : DEV_WRITE;
-		fs_msg.type = t;
+		for (i = 0; i < iovcnt; i++) {
+			if (iov[i].iov_len <= 0)
+				continue;
+			total += rdwt_dev(pin, io_type, src,
+					  iov[i].iov_base, iov[i].iov_len);
+			if (io_type == READ)
+				break;
+		}
+		return total;
+	}
+
+	assert(pin->i_mode == I_REGULAR || pin->i_mode == I_DIRECTORY);
+
+	int pos = fs_cur->caller->filp[fd]->fd_pos;
+
+	if (io_type == WRITE)
+		lock_inode(pin);
+
+	for (i = 0; i < iovcnt; i++) {
+		if (iov[i].iov_len <= 0)
+			continue;
+		int n = rdwt_file(pin, io_type, pos + total, iov[i].iov_len,
+				  src, iov[i].iov_base, 0);
+		if (io_type == WRITE)
+			mmap_update(pin, pos + total, n, src, iov[i].iov_base);
+		total += n;
+		if (n < iov[i].iov_len)
+			break;
+	}
+
+	fs_cur->caller->filp[fd]->fd_pos += total;
+
+	if (fs_cur->caller->filp[fd]->fd_pos > pin->i_size) {
+		/* update inode::size */
+		pin->i_size = fs_cur->caller->filp[fd]->fd_pos;
+		/* write the updated i-node back to disk */
+		sync_inode(pin);
+	}
+
+	if (io_type == WRITE)
+		unlock_inode(pin);
+
+	return total;
+}
+
+/*****************************************************************************
+ *                                do_copy_range
+ *****************************************************************************/
+/**
+ * Copy bytes from one file to another without leaving TASK_FS.
+ *
+ * The data is staged in the upper half of fsbuf, rw_cached() uses the lower
+ * half for its sector I/O. Both fd_pos are advanced, as if the caller had
+ * done read() and write() itself.
+ * 
+ * @return How many bytes have been copied, -1 on error.
+ *****************************************************************************/
+PUBLIC int do_copy_range()
+{
+	int fd_in = fs_cur->msg.FD;		/**< file to copy from */
+	int fd_out = fs_cur->msg.FD_OUT;	/**< file to copy to */
+	int len = fs_cur->msg.CNT;		/**< how many bytes */
+
+	struct file_desc * fin = fs_cur->caller->filp[fd_in];
+	struct file_desc * fout = fs_cur->caller->filp[fd_out];
+
+	assert(fin >= &f_desc_table[0] && fin < &f_desc_table[NR_FILE_DESC]);
+	assert(fout >= &f_desc_table[0] && fout < &f_desc_table[NR_FILE_DESC]);
+
+	if (!(fin->fd_mode & O_RDWR) || !(fout->fd_mode & O_RDWR))
+		return 0;
+
+	struct inode * pin = fin->fd_inode;
+	struct inode * pout = fout->fd_inode;
+
+	if (pin->i_mode != I_REGULAR || pout->i_mode != I_REGULAR)
+		return -1;
+
+	void * stage = fsbuf + FSBUF_SIZE / 2;
+	int total = 0;
+
+	lock_inode(pout);
+
+	while (total < len) {
+		/*
+		 * rw_cached() runs its copy on the len given, clamp it here
+		 * the way rdwt_file() does: not past the end of the source,
+		 * not past the extent of the destination.
+		 */
+		int n = min(len - total, COPY_RANGE_CHUNK);
+		n = min(n, pin->i_size - fin->fd_pos);
+		n = min(n, pout->i_nr_sects * SECTOR_SIZE - fout->fd_pos);
+		if (n <= 0)
+			break;
+
+		n = rw_cached(pin, READ, fin->fd_pos, n, TASK_FS, stage);
+		if (n <= 0)
+			break;
+		mmap_fetch(pin, fin->fd_pos, n, TASK_FS, stage);
+		n = rw_cached(pout, WRITE, fout->fd_pos, n, TASK_FS, stage);
+		if (n <= 0)
+			break;
+		mmap_update(pout, fout->fd_pos, n, TASK_FS, stage);
+
+		fin->fd_pos += n;
+		fout->fd_pos += n;
+		total += n;
+	}
+
+	if (fout->fd_pos > pout->i_size) {
+		/* update inode::size */
+		pout->i_size = fout->fd_pos;
+		/* write the updated i-node back to disk */
+		sync_inode(pout);
+	}
+
+	unlock_inode(pout);
+
+	return total;
+}
+
+/*****************************************************************************
+ *                                do_ftruncate
+ *****************************************************************************/
+/**
+ * Handle the message FTRUNCATE: set the file size to OFFSET bytes.
+ *
+ * The file may shrink or grow inside its extent; the extent itself is kept,
+ * use fallocate() to make it larger. Bytes added by growing read as zero.
+ * 
+ * @return Zero if success, otherwise -1.
+ *****************************************************************************/
+PUBLIC int do_ftruncate()
+{
+	int fd = fs_cur->msg.FD;
+	int length = fs_cur->msg.OFFSET;
+
+	assert((fs_cur->caller->filp[fd] >= &f_desc_table[0]) &&
+	       (fs_cur->caller->filp[fd] < &f_desc_table[NR_FILE_DESC]));
+
+	if (!(fs_cur->caller->filp[fd]->fd_mode & O_RDWR))
+		return -1;
+
+	struct inode * pin = fs_cur->caller->filp[fd]->fd_inode;
+
+	if (pin->i_mode != I_REGULAR || length < 0 ||
+	    length > pin->i_nr_sects * SECTOR_SIZE)
+		return -1;
+
+	lock_inode(pin);
+
+	if (length > pin->i_size) {
+		void * zeros = fsbuf + FSBUF_SIZE / 2;
+		int pos = pin->i_size;
+
+		memset(zeros, 0, COPY_RANGE_CHUNK);
+		while (pos < length) {
+			int n = min(length - pos, COPY_RANGE_CHUNK);
+			pos += rw_cached(pin, WRITE, pos, n, TASK_FS, zeros);
+		}
+	}
+
+	pin->i_size = length;
+	sync_inode(pin);
+
+	unlock_inode(pin);
+
+	return 0;
+}
+
+/*****************************************************************************
+ *                                rdwt_dev
+ *****************************************************************************/
+/**
+ * R/W a char device by forwarding the request to its driver.
+ *
+ * A TTY read leaves fs_cur->msg.type as SUSPEND_PROC, so task_fs() won't reply.
+ * 
+ * @param pin      I-node of the device.
+ * @param io_type  READ or WRITE.
+ * @param src      Caller proc nr.
+ * @param buf      Caller's buffer.
+ * @param len      How many bytes to read/write.
+ * 
+ * @return How many bytes have been read/written.
+ *****************************************************************************/
+PRIVATE int rdwt_dev(struct inode * pin, int io_type, int src,
+		     void * buf, int len)
+{
+	int dev = pin->i_start_sect;
+	assert(MAJOR(dev) == 4);
+
+	fs_cur->msg.type	= io_type == READ ? DEV_READ : DEV_WRITE;
+	fs_cur->msg.DEVICE	= MINOR(dev);
+	fs_cur->msg.BUF	= buf;
+	fs_cur->msg.CNT	= len;
+	fs_cur->msg.PROC_NR	= src;
+	assert(dd_map[MAJOR(dev)].driver_nr != INVALID_DRIVER);
+	send_recv(BOTH, dd_map[MAJOR(dev)].driver_nr, &fs_cur->msg);
+	assert(fs_cur->msg.CNT == len);
+
+	return fs_cur->msg.CNT;
+}
+
+/*****************************************************************************
+ *                                do_ioctl
+ *****************************************************************************/
+/**
+ * Handle the message IOCTL by forwarding it to the driver of a char device.
+ * 
+ * @return What the driver returns, -1 if the file is not a char device.
+ *****************************************************************************/
+PUBLIC int do_ioctl()
+{
+	int fd = fs_cur->msg.FD;
+
+	if (fd < 0 || fd >= NR_FILES || !fs_cur->caller->filp[fd])
+		return -1;
+
+	struct inode * pin = fs_cur->caller->filp[fd]->fd_inode;
+
+	if ((pin->i_mode & I_TYPE_MASK) != I_CHAR_SPECIAL)
+		return -1;
+
+	int dev = pin->i_start_sect;
+	assert(MAJOR(dev) == 4);
+
+	MESSAGE driver_msg;
+	driver_msg.type		= DEV_IOCTL;
+	driver_msg.DEVICE	= MINOR(dev);
+	driver_msg.REQUEST	= fs_cur->msg.REQUEST;
+	driver_msg.BUF		= fs_cur->msg.BUF;
+	driver_msg.PROC_NR	= fs_cur->msg.source;
+	assert(dd_map[MAJOR(dev)].driver_nr != INVALID_DRIVER);
+	send_recv(BOTH, dd_map[MAJOR(dev)].driver_nr, &driver_msg);
+
+	return driver_msg.RETVAL;
+}
+
+/*****************************************************************************
+ *                                rdwt_file
+ *****************************************************************************/
+/**
+ * R/W a regular file at a given offset.
+ *
+ * Large reads bypass fsbuf: the sector-aligned body is transferred by TASK_HD
+ * into the caller's buffer directly, see read_direct().
+ *
+ * If parked is given, the body is not waited for but parked with
+ * park_direct(), and *parked is set; unless part of it is in a shared
+ * mapping, which is then copied over what has been read (mmap_fetch()).
+ * 
+ * @param pin      I-node of the file.
+ * @param io_type  READ or WRITE.
+ * @param pos      Byte offset in the file.
+ * @param len      How many bytes to read/write.
+ * @param src      Caller proc nr.
+ * @param buf      Caller's buffer.
+ * @param parked   Zero, or where to report that the body was parked.
+ * 
+ * @return How many bytes have been (or will have been) read/written.
+ *****************************************************************************/
+PUBLIC int rdwt_file(struct inode * pin, int io_type, int pos, int len,
+		     int src, void * buf, int * parked)
+{
+	int pos_end;
+	if (io_type == READ)
+		pos_end = min(pos + len, pin->i_size);
+	else		/* WRITE */
+		pos_end = min(pos + len, pin->i_nr_sects * SECTOR_SIZE);
+
+	if (pos_end <= pos)
+		return 0;
 
-		int dev = pin->i_start_sect;
-		assert(MAJOR(dev) == 4);
+	if (io_type == WRITE || pos_end - pos < DIRECT_IO_MIN_BYTES) {
+		int n = rw_cached(pin, io_type, pos, pos_end - pos, src, buf);
+		if (io_type == READ)
+			mmap_fetch(pin, pos, n, src, buf);
+		return n;
+	}
 
-		fs_msg.DEVICE	= MINOR(dev);
-		fs_msg.BUF	= buf;
-		fs_msg.CNT	= len;
-		fs_msg.PROC_NR	= src;
-		assert(dd_map[MAJOR(dev)].driver_nr != INVALID_DRIVER);
-		send_recv(BOTH, dd_map[MAJOR(dev)].driver_nr, &fs_msg);
-		assert(fs_msg.CNT == len);
+	/* mapped bytes are laid over the body, which must be there by then */
+	if (mmap_shared(pin, pos, pos_end - pos))
+		parked = 0;
 
-		return fs_msg.CNT;
+	/*
+	 *   pos                                    pos_end
+	 *    |<-head->|<------- body -------->|<-tail->|
+	 *    +--------+--------+-...-+--------+--------+
+	 *             ^ sector boundary       ^
+	 *
+	 * head & tail go through fsbuf, body goes from the disk into the
+	 * caller's buffer directly.
+	 */
+	int head = (SECTOR_SIZE - pos % SECTOR_SIZE) % SECTOR_SIZE;
+	int body = (pos_end - pos - head) & ~(SECTOR_SIZE - 1);
+	int tail = pos_end - pos - head - body;
+
+	int bytes_rw = 0;
+	bytes_rw += rw_cached(pin, READ, pos, head, src, buf);
+	bytes_rw += rw_cached(pin, READ, pos + head + body, tail,
+			      src, buf + head + body);
+
+	if (parked) {
+		/* head & tail are done, nothing else will touch the disk */
+		bytes_rw += body;
+		park_direct(pin, pos + head, body, src, buf + head, bytes_rw);
+		*parked = 1;
 	}
 	else {
-		assert(pin->i_mode == I_REGULAR || pin->i_mode == I_DIRECTORY);
-		assert((fs_msg.type == READ) || (fs_msg.type == WRITE));
-
-		int pos_end;
-		if (fs_msg.type == READ)
-			pos_end = min(pos + len, pin->i_size);
-		else		/* WRITE */
-			pos_end = min(pos + len, pin->i_nr_sects * SECTOR_SIZE);
-
-		int off = pos % SECTOR_SIZE;
-		int rw_sect_min=pin->i_start_sect+(pos>>SECTOR_SIZE_SHIFT);
-		int rw_sect_max=pin->i_start_sect+(pos_end>>SECTOR_SIZE_SHIFT);
-
-		int chunk = min(rw_sect_max - rw_sect_min + 1,
-				FSBUF_SIZE >> SECTOR_SIZE_SHIFT);
-
-		int bytes_rw = 0;
-		int bytes_left = len;
-		int i;
-		for (i = rw_sect_min; i <= rw_sect_max; i += chunk) {
-			/* read/write this amount of bytes every time */
-			int bytes = min(bytes_left, chunk * SECTOR_SIZE - off);
-			rw_sector(DEV_READ,
+		bytes_rw += read_direct(pin, pos + head, body,
+					src, buf + head);
+		mmap_fetch(pin, pos, bytes_rw, src, buf);
+	}
+
+	return bytes_rw;
+}
+
+/*****************************************************************************
+ *                                rw_cached
+ *****************************************************************************/
+/**
+ * R/W a regular file through fsbuf.
+ *
+ * Every sector involved is read into fsbuf first, so this routine copes with
+ * any offset and any length.
+ * 
+ * @param pin      I-node of the file.
+ * @param io_type  READ or WRITE.
+ * @param pos      Byte offset in the file.
+ * @param len      How many bytes to read/write.
+ * @param src      Caller proc nr.
+ * @param buf      Caller's buffer.
+ * 
+ * @return How many bytes have been read/written.
+ *****************************************************************************/
+PRIVATE int rw_cached(struct inode * pin, int io_type, int pos, int len,
+		      int src, void * buf)
+{
+	if (len <= 0)
+		return 0;
+
+	int pos_end;
+	if (io_type == READ)
+		pos_end = min(pos + len, pin->i_size);
+	else		/* WRITE */
+		pos_end = min(pos + len, pin->i_nr_sects * SECTOR_SIZE);
+
+	int off = pos % SECTOR_SIZE;
+	int rw_sect_min=pin->i_start_sect+(pos>>SECTOR_SIZE_SHIFT);
+	int rw_sect_max=pin->i_start_sect+(pos_end>>SECTOR_SIZE_SHIFT);
+
+	int chunk = min(rw_sect_max - rw_sect_min + 1,
+			FSBUF_SIZE >> SECTOR_SIZE_SHIFT);
+
+	int bytes_rw = 0;
+	int bytes_left = len;
+	int i;
+	for (i = rw_sect_min; i <= rw_sect_max; i += chunk) {
+		/* read/write this amount of bytes every time */
+		int bytes = min(bytes_left, chunk * SECTOR_SIZE - off);
+		rw_sector(DEV_READ,
+			  pin->i_dev,
+			  i * SECTOR_SIZE,
+			  chunk * SECTOR_SIZE,
+			  TASK_FS,
+			  fsbuf);
+
+		if (io_type == READ) {
+			phys_copy((void*)va2la(src, buf + bytes_rw),
+				  (void*)va2la(TASK_FS, fsbuf + off),
+				  bytes);
+		}
+		else {	/* WRITE */
+			phys_copy((void*)va2la(TASK_FS, fsbuf + off),
+				  (void*)va2la(src, buf + bytes_rw),
+				  bytes);
+			rw_sector(DEV_WRITE,
 				  pin->i_dev,
 				  i * SECTOR_SIZE,
 				  chunk * SECTOR_SIZE,
 				  TASK_FS,
 				  fsbuf);
-
-			if (fs_msg.type == READ) {
-				phys_copy((void*)va2la(src, buf + bytes_rw),
-					  (void*)va2la(TASK_FS, fsbuf + off),
-					  bytes);
-			}
-			else {	/* WRITE */
-				phys_copy((void*)va2la(TASK_FS, fsbuf + off),
-					  (void*)va2la(src, buf + bytes_rw),
-					  bytes);
-				rw_sector(DEV_WRITE,
-					  pin->i_dev,
-					  i * SECTOR_SIZE,
-					  chunk * SECTOR_SIZE,
-					  TASK_FS,
-					  fsbuf);
-			}
-			off = 0;
-			bytes_rw += bytes;
-			pcaller->filp[fd]->fd_pos += bytes;
-			bytes_left -= bytes;
 		}
+		off = 0;
+		bytes_rw += bytes;
+		bytes_left -= bytes;
+	}
 
-		if (pcaller->filp[fd]->fd_pos > pin->i_size) {
-			/* update inode::size */
-			pin->i_size = pcaller->filp[fd]->fd_pos;
-			/* write the updated i-node back to disk */
-			sync_inode(pin);
-		}
+	return bytes_rw;
+}
+
+/*****************************************************************************
+ *                                read_direct
+ *****************************************************************************/
+/**
+ * Read whole sectors of a file straight into the caller's buffer.
+ *
+ * TASK_HD is given the caller's proc nr and buffer, so the data is not
+ * staged in fsbuf at all.
+ * 
+ * @param pin  I-node of the file.
+ * @param pos  Byte offset in the file, must be sector aligned.
+ * @param len  How many bytes to read, must be a multiple of SECTOR_SIZE.
+ * @param src  Caller proc nr.
+ * @param buf  Caller's buffer.
+ * 
+ * @return How many bytes have been read.
+ *****************************************************************************/
+PRIVATE int read_direct(struct inode * pin, int pos, int len,
+			int src, void * buf)
+{
+	assert(pos % SECTOR_SIZE == 0);
+	assert(len % SECTOR_SIZE == 0);
+
+	int sect = pin->i_start_sect + (pos >> SECTOR_SIZE_SHIFT);
+	int nr_sects = len >> SECTOR_SIZE_SHIFT;
+	int bytes_rd = 0;
+
+	while (nr_sects) {
+		int n = min(nr_sects, DIRECT_IO_MAX_SECTS);
+		rw_sector(DEV_READ,
+			  pin->i_dev,
+			  (u64)sect * SECTOR_SIZE,
+			  n * SECTOR_SIZE,
+			  src,
+			  buf + bytes_rd);
+		sect += n;
+		nr_sects -= n;
+		bytes_rd += n * SECTOR_SIZE;
+	}
+
+	return bytes_rd;
+}
+
+/*****************************************************************************
+ *                                park_direct
+ *****************************************************************************/
+/**
+ * Like read_direct(), but only hand the first chunk to the driver and
+ * return. TASK_FS goes on serving other requests; each completion comes
+ * back to task_fs() as a message from the driver and is passed to
+ * disk_done().
+ * 
+ * @param pin  I-node of the file.
+ * @param pos  Byte offset in the file, must be sector aligned.
+ * @param len  How many bytes to read, must be a multiple of SECTOR_SIZE.
+ * @param src  Caller proc nr.
+ * @param buf  Caller's buffer.
+ * @param cnt  The byte count of the whole request, replied to the caller.
+ *****************************************************************************/
+PRIVATE void park_direct(struct inode * pin, int pos, int len,
+			 int src, void * buf, int cnt)
+{
+	assert(pos % SECTOR_SIZE == 0);
+	assert(len % SECTOR_SIZE == 0);
+
+	/* only one read is parked at a time, the previous one finishes first */
+	disk_drain();
+
+	lock_inode(pin);
+	fs_cur->parked = 1;
+
+	dreq.req	= fs_cur;
+	dreq.pin	= pin;
+	dreq.cnt	= cnt;
+	dreq.dev	= pin->i_dev;
+	dreq.sect	= pin->i_start_sect + (pos >> SECTOR_SIZE_SHIFT);
+	dreq.nr_sects	= len >> SECTOR_SIZE_SHIFT;
+	dreq.buf	= buf;
+
+	disk_issue();
+}
+
+/*****************************************************************************
+ *                                disk_issue
+ *****************************************************************************/
+/**
+ * Send the next chunk of the parked read to the driver, without waiting.
+ *****************************************************************************/
+PRIVATE void disk_issue()
+{
+	MESSAGE driver_msg;
+
+	dreq.chunk = min(dreq.nr_sects, DIRECT_IO_MAX_SECTS);
+
+	driver_msg.type		= DEV_READ;
+	driver_msg.DEVICE	= MINOR(dreq.dev);
+	driver_msg.POSITION	= (u64)dreq.sect * SECTOR_SIZE;
+	driver_msg.BUF		= dreq.buf;
+	driver_msg.CNT		= dreq.chunk * SECTOR_SIZE;
+	driver_msg.PROC_NR	= dreq.req->msg.source;
+	assert(dd_map[MAJOR(dreq.dev)].driver_nr != INVALID_DRIVER);
+	send_recv(SEND, dd_map[MAJOR(dreq.dev)].driver_nr, &driver_msg);
+}
+
+/*****************************************************************************
+ *                                disk_done
+ *****************************************************************************/
+/**
+ * The driver has finished the chunk in flight. Issue the next one, or reply
+ * to the caller if the parked read is complete.
+ *****************************************************************************/
+PUBLIC void disk_done()
+{
+	assert(dreq.req);
+
+	dreq.sect	+= dreq.chunk;
+	dreq.nr_sects	-= dreq.chunk;
+	dreq.buf	+= dreq.chunk * SECTOR_SIZE;
+
+	if (dreq.nr_sects) {
+		disk_issue();
+		return;
+	}
+
+	struct fs_req * r = dreq.req;
+	dreq.req = 0;
+	unlock_inode(dreq.pin);
+
+	r->msg.type = SYSCALL_RET;
+	r->msg.CNT  = dreq.cnt;
+	send_recv(SEND, r->msg.source, &r->msg);
+	r->parked = 0;
+}
+
+/*****************************************************************************
+ *                                disk_drain
+ *****************************************************************************/
+/**
+ * Wait until the parked read, if any, is complete.
+ *
+ * Must be called before FS sends anything else to the driver: the driver
+ * would be blocked sending its completion to FS while FS is blocked sending
+ * to the driver.
+ *****************************************************************************/
+PUBLIC void disk_drain()
+{
+	MESSAGE msg;
 
-		return bytes_rw;
+	while (dreq.req) {
+		send_recv(RECEIVE, dd_map[MAJOR(dreq.dev)].driver_nr, &msg);
+		disk_done();
 	}
 }
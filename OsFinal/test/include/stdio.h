@@ -39,6 +39,30 @@ void assertion_failure(char *exp, char *file, char *base_file, int line);
 #define	O_CREAT		1
 #define	O_RDWR		2
 #define	O_TRUNC		4
+#define	O_RDONLY	8	/* FIFO and pipe read end */
+#define	O_WRONLY	16	/* FIFO and pipe write end */
+
+/**
+ * @struct termios
+ * @brief  Line discipline of a TTY, see tcgetattr() and tcsetattr().
+ *
+ * With ICANON, a read returns one edited line. Without it, chars are
+ * returned as they are typed: a read waits for c_vmin chars, and gives up
+ * c_vtime tenths of a second after the last char (or after the read started,
+ * if c_vmin is 0). c_vmin == c_vtime == 0 does not wait at all.
+ */
+struct termios {
+	int	c_lflag;	/* ICANON | ECHO */
+	int	c_vmin;
+	int	c_vtime;
+};
+
+#define	ICANON		1	/* canonical mode: line editing */
+#define	ECHO		2	/* echo typed chars */
+
+/* ioctl() requests of a TTY */
+#define	TCGETS		0x5401
+#define	TCSETS		0x5402
 
 #define SEEK_SET	1
 #define SEEK_CUR	2
@@ -58,6 +82,24 @@ struct stat {
 	int st_size;		/* file size */
 };
 
+/**
+ * @struct iovec
+ * @brief  One buffer of readv() / writev().
+ */
+struct iovec {
+	void *	iov_base;	/* start of the buffer */
+	int	iov_len;	/* size of the buffer */
+};
+
+#define	IOV_MAX		16	/* max buffers per readv() / writev() */
+
+/* mmap() */
+#define	PROT_READ	1
+#define	PROT_WRITE	2
+#define	MAP_SHARED	1
+#define	MAP_PRIVATE	2
+#define	MAP_FAILED	((void*)-1)
+
 /**
  * @struct time
  * @brief  RTC time from CMOS.
@@ -71,6 +113,17 @@ struct time {
 	u32 second;
 };
 
+/**
+ * @struct timespec
+ * @brief  Time from clock_gettime().
+ */
+struct timespec {
+	int	tv_sec;		/**< Seconds */
+	int	tv_nsec;	/**< Nanoseconds, 0 ~ 999999999 */
+};
+
+#define	CLOCK_MONOTONIC	1	/* time since boot, never goes back */
+
 #define  BCD_TO_DEC(x)      ( (x >> 4) * 10 + (x & 0x0f) )
 
 /*========================*
@@ -129,15 +182,63 @@ PUBLIC int	read		(int fd, void *buf, int count);
 /* lib/write.c */
 PUBLIC int	write		(int fd, const void *buf, int count);
 
+/* lib/pread.c */
+PUBLIC int	pread		(int fd, void *buf, int count, int offset);
+
+/* lib/pwrite.c */
+PUBLIC int	pwrite		(int fd, const void *buf, int count, int offset);
+
+/* lib/readv.c */
+PUBLIC int	readv		(int fd, const struct iovec *iov, int iovcnt);
+
+/* lib/writev.c */
+PUBLIC int	writev		(int fd, const struct iovec *iov, int iovcnt);
+
+/* lib/pipe.c */
+PUBLIC	int	pipe		(int fd[2]);
+
+/* lib/mkfifo.c */
+PUBLIC	int	mkfifo		(const char *pathname);
+
+/* lib/dup2.c */
+PUBLIC	int	dup2		(int oldfd, int newfd);
+
+/* lib/ioctl.c */
+PUBLIC	int	ioctl		(int fd, int request, void *argp);
+PUBLIC	int	tcgetattr	(int fd, struct termios *t);
+PUBLIC	int	tcsetattr	(int fd, const struct termios *t);
+
 /* lib/lseek.c */
 PUBLIC	int	lseek		(int fd, int offset, int whence);
 
+/* lib/mmap.c */
+PUBLIC	void *	mmap		(void *addr, int length, int prot, int flags,
+				 int fd, int offset);
+
+/* lib/munmap.c */
+PUBLIC	int	munmap		(void *addr, int length);
+
+/* lib/ftruncate.c */
+PUBLIC	int	ftruncate	(int fd, int length);
+
+/* lib/fallocate.c */
+PUBLIC	int	fallocate	(int fd, int len);
+
 /* lib/unlink.c */
 PUBLIC	int	unlink		(const char *pathname);
 
+/* lib/rename.c */
+PUBLIC	int	rename		(const char *oldpath, const char *newpath);
+
+/* lib/copyrange.c */
+PUBLIC	int	copy_file_range	(int fd_in, int fd_out, int len);
+
 /* lib/getpid.c */
 PUBLIC int	getpid		();
 
+/* lib/sleep.c */
+PUBLIC int	sleep_ms	(int msec);
+
 /* lib/fork.c */
 PUBLIC int	fork		();
 
@@ -27,6 +27,7 @@
 #define	BI_MAG				0
 #define	BI_MEM_SIZE			1
 #define	BI_KERNEL_FILE			2
+#define	BI_HZ				3
 
 /**
  * corresponding with boot/include/load.inc::ROOT_BASE, which should
@@ -34,6 +35,20 @@
  */
 #define	MINOR_BOOT			MINOR_hd2c
 
+/*
+ * where printl() and panic() go: LOG_TO_CONSOLE, LOG_TO_SERIAL or both.
+ * With LOG_TO_SERIAL the output can be captured by `qemu -serial stdio'.
+ */
+#define	LOG_TO_CONSOLE			1
+#define	LOG_TO_SERIAL			2
+#define	LOG_SINK			(LOG_TO_CONSOLE | LOG_TO_SERIAL)
+
+/*
+ * lines kept by each console for scrolling back (Shift+Up), at least one
+ * screen. NR_CONSOLES * CONSOLE_LINES * 160 bytes must fit in CON_TEXT_SIZE.
+ */
+#define	CONSOLE_LINES			1000
+
 /*
  * disk log
  */
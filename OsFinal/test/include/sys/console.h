@@ -8,22 +8,41 @@
 #ifndef _ORANGES_CONSOLE_H_
 #define _ORANGES_CONSOLE_H_
 
+#define ESC_MAX_PARAMS	4	/* ESC[p1;p2;...X */
+
 /* CONSOLE */
 typedef struct s_console
 {
-	unsigned int	crtc_start; /* set CRTC start addr reg */
-	unsigned int	orig;	    /* start addr of the console */
-	unsigned int	con_size;   /* how many words does the console have */
-	unsigned int	cursor;
-	int		is_full;
+	u16 *		text;	    /* CONSOLE_LINES lines, used as a ring */
+	unsigned int	cursor;	    /* line * SCR_WIDTH + column */
+	unsigned int	scr_top;    /* line at the top of the screen */
+	unsigned int	view_top;   /* line at the top of what is to be seen,
+				     * above scr_top when scrolled back */
+
+	/* damage: cells in [dirty_lo, dirty_hi) may not be on the screen yet */
+	unsigned int	dirty_lo;
+	unsigned int	dirty_hi;
+
+	/* ANSI/VT100 escape sequences, see put_char() */
+	int		esc_state;  /* ESC_NONE, ESC_ESC or ESC_CSI */
+	int		esc_params[ESC_MAX_PARAMS];
+	int		esc_nr_params;
+	u8		attr;	    /* color of the chars printed */
+	int		saved_x;    /* ESC[s */
+	int		saved_y;
 }CONSOLE;
 
+#define ESC_NONE	0
+#define ESC_ESC		1	/* got ESC */
+#define ESC_CSI		2	/* got ESC[ */
+
 
 #define SCR_UP	1	/* scroll upward */
 #define SCR_DN	-1	/* scroll downward */
 
 #define SCR_SIZE		(80 * 25)
 #define SCR_WIDTH		 80
+#define SCR_LINES		(SCR_SIZE / SCR_WIDTH)
 
 #define DEFAULT_CHAR_COLOR	(MAKE_COLOR(BLACK, WHITE))
 #define GRAY_CHAR		(MAKE_COLOR(BLACK, BLACK) | BRIGHT)
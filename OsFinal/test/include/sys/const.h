@@ -51,12 +51,15 @@
 
 /* TTY */
 #define NR_CONSOLES	3	/* consoles */
+#define NR_SERIALS	1	/* serial lines, minor NR_CONSOLES ~ */
+#define NR_TTYS		(NR_CONSOLES + NR_SERIALS)
 
 /* 8259A interrupt controller ports. */
 #define	INT_M_CTL	0x20	/* I/O port for interrupt controller         <Master> */
 #define	INT_M_CTLMASK	0x21	/* setting bits in this port disables ints   <Master> */
 #define	INT_S_CTL	0xA0	/* I/O port for second interrupt controller  <Slave>  */
 #define	INT_S_CTLMASK	0xA1	/* setting bits in this port disables ints   <Slave>  */
+#define	READ_IRR	0x0A	/* OCW3: next read of the CTL port gives the IRR      */
 
 /* 8253/8254 PIT (Programmable Interval Timer) */
 #define TIMER0         0x40 /* I/O port for timer channel 0 */
@@ -65,7 +68,50 @@
 			     * Counter0 - LSB then MSB - rate generator - binary
 			     */
 #define TIMER_FREQ     1193182L/* clock frequency for timer in PC and AT */
-#define HZ             100  /* clock freq (software settable on IBM-PC) */
+#define DEFAULT_HZ     100  /* clock freq (software settable on IBM-PC) */
+#define MIN_HZ         19   /* TIMER_FREQ/MIN_HZ must fit in 16 bits */
+#define MAX_HZ         1000
+#define ONE_SHOT       0x30 /* 00-11-000-0 :
+			     * Counter0 - LSB then MSB - int on terminal count
+			     * - binary
+			     */
+#define LATCH_COUNT0   0x00 /* 00-00-000-0 : Counter0 - latch the count */
+#define TIMER2         0x42 /* I/O port for timer channel 2 */
+#define ONE_SHOT2      0xB0 /* 10-11-000-0 :
+			     * Counter2 - LSB then MSB - int on terminal count
+			     * - binary
+			     */
+#define PORT_B         0x61 /* I/O port for 8255 port B */
+#define PORT_B_GATE2   0x01 /* gate of timer channel 2 */
+#define PORT_B_SPKR    0x02 /* speaker data, driven by channel 2 */
+#define PORT_B_OUT2    0x20 /* output of timer channel 2 */
+#define TSC_CALIBRATE_MS 10 /* how long the TSC is counted against the PIT */
+
+/* 16550 UART of COM1 */
+#define COM1_BASE	0x3F8
+#define UART_RBR	(COM1_BASE + 0)	/* Read : Receiver Buffer   (DLAB=0) */
+#define UART_THR	(COM1_BASE + 0)	/* Write: Transmit Holding  (DLAB=0) */
+#define UART_DLL	(COM1_BASE + 0)	/* Divisor Latch LSB        (DLAB=1) */
+#define UART_DLM	(COM1_BASE + 1)	/* Divisor Latch MSB        (DLAB=1) */
+#define UART_IER	(COM1_BASE + 1)	/* Interrupt Enable         (DLAB=0) */
+#define UART_IIR	(COM1_BASE + 2)	/* Read : Interrupt Identification */
+#define UART_FCR	(COM1_BASE + 2)	/* Write: FIFO Control */
+#define UART_LCR	(COM1_BASE + 3)	/* Line Control */
+#define UART_MCR	(COM1_BASE + 4)	/* Modem Control */
+#define UART_LSR	(COM1_BASE + 5)	/* Line Status */
+#define UART_MSR	(COM1_BASE + 6)	/* Modem Status */
+#define IER_RDA		0x01	/* int when data is received */
+#define IER_THRE	0x02	/* int when the transmitter is empty */
+#define IIR_NO_INT	0x01	/* no interrupt pending */
+#define FCR_ENABLE	0xC7	/* enable & clear FIFOs, RX trigger 14 bytes */
+#define LCR_DLAB	0x80	/* divisor latch access */
+#define LCR_8N1		0x03	/* 8 data bits, no parity, 1 stop bit */
+#define MCR_DTR_RTS_OUT2 0x0B	/* OUT2 gates the int line to the 8259 */
+#define LSR_DR		0x01	/* data ready */
+#define LSR_THRE	0x20	/* transmit holding register empty */
+#define UART_FIFO_SIZE	16
+#define UART_CLOCK	115200	/* 1.8432 MHz / 16, baud = UART_CLOCK / divisor */
+#define SERIAL_BAUD	115200
 
 /* AT keyboard */
 /* 8042 ports */
@@ -128,28 +174,37 @@
 #define	PRINTER_IRQ	7
 #define	AT_WINI_IRQ	14	/* at winchester */
 
+/* softirqs, run in this order, see softirq.c */
+#define	NR_SOFTIRQS	3
+#define	SOFTIRQ_INFORM	0	/* HARD_INT to tasks, see defer_inform() */
+#define	SOFTIRQ_SCHED	1	/* schedule(), raised by the clock */
+#define	SOFTIRQ_KBD	2	/* keys in, switch to TTY */
+
 /* tasks */
 /* 注意 TASK_XXX 的定义要与 global.c 中对应 */
 #define INVALID_DRIVER	-20
 #define INTERRUPT	-10
+#define NOTIFICATION	-11	/* source of NOTIFY_MSG, see notify() */
 #define TASK_TTY	0
 #define TASK_SYS	1
 #define TASK_HD		2
 #define TASK_FS		3
 #define TASK_MM		4
 #define INIT		5
+#define IDLE		(NR_TASKS + NR_NATIVE_PROCS - 1)	/* the idle proc */
 #define ANY		(NR_TASKS + NR_PROCS + 10)
 #define NO_TASK		(NR_TASKS + NR_PROCS + 20)
 
 #define	MAX_TICKS	0x7FFFABCD
 
 /* system call */
-#define NR_SYS_CALL	3
+#define NR_SYS_CALL	4
 
 /* ipc */
 #define SEND		1
 #define RECEIVE		2
 #define BOTH		3	/* BOTH = (SEND | RECEIVE) */
+#define NOTIFY		4	/* set bits at dest, never blocks */
 
 /* magic chars used by `printx' */
 #define MAG_CH_PANIC	'\002'
@@ -167,10 +222,12 @@ enum msgtype {
 	HARD_INT = 1,
 
 	/* SYS task */
-	GET_TICKS, GET_PID, GET_RTC_TIME,
+	GET_TICKS, GET_PID, GET_RTC_TIME, SLEEP,
 
 	/* FS */
 	OPEN, CLOSE, READ, WRITE, LSEEK, STAT, UNLINK,RENAME,
+	PREAD, PWRITE, READV, WRITEV, COPY_RANGE, FTRUNCATE, FALLOCATE,
+	MMAP, MUNMAP, PIPE, MKFIFO, DUP, IOCTL,
 
 	/* FS & TTY */
 	SUSPEND_PROC, RESUME_PROC,
@@ -184,6 +241,9 @@ enum msgtype {
 	/* TTY, SYS, FS, MM, etc */
 	SYSCALL_RET,
 
+	/* the bits notify() has set, from NOTIFICATION */
+	NOTIFY_MSG,
+
 	/* message type for drivers */
 	DEV_OPEN = 1001,
 	DEV_CLOSE,
@@ -194,6 +254,7 @@ enum msgtype {
 
 /* macros for messages */
 #define	FD		u.m3.m3i1
+#define	FD_OUT		u.m3.m3i3
 #define	PATHNAME	u.m3.m3p1
 #define	FLAGS		u.m3.m3i1
 #define	NAME_LEN	u.m3.m3i2
@@ -206,6 +267,10 @@ enum msgtype {
 #define	BUF		u.m3.m3p2
 #define	OFFSET		u.m3.m3i2
 #define	WHENCE		u.m3.m3i3
+#define	MMAP_PROT	u.m3.m3i3
+#define	MMAP_FLAGS	u.m3.m3i4
+#define	MSEC		u.m3.m3i2
+#define	NOTIFY_BITS	u.m3.m3i1
 
 #define	PID		u.m3.m3i2
 #define	RETVAL		u.m3.m3i1
@@ -235,7 +300,7 @@ enum msgtype {
 #define	DEV_SCSI		5
 /* make device number from major and minor numbers */
 #define	MAJOR_SHIFT		8
-#define	MAKE_DEV(a,b)		((a << MAJOR_SHIFT) | b)
+#define	MAKE_DEV(a,b)		(((a) << MAJOR_SHIFT) | (b))
 /* separate major and minor numbers from device number */
 #define	MAJOR(x)		((x >> MAJOR_SHIFT) & 0xFF)
 #define	MINOR(x)		(x & 0xFF)
@@ -277,6 +342,7 @@ enum msgtype {
 #define	NR_FILE_DESC	64	/* FIXME */
 #define	NR_INODE	64	/* FIXME */
 #define	NR_SUPER_BLOCK	8
+#define	NR_FS_REQS	4	/* request contexts of FS */
 
 
 /* INODE::i_mode (octal, lower 12 bits reserved) */
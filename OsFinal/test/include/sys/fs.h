@@ -83,6 +83,8 @@ struct inode {
 	int	i_dev;
 	int	i_cnt;		/**< How many procs share this inode  */
 	int	i_num;		/**< inode nr.  */
+	struct fs_req *	i_lock;	/**< Request holding the i-node, or 0 */
+	struct pipe *	i_pipe;	/**< Ring buffer of an open FIFO, or 0 */
 
 	u32 next_inode[10];
 };
@@ -131,23 +133,123 @@ struct file_desc {
 	struct inode*	fd_inode;	/**< Ptr to the i-node */
 };
 
+/**
+ * @struct fs_req
+ * @brief  Everything FS keeps about one request while serving it.
+ *
+ * task_fs() receives each message into a free slot of fs_req_table[] and
+ * points fs_cur at it; the FS code reaches the message and its sender as
+ * fs_cur->msg and fs_cur->caller. A slot stays taken while its request is
+ * parked (see park_direct()), so FS can take new requests meanwhile.
+ */
+struct fs_req {
+	MESSAGE		msg;	/**< The request, then the reply */
+	struct proc *	caller;	/**< Who sent the request */
+	int		parked;	/**< Waiting for the disk, reply pending */
+};
+
 
 /**
  * Since all invocations of `rw_sector()' in FS look similar (most of the
  * params are the same), we use this macro to make code more readable.
+ *
+ * All single-sector r/w through fsbuf is metadata (maps, i-nodes, dir
+ * entries), so it goes through the journal, see fs/journal.c.
+ */
+#define RD_SECT(dev,sect_nr) journal_rd_sect(dev, sect_nr);
+#define WR_SECT(dev,sect_nr) journal_wr_sect(dev, sect_nr);
+
+/**
+ * @def   PCACHE_PAGE_SIZE
+ * @brief Page size of the mmap() page cache, see fs/mmap.c.
+ */
+#define	PCACHE_PAGE_SIZE	0x1000
+#define	NR_PCACHE_PAGES		0xF0	/* pcache: 960KB */
+#define	NR_PCACHE_MAPS		16	/* file ranges held in pcache */
+#define	NR_MAP_REFS		32	/* mmap()s alive */
+
+/**
+ * @def   PIPE_BUF_SIZE
+ * @brief Capacity of a pipe's ring buffer, see fs/pipe.c.
  */
-#define RD_SECT(dev,sect_nr) rw_sector(DEV_READ, \
-				       dev,				\
-				       (sect_nr) * SECTOR_SIZE,		\
-				       SECTOR_SIZE, /* read one sector */ \
-				       TASK_FS,				\
-				       fsbuf);
-#define WR_SECT(dev,sect_nr) rw_sector(DEV_WRITE, \
-				       dev,				\
-				       (sect_nr) * SECTOR_SIZE,		\
-				       SECTOR_SIZE, /* write one sector */ \
-				       TASK_FS,				\
-				       fsbuf);
-
-	
+#define	PIPE_BUF_SIZE		1024
+#define	NR_PIPES		8	/* pipes and FIFOs open at once */
+
+/**
+ * @def   JOURNAL_MAX_BLOCKS
+ * @brief Max metadata sectors in one journal transaction.
+ */
+#define	JOURNAL_MAX_BLOCKS	32
+
+/**
+ * @def   JOURNAL_NR_SECTS
+ * @brief Size of the journal region: one header sector plus the blocks.
+ *
+ * The region sits right before the disk log at the end of the partition.
+ */
+#define	JOURNAL_NR_SECTS	(1 + JOURNAL_MAX_BLOCKS)
+
+/**
+ * @def   JOURNAL_OP_MAX_SECTS
+ * @brief Max metadata sectors a single FS request may dirty without calling
+ *        journal_reserve() first.
+ *
+ * A transaction with fewer free slots than this is committed before the
+ * next request starts, so a request never straddles two transactions.
+ */
+#define	JOURNAL_OP_MAX_SECTS	8
+
+/**
+ * @def   JOURNAL_BATCH_OPS
+ * @brief Requests sharing one commit at most.
+ */
+#define	JOURNAL_BATCH_OPS	16
+
+/**
+ * @def   JOURNAL_COMMIT_TICKS
+ * @brief A dirty transaction is committed at latest this many ticks later.
+ */
+#define	JOURNAL_COMMIT_TICKS	(system_hz / 2)
+
+#define	JOURNAL_MAGIC		0x4A4E4C31 /* "JNL1" */
+
+/**
+ * @struct journal_header
+ * @brief  The 1st sector of the journal region.
+ *
+ * The header and the blocks of a transaction are written in one go. The
+ * checksum covers both, so a torn write is never replayed.
+ */
+struct journal_header {
+	u32	magic;			/**< JOURNAL_MAGIC */
+	u32	seq;			/**< Transaction nr */
+	u32	nr_blocks;		/**< How many blocks follow */
+	u32	checksum;		/**< Over sects[] and the blocks */
+	u32	sects[JOURNAL_MAX_BLOCKS]; /**< Home sector of each block */
+};
+
+/**
+ * @def   DIRECT_IO_MIN_BYTES
+ * @brief Reads at least this large skip fsbuf for their aligned sectors.
+ */
+#define	DIRECT_IO_MIN_BYTES	(SECTOR_SIZE * 4)
+
+/**
+ * @def   DIRECT_IO_MAX_SECTS
+ * @brief Max sectors per direct request.
+ *
+ * hd_rdwt() issues a single ATA command per request, and the sector count
+ * register is only 8 bits wide.
+ */
+#define	DIRECT_IO_MAX_SECTS	128
+
+/**
+ * @def   COPY_RANGE_CHUNK
+ * @brief Bytes copied per round by do_copy_range().
+ *
+ * The data is staged in the upper half of fsbuf, and a chunk of this size
+ * never needs more than the lower half for its sector I/O.
+ */
+#define	COPY_RANGE_CHUNK	(FSBUF_SIZE / 4)
+
 #endif /* _ORANGES_FS_H_ */
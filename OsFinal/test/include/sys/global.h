@@ -12,6 +12,7 @@
 #endif
 
 EXTERN	int	ticks;
+EXTERN	int	system_hz;	/* ticks per second */
 
 EXTERN	int	schedule_flag;
 
@@ -22,20 +23,31 @@ EXTERN	struct descriptor	gdt[GDT_SIZE];
 EXTERN	u8			idt_ptr[6];	/* 0~15:Limit  16~47:Base */
 EXTERN	struct gate		idt[IDT_SIZE];
 
-EXTERN	u32	k_reenter;
 EXTERN	int	current_console;
+extern	u16 *	con_text;
+extern	const int	CON_TEXT_SIZE;
 
-EXTERN	int	key_pressed; /**
-			      * used for clock_handler
-			      * to wake up TASK_TTY when
-			      * a key is pressed
-			      */
+EXTERN	int	tty_countdown; /**
+				* ticks before clock_handler
+				* wakes up TASK_TTY for a raw
+				* read timing out or the screen
+				* to be rendered, 0: idle
+				*/
+EXTERN	int	sys_countdown; /**
+				* ticks before clock_handler
+				* wakes up TASK_SYS for the
+				* 1st sleeper due, 0: idle
+				*/
 
-EXTERN	struct tss	tss;
-EXTERN	struct proc*	p_proc_ready;
+EXTERN	u32	tsc_khz;	/* TSC cycles per millisecond */
+
+EXTERN	int	apic_mode;	/* IRQs come through the APICs, see apic.c */
+EXTERN	u32	lapic_eoi;	/* addr of the EOI register of the local APIC */
+EXTERN	u32	lapic_tick_count; /* local APIC timer counts a tick */
 
 extern	char		task_stack[];
 extern	struct proc	proc_table[];
+extern	struct mailbox	mailbox_table[];
 extern  struct task	task_table[];
 extern  struct task	user_proc_table[];
 extern	irq_handler	irq_table[];
@@ -54,9 +66,17 @@ EXTERN	struct inode		inode_table[NR_INODE];
 EXTERN	struct super_block	super_block[NR_SUPER_BLOCK];
 extern	u8 *			fsbuf;
 extern	const int		FSBUF_SIZE;
-EXTERN	MESSAGE			fs_msg;
-EXTERN	struct proc *		pcaller;
+extern	u8 *			pcache;
+extern	const int		PCACHE_SIZE;
+EXTERN	struct fs_req		fs_req_table[NR_FS_REQS];
+EXTERN	struct fs_req *		fs_cur;	/* the request being served */
 EXTERN	struct inode *		root_inode;
+EXTERN	int			journal_countdown; /**
+							    * ticks before
+							    * clock_handler
+							    * asks FS to
+							    * commit, 0: idle
+							    */
 extern	struct dev_drv_map	dd_map[];
 
 /* for test only */
@@ -28,6 +28,26 @@ struct stackframe {	/* proc_ptr points here				↑ Low			*/
 };
 
 
+/* kernel mailboxes, given to TASK_SYS and TASK_FS by kernel_main() */
+#define NR_MAILBOXES		2
+#define MAILBOX_SIZE		16	/* messages */
+
+/**
+ * @struct mailbox
+ * @brief  Messages sent to a proc and not received yet, kept by the kernel
+ *         so that the senders need not wait. See msg_send().
+ */
+struct mailbox {
+	MESSAGE	slot[MAILBOX_SIZE];
+	int	head;		/**< Index of the oldest message */
+	int	count;		/**< How many messages */
+	int	high_water;	/**< The most messages it has ever held */
+	u32	nr_queued;	/**< Messages that went through it */
+	u32	nr_full;	/**< Senders blocked for it being full */
+	u32	nr_dropped;	/**< Messages dropped as blocking would
+				 *   deadlock */
+};
+
 struct proc {
 	struct stackframe regs;    /* process registers saved in stack frame */
 
@@ -36,6 +56,9 @@ struct proc {
 
         int ticks;                 /* remained ticks */
         int priority;
+	int p_level;               /* MLFQ level, 0 is the highest */
+	u64 p_pass;                /* stride scheduling: virtual time */
+	u32 p_runtime;             /* ticks run, for the curious */
 
 	/* u32 pid;                   /\* process id passed in from MM *\/ */
 	char name[16];		   /* name of the process */
@@ -53,6 +76,10 @@ struct proc {
 				    * nonzero if an INTERRUPT occurred when
 				    * the task is not ready to deal with it.
 				    */
+	u32 notify_pending;        /**
+				    * bits notify() has set, not received
+				    * yet
+				    */
 
 	struct proc * q_sending;   /**
 				    * queue of procs sending messages to
@@ -62,12 +89,18 @@ struct proc {
 				    * next proc in the sending
 				    * queue (q_sending)
 				    */
+	struct mailbox * p_mailbox;/**
+				    * 0 if senders are to wait till this
+				    * proc receives
+				    */
 
 	int p_parent; /**< pid of parent process */
 
 	int exit_status; /**< for parent */
 
 	struct file_desc * filp[NR_FILES];
+
+	struct cpu * p_cpu; /**< the processor running it, 0: none */
 };
 
 struct task {
@@ -84,10 +117,20 @@ struct task {
 
 #define RR_SCHEDULE	1
 #define PRIO_SCHEDULE	2
+#define MLFQ_SCHEDULE	3
+#define STRIDE_SCHEDULE	4
+
+/* multilevel feedback queue, level 0 is the highest */
+#define NR_MLFQ_LEVELS		4
+#define MLFQ_QUANTUM(level)	(2 << (level))	/* ticks a level may run */
+#define MLFQ_BOOST_TICKS	system_hz	/* everyone back to level 0 */
+
+/* stride scheduling: a tick run adds STRIDE1 / priority to the pass */
+#define STRIDE1			(1 << 20)
 
 //#define NR_NATIVE_PROCS		5
 
-#define NR_NATIVE_PROCS		4
+#define NR_NATIVE_PROCS		5
 #define FIRST_PROC		proc_table[0]
 #define LAST_PROC		proc_table[NR_TASKS + NR_PROCS - 1]
 
@@ -116,6 +159,7 @@ struct task {
 #define STACK_SIZE_TESTA	STACK_SIZE_DEFAULT
 #define STACK_SIZE_TESTB	STACK_SIZE_DEFAULT
 #define STACK_SIZE_TESTC	STACK_SIZE_DEFAULT
+#define STACK_SIZE_IDLE		STACK_SIZE_DEFAULT
 
 #define STACK_SIZE_TOTAL	(STACK_SIZE_TTY + \
 				STACK_SIZE_SYS + \
@@ -125,5 +169,6 @@ struct task {
 				STACK_SIZE_INIT + \
 				STACK_SIZE_TESTA + \
 				STACK_SIZE_TESTB + \
-				STACK_SIZE_TESTC)
+				STACK_SIZE_TESTC + \
+				STACK_SIZE_IDLE)
 
@@ -74,15 +74,15 @@ struct tss {
 #define	INDEX_FLAT_C		1	/* ┣ LOADER 里面已经确定了的. */
 #define	INDEX_FLAT_RW		2	/* ┃                          */
 #define	INDEX_VIDEO		3	/* ┛                          */
-#define	INDEX_TSS		4
-#define	INDEX_LDT_FIRST		5
+#define	INDEX_TSS		4	/* one for each of the NR_CPUS (smp.h) */
+#define	INDEX_LDT_FIRST		12	/* INDEX_TSS + NR_CPUS */
 /* 选择子 */
 #define	SELECTOR_DUMMY		   0		/* ┓                          */
 #define	SELECTOR_FLAT_C		0x08		/* ┣ LOADER 里面已经确定了的. */
 #define	SELECTOR_FLAT_RW	0x10		/* ┃                          */
 #define	SELECTOR_VIDEO		(0x18+3)	/* ┛<-- RPL=3                 */
-#define	SELECTOR_TSS		0x20		/* TSS. 从外层跳到内存时 SS 和 ESP 的值从里面获得. */
-#define SELECTOR_LDT_FIRST	0x28
+#define	SELECTOR_TSS		0x20		/* BSP 的 TSS. 从外层跳到内存时 SS 和 ESP 的值从里面获得. */
+#define SELECTOR_LDT_FIRST	0x60
 
 #define	SELECTOR_KERNEL_CS	SELECTOR_FLAT_C
 #define	SELECTOR_KERNEL_DS	SELECTOR_FLAT_RW
@@ -155,6 +155,13 @@ struct tss {
 /* 系统调用 */
 #define INT_VECTOR_SYS_CALL             0x90
 
+/* IPIs: the tick the BSP passes on to the APs, and an AP waking the BSP */
+#define	INT_VECTOR_AP_TICK		0x30
+#define	INT_VECTOR_RESCHED		0x31
+
+/* local APIC spurious interrupt, the low 4 bits must be 1s */
+#define	INT_VECTOR_SPURIOUS		0xFF
+
 /* 宏 */
 /* 线性地址 → 物理地址 */
 //#define vir2phys(seg_base, vir)	(u32)(((u32)seg_base) + (u32)(vir))
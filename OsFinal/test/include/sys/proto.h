@@ -14,6 +14,8 @@ PUBLIC void	disable_irq(int irq);
 PUBLIC void	enable_irq(int irq);
 PUBLIC void	disable_int();
 PUBLIC void	enable_int();
+PUBLIC void	irqoff_begin();
+PUBLIC void	irqoff_end();
 PUBLIC void	port_read(u16 port, void* buf, int n);
 PUBLIC void	port_write(u16 port, void* buf, int n);
 PUBLIC void	glitter(int row, int col);
@@ -36,6 +38,8 @@ PUBLIC char *	itoa(char * str, int num);
 
 /* kernel.asm */
 PUBLIC void restart();
+PUBLIC void lock_kernel();
+PUBLIC void unlock_kernel();
 
 /* main.c */
 PUBLIC void Init();
@@ -43,6 +47,7 @@ PUBLIC int  get_ticks();
 PUBLIC void TestA();
 PUBLIC void TestB();
 PUBLIC void TestC();
+PUBLIC void Idle();
 PUBLIC void panic(const char *fmt, ...);
 
 /* i8259.c */
@@ -50,10 +55,21 @@ PUBLIC void init_8259A();
 PUBLIC void put_irq_handler(int irq, irq_handler handler);
 PUBLIC void spurious_irq(int irq);
 
+/* softirq.c */
+PUBLIC void init_softirq();
+PUBLIC void put_softirq_handler(int nr, softirq_handler handler);
+PUBLIC void raise_softirq(int nr);
+PUBLIC void defer_inform(int task_nr);
+PUBLIC void do_softirq();
+
 /* clock.c */
 PUBLIC void clock_handler(int irq);
+PUBLIC void ap_clock_handler();
 PUBLIC void init_clock();
 PUBLIC void milli_delay(int milli_sec);
+PUBLIC void udelay(int usec);
+PUBLIC void clock_idle();
+PUBLIC void clock_wake();
 
 /* kernel/hd.c */
 PUBLIC void task_hd();
@@ -63,11 +79,35 @@ PUBLIC void hd_handler(int irq);
 PUBLIC void init_keyboard();
 PUBLIC void keyboard_read(TTY* p_tty);
 
+/* serial.c */
+PUBLIC void init_serial();
+PUBLIC void serial_handler(int irq);
+PUBLIC void serial_read(TTY* p_tty);
+PUBLIC void serial_write(const char * buf, int len);
+PUBLIC void serial_puts_sync(const char * s);
+
 /* tty.c */
 PUBLIC void task_tty();
 PUBLIC void in_process(TTY* p_tty, u32 key);
 PUBLIC void dump_tty_buf();	/* for debug only */
 
+/* smp.c */
+PUBLIC int  init_smp();
+PUBLIC void run_aps();
+PUBLIC void ap_main();
+PUBLIC struct cpu * this_cpu();
+PUBLIC void tick_aps();
+PUBLIC void kick_bsp();
+PUBLIC void resched_handler();
+PUBLIC void map_apic(u32 addr);
+
+/* apic.c */
+PUBLIC void init_apic();
+PUBLIC void ioapic_enable_irq(int irq);
+PUBLIC int  ioapic_disable_irq(int irq);
+PUBLIC void lapic_timer(int periodic, u32 count);
+PUBLIC u32  lapic_timer_left();
+
 /* systask.c */
 PUBLIC void task_sys();
 
@@ -77,6 +117,8 @@ PUBLIC int			rw_sector(int io_type, int dev, u64 pos,
 					  int bytes, int proc_nr, void * buf);
 PUBLIC struct inode *		get_inode(int dev, int num);
 PUBLIC void			put_inode(struct inode * pinode);
+PUBLIC void			lock_inode(struct inode * pinode);
+PUBLIC void			unlock_inode(struct inode * pinode);
 PUBLIC void			sync_inode(struct inode * p);
 PUBLIC struct super_block *	get_super_block(int dev);
 
@@ -84,12 +126,53 @@ PUBLIC struct super_block *	get_super_block(int dev);
 PUBLIC int		do_open();
 PUBLIC int		do_close();
 PUBLIC int		do_lseek();
+PUBLIC int		do_dup();
+PUBLIC int		do_mkfifo();
+PUBLIC int		do_fallocate();
+PUBLIC int		smap_run_free(int dev, int start_sect, int nr_sects);
+PUBLIC int		smap_nr_sects(int dev, int start_sect, int nr_sects);
+PUBLIC void		set_smap_bits(int dev, int start_sect, int nr_sects,
+				      int val);
 
 /* fs/read_write.c */
 PUBLIC int		do_rdwt();
+PUBLIC int		do_rdwtv();
+PUBLIC int		do_copy_range();
+PUBLIC int		do_ioctl();
+PUBLIC int		do_ftruncate();
+PUBLIC int		rdwt_file(struct inode * pin, int io_type, int pos, int len,
+				  int src, void * buf, int * parked);
+PUBLIC void		disk_done();
+PUBLIC void		disk_drain();
+
+/* fs/mmap.c */
+PUBLIC void *		do_mmap();
+PUBLIC int		do_munmap();
+PUBLIC void		mmap_exit(int pid);
+PUBLIC void		mmap_update(struct inode * pin, int pos, int len,
+				    int src, void * buf);
+PUBLIC int		mmap_shared(struct inode * pin, int pos, int len);
+PUBLIC void		mmap_fetch(struct inode * pin, int pos, int len,
+				   int src, void * buf);
+
+/* fs/pipe.c */
+PUBLIC int		do_pipe();
+PUBLIC int		pipe_open(struct inode * pin, struct file_desc * f);
+PUBLIC void		pipe_close(struct file_desc * f);
+PUBLIC int		pipe_rdwt(struct file_desc * f, int io_type, int src,
+				  void * buf, int len);
+
+/* fs/journal.c */
+PUBLIC void		journal_init(int dev);
+PUBLIC void		journal_rd_sect(int dev, int sect_nr);
+PUBLIC void		journal_wr_sect(int dev, int sect_nr);
+PUBLIC int		journal_reserve(int nr_sects);
+PUBLIC void		journal_end_op();
+PUBLIC void		journal_commit();
 
 /* fs/link.c */
 PUBLIC int		do_unlink();
+PUBLIC int		do_rename();
 
 /* fs/misc.c */
 PUBLIC int		do_stat();
@@ -117,19 +200,24 @@ PUBLIC int		do_exec();
 
 /* console.c */
 PUBLIC void out_char(CONSOLE* p_con, char ch);
+PUBLIC void out_string(CONSOLE* p_con, const char * s, int len);
 PUBLIC void scroll_screen(CONSOLE* p_con, int direction);
 PUBLIC void select_console(int nr_console);
 PUBLIC void init_screen(TTY* p_tty);
 PUBLIC int  is_current_console(CONSOLE* p_con);
+PUBLIC int  render_screen();
 
 /* proc.c */
 PUBLIC	void	schedule();
+PUBLIC	void	set_proc_ready(struct proc * p);
+PUBLIC	void	stride_tick(struct proc * p);
 PUBLIC	void*	va2la(int pid, void* va);
 PUBLIC	int	ldt_seg_linear(struct proc* p, int idx);
 PUBLIC	void	reset_msg(MESSAGE* p);
 PUBLIC	void	dump_msg(const char * title, MESSAGE* m);
 PUBLIC	void	dump_proc(struct proc * p);
 PUBLIC	int	send_recv(int function, int src_dest, MESSAGE* msg);
+PUBLIC	int	notify(int dest, int bit);
 PUBLIC void	inform_int(int task_nr);
 
 /* lib/misc.c */
@@ -142,9 +230,16 @@ PUBLIC void spin(char * func_name);
 PUBLIC	int	sys_sendrec(int function, int src_dest, MESSAGE* m, struct proc* p);
 PUBLIC	int	sys_printx(int _unused1, int _unused2, char* s, struct proc * p_proc);
 
+/* clock.c */
+PUBLIC	int	sys_halt(int _unused1, int _unused2, int _unused3, struct proc * p);
+PUBLIC	int	sys_clock_gettime(int clock_id, struct timespec * tp,
+				  int _unused3, struct proc * p);
+
 /* syscall.asm */
 PUBLIC  void    sys_call();             /* int_handler */
 
 /* 系统调用 - 用户级 */
 PUBLIC	int	sendrec(int function, int src_dest, MESSAGE* p_msg);
 PUBLIC	int	printx(char* str);
+PUBLIC	int	halt();
+PUBLIC	int	clock_gettime(int clock_id, struct timespec * tp);
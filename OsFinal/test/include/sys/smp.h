@@ -0,0 +1,206 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   include/sys/smp.h
+ * @brief  Processors, the local APIC and the MP configuration table.
+ * @author Forrest Y. Yu
+ * @date   2008
+ *****************************************************************************
+ *****************************************************************************/
+
+#ifndef	_ORANGES_SMP_H_
+#define	_ORANGES_SMP_H_
+
+#define	NR_CPUS			8	/* their TSSs are INDEX_TSS~, protect.h */
+#define	KSTACK_SIZE		0x1000	/* kernel stack of an AP, as the BSP's
+					 * StackSpace in kernel.asm */
+#define	CPU_SIZE		148	/* sizeof(struct cpu), corresponding
+					 * with sconst.inc */
+#define	AP_TRAMPOLINE		0x90000	/* where APs start, kernel.bin was here;
+					 * corresponding with kernel/smpboot.asm */
+
+/* paging, corresponding with boot/include/load.inc & pm.inc */
+#define	PAGE_DIR_BASE		0x100000
+#define	PAGE_TBL_BASE		0x101000
+#define	PG_P			1	/* present */
+#define	PG_RWW			2	/* read/write */
+#define	PG_PWT			8	/* write through */
+#define	PG_PCD			0x10	/* cache disabled */
+
+/* local APIC, at LAPIC_BASE unless the MP table says otherwise */
+#define	LAPIC_BASE		0xFEE00000
+#define	IOAPIC_BASE		0xFEC00000
+#define	LAPIC_ID		0x020	/* bits 24~31 */
+#define	LAPIC_TPR		0x080	/* task priority */
+#define	LAPIC_EOI		0x0B0
+#define	LAPIC_SVR		0x0F0	/* spurious interrupt vector */
+#define	LAPIC_IRR(vec)		(0x200 + 0x10 * ((vec) / 32))	/* bit vec%32 */
+#define	LAPIC_ICR_LO		0x300
+#define	LAPIC_ICR_HI		0x310	/* bits 24~31: destination */
+#define	LAPIC_LVT_TIMER		0x320
+#define	LAPIC_LVT_LINT0		0x350
+#define	LAPIC_LVT_LINT1		0x360
+#define	LAPIC_TIMER_INIT	0x380	/* initial count */
+#define	LAPIC_TIMER_CUR		0x390	/* current count */
+#define	LAPIC_TIMER_DIV		0x3E0
+#define	SVR_ENABLE		0x00000100
+#define	ICR_INIT		0x00000500
+#define	ICR_STARTUP		0x00000600
+#define	ICR_PENDING		0x00001000	/* delivery status */
+#define	ICR_ASSERT		0x00004000
+#define	ICR_ALL_BUT_SELF	0x000C0000	/* destination shorthand */
+#define	LVT_NMI			0x00000400
+#define	LVT_EXTINT		0x00000700	/* the 8259A, virtual wire */
+#define	LVT_MASKED		0x00010000
+#define	LVT_PERIODIC		0x00020000	/* timer: periodic, else one-shot */
+#define	TIMER_DIV_16		0x3
+
+/* I/O APIC, registers are reached through IOREGSEL and IOWIN */
+#define	IOAPIC_REGSEL		0x00
+#define	IOAPIC_WIN		0x10
+#define	IOAPIC_VER		0x01	/* bits 16~23: max redirection entry */
+#define	IOAPIC_REDTBL(pin)	(0x10 + 2 * (pin))	/* +1: high dword */
+#define	REDTBL_MASKED		0x00010000
+
+/* IMCR: routes the 8259A to the BSP directly (PIC mode) or to the APICs */
+#define	IMCR_ADDR		0x22
+#define	IMCR_DATA		0x23
+#define	IMCR_SELECT		0x70
+#define	IMCR_APIC		0x01
+
+/**
+ * @struct mp_fp
+ * @brief  MP Floating Pointer Structure.
+ *
+ * Found on a 16-byte boundary in the 1st KB of the EBDA, the last KB of base
+ * memory or the BIOS ROM, see the Intel MultiProcessor Specification 1.4.
+ */
+struct mp_fp {
+	char	signature[4];	/**< "_MP_" */
+	u32	config;		/**< Phys addr of the MP configuration table */
+	u8	length;		/**< In 16 bytes, 1 */
+	u8	spec_rev;
+	u8	checksum;	/**< All bytes add up to 0 */
+	u8	type;		/**< 0: there is a configuration table */
+	u8	features[4];	/**< features[1] bit 7: IMCR present */
+};
+
+/**
+ * @struct mp_conf
+ * @brief  Header of the MP Configuration Table, the entries follow.
+ */
+struct mp_conf {
+	char	signature[4];	/**< "PCMP" */
+	u16	length;		/**< Of the header and the entries */
+	u8	spec_rev;
+	u8	checksum;
+	char	oem[8];
+	char	product[12];
+	u32	oem_table;
+	u16	oem_length;
+	u16	nr_entries;
+	u32	lapic;		/**< Phys addr of the local APICs */
+	u16	ext_length;
+	u8	ext_checksum;
+	u8	reserved;
+};
+
+/* types of MP configuration table entries, the 1st byte of each */
+#define	MP_PROCESSOR		0	/* 20 bytes, the others are 8 */
+#define	MP_BUS			1
+#define	MP_IOAPIC		2
+#define	MP_IOINTR		3
+#define	MP_LINTR		4
+
+/**
+ * @struct mp_proc
+ * @brief  Processor entry.
+ */
+struct mp_proc {
+	u8	type;		/**< MP_PROCESSOR */
+	u8	apic_id;
+	u8	apic_ver;
+	u8	flags;		/**< MP_CPU_ENABLED, MP_CPU_BSP */
+	u32	signature;
+	u32	features;
+	u32	reserved[2];
+};
+#define	MP_CPU_ENABLED		1
+#define	MP_CPU_BSP		2
+
+/**
+ * @struct mp_bus
+ * @brief  Bus entry.
+ */
+struct mp_bus {
+	u8	type;		/**< MP_BUS */
+	u8	bus_id;
+	char	bus_type[6];	/**< "ISA   ", "PCI   ", ... */
+};
+
+/**
+ * @struct mp_ioapic
+ * @brief  I/O APIC entry.
+ */
+struct mp_ioapic {
+	u8	type;		/**< MP_IOAPIC */
+	u8	apic_id;
+	u8	apic_ver;
+	u8	flags;		/**< bit 0: enabled */
+	u32	addr;		/**< Phys addr of the I/O APIC */
+};
+
+/**
+ * @struct mp_iointr
+ * @brief  I/O interrupt assignment entry: which I/O APIC pin a bus IRQ is
+ *         wired to.
+ */
+struct mp_iointr {
+	u8	type;		/**< MP_IOINTR */
+	u8	intr_type;	/**< MP_INTR_INT for an ordinary one */
+	u16	flags;		/**< polarity & trigger mode */
+	u8	src_bus;
+	u8	src_irq;
+	u8	dst_apic;
+	u8	dst_pin;
+};
+#define	MP_INTR_INT		0
+
+/**
+ * @struct cpu
+ * @brief  A processor, and what used to be single in the kernel: the proc
+ *         it runs, k_reenter, the kernel stack, the softirqs raised, the
+ *         IRQ-off timing and the TSS.
+ *
+ * kernel.asm finds the one it runs on by the TSS it has loaded (str), the
+ * members up to tss are reached from there: CPU_* in sconst.inc.
+ */
+struct cpu {
+	struct proc *	proc;		/**< p_proc_ready of this processor,
+					 *   0: none, an AP halts */
+	int		reenter;	/**< k_reenter of this processor */
+	u32		stack_top;	/**< Its kernel stack */
+	u32		softirq_pending;/**< Bit n: softirq n is raised */
+	u64		irqoff_since;	/**< TSC when interrupts went off,
+					 *   0: not timing */
+	u32		irqoff_max;	/**< Longest stretch with interrupts
+					 *   off, in TSC cycles */
+	u32		irqoff_where;	/**< Where the longest one ended */
+	struct tss	tss;		/**< Loaded as INDEX_TSS + its index */
+	int		apic_id;	/**< Local APIC ID */
+	int		bsp;		/**< Non-zero for the one that booted,
+					 *   cpu_table[0] */
+	volatile int	online;		/**< Set by the AP itself in ap_main() */
+};
+
+/* smp.c */
+extern	struct cpu	cpu_table[];
+extern	int		nr_aps;		/* APs running procs */
+extern	u32		lapic_addr;	/* 0: no local APIC */
+extern	u32		ioapic_addr;	/* 0: no I/O APIC */
+extern	u8		isa_irq_pin[];	/* I/O APIC pin of each ISA IRQ */
+extern	int		imcr_present;
+
+#define	lapic_read(reg)		(*(volatile u32 *)(lapic_addr + (reg)))
+#define	lapic_write(reg, v)	(*(volatile u32 *)(lapic_addr + (reg)) = (v))
+
+#endif /* _ORANGES_SMP_H_ */
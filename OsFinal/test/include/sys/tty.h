@@ -9,8 +9,8 @@
 #define _ORANGES_TTY_H_
 
 
-#define TTY_IN_BYTES		256	/* tty input queue size */
-#define TTY_OUT_BUF_LEN		2	/* tty output buffer size */
+#define TTY_IN_BYTES		1024	/* tty input queue size */
+#define TTY_LINE_LEN		256	/* max line in canonical mode */
 
 struct s_tty;
 struct s_console;
@@ -18,9 +18,9 @@ struct s_console;
 /* TTY */
 typedef struct s_tty
 {
-	u32	ibuf[TTY_IN_BYTES];	/* TTY input buffer */
-	u32*	ibuf_head;		/* the next free slot */
-	u32*	ibuf_tail;		/* the val to be processed by TTY */
+	char	ibuf[TTY_IN_BYTES];	/* TTY input buffer */
+	char*	ibuf_head;		/* the next free slot */
+	char*	ibuf_tail;		/* the val to be processed by TTY */
 	int	ibuf_cnt;		/* how many */
 
 	int	tty_caller;
@@ -29,6 +29,14 @@ typedef struct s_tty
 	int	tty_left_cnt;
 	int	tty_trans_cnt;
 
+	/* line discipline, see tcsetattr() */
+	int	tty_lflag;		/* ICANON, ECHO */
+	int	tty_vmin;		/* raw: min chars for a read */
+	int	tty_vtime;		/* raw: timeout of a read, 1/10 s */
+	int	tty_expire;		/* raw: when the read times out, ticks */
+	char	tty_line[TTY_LINE_LEN];	/* canonical: the line being edited */
+	int	tty_line_len;
+
 	struct s_console *	console;
 }TTY;
 
@@ -22,6 +22,7 @@ typedef	char *			va_list;
 typedef	void	(*int_handler)	();
 typedef	void	(*task_f)	();
 typedef	void	(*irq_handler)	(int irq);
+typedef	void	(*softirq_handler)	();
 
 typedef void*	system_call;
 
@@ -65,6 +66,7 @@ typedef struct {
 struct boot_params {
 	int		mem_size;	/* memory size */
 	unsigned char *	kernel_file;	/* addr of kernel file */
+	int		hz;		/* clock ticks per second, 0: default */
 };
 
 
@@ -0,0 +1,237 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   apic.c
+ * @brief  Take interrupts through the local APIC and the I/O APIC.
+ *
+ * If the MP table has shown an I/O APIC, init_apic() masks the 8259A and
+ * routes the ISA IRQs through the I/O APIC to the BSP, with the same vectors
+ * the 8259A used, so hwint00~hwint15 and irq_table[] stay as they are. The
+ * tick comes from the local APIC timer of the BSP instead of the PIT; it
+ * still arrives on the vector of CLOCK_IRQ, and the BSP still passes it on
+ * to the APs (tick_aps()).
+ *
+ * In this mode (apic_mode), an interrupt is ended by a write to the EOI
+ * register of the local APIC (lapic_eoi) after the handler, and
+ * enable_irq()/disable_irq() end up here instead of at the 8259A ports.
+ * Without an I/O APIC nothing changes: the 8259A and the PIT are used.
+ *
+ * @author Forrest Y. Yu
+ * @date   2008
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "smp.h"
+#include "proto.h"
+
+PRIVATE u32	bsp_apic_id;	/* where the I/O APIC sends the IRQs */
+
+PRIVATE void	lapic_calibrate();
+PRIVATE u32	ioapic_read(int reg);
+PRIVATE void	ioapic_write(int reg, u32 v);
+
+
+/*****************************************************************************
+ *                                init_apic
+ *****************************************************************************/
+/**
+ * <Ring 0> Switch from the 8259A to the APICs, if there is an I/O APIC.
+ *
+ * Called after init_clock() and init_smp(), with interrupts disabled. The
+ * IRQs enabled at the 8259A so far are enabled at the I/O APIC, CLOCK_IRQ
+ * being the local APIC timer.
+ *****************************************************************************/
+PUBLIC void init_apic()
+{
+	if (!lapic_addr || !ioapic_addr)
+		return;
+
+	/* PIC mode: the 8259A is wired to the BSP, take it off */
+	if (imcr_present) {
+		out_byte(IMCR_ADDR, IMCR_SELECT);
+		out_byte(IMCR_DATA, IMCR_APIC);
+	}
+
+	bsp_apic_id = lapic_read(LAPIC_ID) >> 24;
+
+	lapic_write(LAPIC_SVR, SVR_ENABLE | INT_VECTOR_SPURIOUS);
+	lapic_write(LAPIC_TPR, 0);
+	lapic_write(LAPIC_LVT_LINT0, LVT_MASKED);
+
+	lapic_calibrate();
+	lapic_write(LAPIC_LVT_TIMER, LVT_MASKED | (INT_VECTOR_IRQ0 + CLOCK_IRQ));
+	lapic_timer(1, lapic_tick_count);
+
+	int nr_pins = ((ioapic_read(IOAPIC_VER) >> 16) & 0xFF) + 1;
+	int i;
+	for (i = 0; i < nr_pins; i++)
+		ioapic_write(IOAPIC_REDTBL(i), REDTBL_MASKED);
+
+	u16 pic_mask = in_byte(INT_M_CTLMASK) | (in_byte(INT_S_CTLMASK) << 8);
+	out_byte(INT_M_CTLMASK, 0xFF);
+	out_byte(INT_S_CTLMASK, 0xFF);
+
+	lapic_eoi = lapic_addr + LAPIC_EOI;
+	apic_mode = 1;
+
+	for (i = 0; i < NR_IRQ; i++)
+		if (!(pic_mask & (1 << i)))
+			ioapic_enable_irq(i);
+}
+
+
+/*****************************************************************************
+ *                                ioapic_enable_irq
+ *****************************************************************************/
+/**
+ * <Ring 0> enable_irq() in apic_mode: point the I/O APIC pin of an ISA IRQ
+ * at the BSP, edge triggered and active high as ISA is. Interrupts must be
+ * disabled.
+ *
+ * @param irq  The IRQ. CLOCK_IRQ is the local APIC timer, CASCADE_IRQ means
+ *             nothing without the 8259A.
+ *****************************************************************************/
+PUBLIC void ioapic_enable_irq(int irq)
+{
+	if (irq == CLOCK_IRQ) {
+		lapic_write(LAPIC_LVT_TIMER,
+			    lapic_read(LAPIC_LVT_TIMER) & ~LVT_MASKED);
+		return;
+	}
+	if (irq == CASCADE_IRQ)
+		return;
+
+	int pin = isa_irq_pin[irq];
+	ioapic_write(IOAPIC_REDTBL(pin) + 1, bsp_apic_id << 24);
+	ioapic_write(IOAPIC_REDTBL(pin), INT_VECTOR_IRQ0 + irq);
+}
+
+
+/*****************************************************************************
+ *                                ioapic_disable_irq
+ *****************************************************************************/
+/**
+ * <Ring 0> disable_irq() in apic_mode. Interrupts must be disabled.
+ *
+ * @param irq  The IRQ.
+ *
+ * @return 1 if it is disabled by this call, 0 if it was already.
+ *****************************************************************************/
+PUBLIC int ioapic_disable_irq(int irq)
+{
+	if (irq == CLOCK_IRQ) {
+		u32 lvt = lapic_read(LAPIC_LVT_TIMER);
+		if (lvt & LVT_MASKED)
+			return 0;
+		lapic_write(LAPIC_LVT_TIMER, lvt | LVT_MASKED);
+		return 1;
+	}
+	if (irq == CASCADE_IRQ)
+		return 0;
+
+	int reg = IOAPIC_REDTBL(isa_irq_pin[irq]);
+	u32 entry = ioapic_read(reg);
+	if (entry & REDTBL_MASKED)
+		return 0;
+	ioapic_write(reg, entry | REDTBL_MASKED);
+	return 1;
+}
+
+
+/*****************************************************************************
+ *                                lapic_timer
+ *****************************************************************************/
+/**
+ * <Ring 0> (Re)start the local APIC timer, leaving it masked or not.
+ *
+ * @param periodic  Non-zero: go off every `count', otherwise once.
+ * @param count     In timer counts, lapic_tick_count a tick.
+ *****************************************************************************/
+PUBLIC void lapic_timer(int periodic, u32 count)
+{
+	u32 lvt = (lapic_read(LAPIC_LVT_TIMER) & LVT_MASKED) |
+		  (INT_VECTOR_IRQ0 + CLOCK_IRQ);
+	if (periodic)
+		lvt |= LVT_PERIODIC;
+
+	lapic_write(LAPIC_LVT_TIMER, lvt);
+	lapic_write(LAPIC_TIMER_INIT, count);
+}
+
+
+/*****************************************************************************
+ *                                lapic_timer_left
+ *****************************************************************************/
+/**
+ * <Ring 0> How far the local APIC timer is from going off.
+ *
+ * @return Timer counts, 0 if a one-shot has gone off.
+ *****************************************************************************/
+PUBLIC u32 lapic_timer_left()
+{
+	return lapic_read(LAPIC_TIMER_CUR);
+}
+
+
+/*****************************************************************************
+ *                                lapic_calibrate
+ *****************************************************************************/
+/**
+ * <Ring 0> Let the local APIC timer count down, masked, for TSC_CALIBRATE_MS
+ * by the TSC, and work out lapic_tick_count from it.
+ *****************************************************************************/
+PRIVATE void lapic_calibrate()
+{
+	lapic_write(LAPIC_TIMER_DIV, TIMER_DIV_16);
+	lapic_write(LAPIC_LVT_TIMER, LVT_MASKED);
+	lapic_write(LAPIC_TIMER_INIT, 0xFFFFFFFF);
+
+	udelay(TSC_CALIBRATE_MS * 1000);
+
+	u32 counts = 0xFFFFFFFF - lapic_read(LAPIC_TIMER_CUR);
+	lapic_write(LAPIC_TIMER_INIT, 0);
+
+	lapic_tick_count = max(counts / TSC_CALIBRATE_MS * 1000 / system_hz, 1);
+}
+
+
+/*****************************************************************************
+ *                                ioapic_read
+ *****************************************************************************/
+/**
+ * <Ring 0> Read an I/O APIC register.
+ *
+ * @param reg  The register.
+ *
+ * @return Its value.
+ *****************************************************************************/
+PRIVATE u32 ioapic_read(int reg)
+{
+	*(volatile u32 *)(ioapic_addr + IOAPIC_REGSEL) = reg;
+	return *(volatile u32 *)(ioapic_addr + IOAPIC_WIN);
+}
+
+
+/*****************************************************************************
+ *                                ioapic_write
+ *****************************************************************************/
+/**
+ * <Ring 0> Write an I/O APIC register.
+ *
+ * @param reg  The register.
+ * @param v    The value.
+ *****************************************************************************/
+PRIVATE void ioapic_write(int reg, u32 v)
+{
+	*(volatile u32 *)(ioapic_addr + IOAPIC_REGSEL) = reg;
+	*(volatile u32 *)(ioapic_addr + IOAPIC_WIN) = v;
+}
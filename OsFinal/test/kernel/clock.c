@@ -17,72 +17,512 @@
 #include "tty.h"
 #include "console.h"
 #include "global.h"
+#include "smp.h"
 #include "proto.h"
 
+#define LATCH		(TIMER_FREQ / system_hz)	/* PIT counts per tick */
+#define TICK_COUNT	(apic_mode ? lapic_tick_count : LATCH)	/* the timer's */
+#define MAX_IDLE_TICKS	((apic_mode ? 0x7FFFFFFF : 0xFFFF) / TICK_COUNT)
+#define TSC_SHIFT	22	/* ns = cycles * tsc_mult >> TSC_SHIFT */
+
+PRIVATE int	idle_ticks;	/* ticks the one-shot covers, 0: periodic */
+PRIVATE u32	idle_count;	/* timer counts the one-shot was loaded with */
+
+PRIVATE u32	tsc_mult;
+PRIVATE u64	mono_ns;	/* ns since boot at mono_tsc */
+PRIVATE u64	mono_tsc;	/* TSC when mono_ns was brought up to date */
+
+PRIVATE void set_periodic();
+PRIVATE void set_one_shot(u32 count);
+PRIVATE u32  timer_left();
+PRIVATE int  clock_pending();
+PRIVATE void add_ticks(int n);
+PRIVATE void charge_ticks(int n);
+PRIVATE void count_down(int * countdown, int n, int task);
+PRIVATE void calibrate_tsc();
+PRIVATE u64  read_tsc();
+PRIVATE u64  mono_now();
 
 /*****************************************************************************
  *                                clock_handler
  *****************************************************************************/
 /**
  * <Ring 0> This routine handles the clock interrupt generated by 8253/8254
- *          programmable interval timer.
+ *          programmable interval timer, or by the local APIC timer in
+ *          apic_mode.
+ *
+ * If the interrupt ends a one-shot of an idle CPU, all the ticks it covered
+ * are accounted at once and the timer goes back to the periodic mode.
+ *
+ * It comes to the BSP only, which passes it on to the APs. Waking tasks
+ * up and schedule() are left to softirqs.
  * 
  * @param irq The IRQ nr, unused here.
  *****************************************************************************/
 PUBLIC void clock_handler(int irq)
 {
-	if (++ticks >= MAX_TICKS)
-		ticks = 0;
+	int n = 1;
 
-	if (p_proc_ready->ticks)
-		p_proc_ready->ticks--;
+	if (idle_ticks) {
+		n = idle_ticks;
+		idle_ticks = 0;
+		set_periodic();
+	}
 
-	if (key_pressed)
-		inform_int(TASK_TTY);
+	add_ticks(n);
+	tick_aps();
+	charge_ticks(n);
+}
 
-	if (k_reenter != 0) {
-		return;
+/*****************************************************************************
+ *                                ap_clock_handler
+ *****************************************************************************/
+/**
+ * <Ring 0> A tick passed on by the BSP (tick_aps()) has come to an AP.
+ * `ticks' and the countdowns are kept by the BSP's clock_handler(); an AP
+ * only charges the tick to its proc and schedules when it is time.
+ *****************************************************************************/
+PUBLIC void ap_clock_handler()
+{
+	charge_ticks(1);
+}
+
+/*****************************************************************************
+ *                                charge_ticks
+ *****************************************************************************/
+/**
+ * <Ring 0> Charge some ticks to the proc this processor runs, and have it
+ * schedule (SOFTIRQ_SCHED) if it is time to. An AP running none looks for
+ * one every tick.
+ * 
+ * @param n  How many ticks.
+ *****************************************************************************/
+PRIVATE void charge_ticks(int n)
+{
+	struct proc * p = this_cpu()->proc;
+
+	if (p) {
+		p->p_runtime += n;
+		if (schedule_flag == STRIDE_SCHEDULE)
+			stride_tick(p);
+
+		if (p->ticks)
+			p->ticks--;
 	}
 
-	if (p_proc_ready->ticks > 0) {
+	if (p && p->ticks > 0 && schedule_flag != MLFQ_SCHEDULE &&
+	    schedule_flag != STRIDE_SCHEDULE) {
 		return;
 	}
 
+	raise_softirq(SOFTIRQ_SCHED);
+}
+
+/*****************************************************************************
+ *                                clock_idle
+ *****************************************************************************/
+/**
+ * <Ring 0> Going idle: stop the periodic tick and program a one-shot that
+ * goes off when the next countdown (tty_countdown, sys_countdown,
+ * journal_countdown) runs out. The counter of the timer caps it at
+ * MAX_IDLE_TICKS ticks: a few with the 16-bit PIT, many with the local APIC.
+ *
+ * Not while APs run procs: their ticks come from this one (tick_aps()), and
+ * `ticks' must go on for them.
+ *
+ * Interrupts must be disabled.
+ *****************************************************************************/
+PUBLIC void clock_idle()
+{
+	if (idle_ticks)		/* clock_wake() has left a one-shot running */
+		return;
+
+	if (nr_aps)
+		return;
+
+	int n = MAX_IDLE_TICKS;
+
+	if (tty_countdown)
+		n = min(n, tty_countdown);
+	if (sys_countdown)
+		n = min(n, sys_countdown);
+	if (journal_countdown)
+		n = min(n, journal_countdown);
+
+	if (n <= 1)	/* the periodic tick does as well */
+		return;
+
+	idle_ticks = n;
+	idle_count = n * TICK_COUNT;
+	set_one_shot(idle_count);
+}
+
+/*****************************************************************************
+ *                                clock_wake
+ *****************************************************************************/
+/**
+ * <Ring 0> Something other than the one-shot has woken the idle CPU up:
+ * account the whole ticks gone by, and reload the timer with what is left of
+ * the current tick only, as a one-shot of 1 tick. The part of the tick that
+ * has passed is kept this way; clock_handler() accounts the tick when it
+ * ends and goes back to the periodic mode.
+ *
+ * Interrupts must be disabled.
+ *****************************************************************************/
+PUBLIC void clock_wake()
+{
+	if (!idle_ticks)	/* the one-shot has gone off */
+		return;
+
+	u32 left = timer_left();
+
+	/*
+	 * It has gone off (the PIT goes on counting from 0xFFFF, the local
+	 * APIC timer stops at 0), the interrupt is pending and
+	 * clock_handler() will account it all.
+	 */
+	if (clock_pending() || left == 0 || left > idle_count)
+		return;
+
+	/* ticks not over yet, the current one included */
+	int to_go = (left - 1) / TICK_COUNT + 1;
+	add_ticks(idle_ticks - to_go);
+
+	idle_ticks = 1;
+	idle_count = left - (to_go - 1) * TICK_COUNT;
+	set_one_shot(idle_count);
+}
+
+/*****************************************************************************
+ *                                sys_halt
+ *****************************************************************************/
+/**
+ * <Ring 0> The core routine of system call `halt()'. Stop the CPU until an
+ * interrupt makes some proc runnable. Only IDLE may call it, other procs
+ * get -1.
+ *
+ * hlt is a ring 0 instruction, that's why IDLE halts through a syscall.
+ * The BKL is let go while the CPU halts, for the APs; the interrupt that
+ * wakes it up takes the BKL back (see kernel.asm::save).
+ * 
+ * @param p  The caller proc.
+ * 
+ * @return Zero if success.
+ *****************************************************************************/
+PUBLIC int sys_halt(int _unused1, int _unused2, int _unused3, struct proc * p)
+{
+	if (p != &proc_table[IDLE])
+		return -1;
+
+	/* nothing may be left in softirqs when the CPU halts */
+	disable_int();
+	do_softirq();
 	schedule();
+	if (this_cpu()->proc == p) {
+		clock_idle();
+		unlock_kernel();
+		irqoff_end();
+		__asm__ __volatile__("sti\n\thlt");
+		disable_int();
+		lock_kernel();	/* if it was not the interrupt that woke it */
+		clock_wake();
+		do_softirq();
+		schedule();
+	}
+	enable_int();
+
+	return 0;
+}
+
+/*****************************************************************************
+ *                                sys_clock_gettime
+ *****************************************************************************/
+/**
+ * <Ring 0> The core routine of system call `clock_gettime()'.
+ * 
+ * @param clock_id  Only CLOCK_MONOTONIC is known.
+ * @param tp        Where the time goes, in the caller's address space.
+ * @param _unused3
+ * @param p         The caller proc.
+ * 
+ * @return Zero if success, -1 if the clock is unknown.
+ *****************************************************************************/
+PUBLIC int sys_clock_gettime(int clock_id, struct timespec * tp,
+			     int _unused3, struct proc * p)
+{
+	if (clock_id != CLOCK_MONOTONIC)
+		return -1;
+
+	disable_int();
+	u64 ns = mono_now();
+	enable_int();
+
+	/* split it without a 64-bit division, which would need libgcc */
+	struct timespec ts;
+	ts.tv_sec = 0;
+	while (ns >= 1000000000ULL * 64) {
+		ns -= 1000000000ULL * 64;
+		ts.tv_sec += 64;
+	}
+	while (ns >= 1000000000ULL) {
+		ns -= 1000000000ULL;
+		ts.tv_sec++;
+	}
+	ts.tv_nsec = (int)ns;
+
+	phys_copy(va2la(proc2pid(p), tp), &ts, sizeof(ts));
+
+	return 0;
+}
 
+/*****************************************************************************
+ *                                udelay
+ *****************************************************************************/
+/**
+ * <Ring 0> Spin for some microseconds, by the TSC. For the short waits
+ * hardware asks for before there are procs to switch to.
+ * 
+ * @param usec  How many microseconds.
+ *****************************************************************************/
+PUBLIC void udelay(int usec)
+{
+	u32 cycles = usec * (tsc_khz / 1000 + 1);
+	u64 t0 = read_tsc();
+
+	while ((u32)(read_tsc() - t0) < cycles) {}
 }
 
 /*****************************************************************************
  *                                milli_delay
  *****************************************************************************/
 /**
- * <Ring 1~3> Delay for a specified amount of time.
+ * <Ring 1~3> Delay for a specified amount of time. The caller is blocked
+ * by TASK SYS meanwhile, so TASK SYS itself must not call it.
  * 
  * @param milli_sec How many milliseconds to delay.
  *****************************************************************************/
 PUBLIC void milli_delay(int milli_sec)
 {
-        int t = get_ticks();
-
-        while(((get_ticks() - t) * 1000 / HZ) < milli_sec) {}
+	sleep_ms(milli_sec);
 }
 
 /*****************************************************************************
  *                                init_clock
  *****************************************************************************/
 /**
- * <Ring 0> Initialize 8253/8254 PIT (Programmable Interval Timer).
+ * <Ring 0> Initialize 8253/8254 PIT (Programmable Interval Timer) to the
+ * rate given by the loader, and calibrate the TSC against it. init_apic()
+ * may move the tick to the local APIC timer later.
  * 
  *****************************************************************************/
 PUBLIC void init_clock()
 {
+	struct boot_params bp;
+	get_boot_params(&bp);
+	system_hz = (bp.hz >= MIN_HZ && bp.hz <= MAX_HZ) ? bp.hz : DEFAULT_HZ;
+
+	calibrate_tsc();
+
         /* 初始化 8253 PIT */
-        out_byte(TIMER_MODE, RATE_GENERATOR);
-        out_byte(TIMER0, (u8) (TIMER_FREQ/HZ) );
-        out_byte(TIMER0, (u8) ((TIMER_FREQ/HZ) >> 8));
+        set_periodic();
 
         put_irq_handler(CLOCK_IRQ, clock_handler);    /* 设定时钟中断处理程序 */
         enable_irq(CLOCK_IRQ);                        /* 让8259A可以接收时钟中断 */
 }
 
+/*****************************************************************************
+ *                                set_periodic
+ *****************************************************************************/
+/**
+ * <Ring 0> Program the timer to interrupt system_hz times a second.
+ * 
+ *****************************************************************************/
+PRIVATE void set_periodic()
+{
+	if (apic_mode) {
+		lapic_timer(1, lapic_tick_count);
+		return;
+	}
+	out_byte(TIMER_MODE, RATE_GENERATOR);
+	out_byte(TIMER0, (u8) LATCH);
+	out_byte(TIMER0, (u8) (LATCH >> 8));
+}
+
+/*****************************************************************************
+ *                                set_one_shot
+ *****************************************************************************/
+/**
+ * <Ring 0> Program the timer to interrupt once.
+ * 
+ * @param count  In timer counts.
+ *****************************************************************************/
+PRIVATE void set_one_shot(u32 count)
+{
+	if (apic_mode) {
+		lapic_timer(0, count);
+		return;
+	}
+	out_byte(TIMER_MODE, ONE_SHOT);
+	out_byte(TIMER0, (u8) count);
+	out_byte(TIMER0, (u8) (count >> 8));
+}
+
+/*****************************************************************************
+ *                                timer_left
+ *****************************************************************************/
+/**
+ * <Ring 0> How far the timer is from going off.
+ * 
+ * @return In timer counts.
+ *****************************************************************************/
+PRIVATE u32 timer_left()
+{
+	if (apic_mode)
+		return lapic_timer_left();
+
+	out_byte(TIMER_MODE, LATCH_COUNT0);
+	u32 left = in_byte(TIMER0);
+	left |= in_byte(TIMER0) << 8;
+	return left;
+}
+
+/*****************************************************************************
+ *                                clock_pending
+ *****************************************************************************/
+/**
+ * <Ring 0> Has the timer interrupt come and not been served yet? It waits
+ * in the IRR of the master 8259A, or of the local APIC in apic_mode, while
+ * interrupts are off.
+ * 
+ * @return Non-zero if it is pending.
+ *****************************************************************************/
+PRIVATE int clock_pending()
+{
+	if (apic_mode) {
+		int vector = INT_VECTOR_IRQ0 + CLOCK_IRQ;
+		return lapic_read(LAPIC_IRR(vector)) & (1 << (vector % 32));
+	}
+
+	out_byte(INT_M_CTL, READ_IRR);
+	return in_byte(INT_M_CTL) & (1 << CLOCK_IRQ);
+}
+
+/*****************************************************************************
+ *                                add_ticks
+ *****************************************************************************/
+/**
+ * <Ring 0> Let some ticks go by: advance `ticks' and the countdowns, and wake
+ * up the task whose countdown runs out.
+ * 
+ * @param n  How many ticks.
+ *****************************************************************************/
+PRIVATE void add_ticks(int n)
+{
+	ticks += n;
+	if (ticks >= MAX_TICKS)
+		ticks -= MAX_TICKS;
+
+	mono_ns = mono_now();	/* keep the TSC delta small */
+	mono_tsc = read_tsc();
+
+	count_down(&tty_countdown, n, TASK_TTY);
+	count_down(&sys_countdown, n, TASK_SYS);
+	count_down(&journal_countdown, n, TASK_FS);
+}
+
+/*****************************************************************************
+ *                                count_down
+ *****************************************************************************/
+/**
+ * <Ring 0> Count a countdown down by some ticks, if it is running.
+ * 
+ * @param countdown  The countdown.
+ * @param n          How many ticks.
+ * @param task       Who is informed (by a softirq) when it runs out.
+ *****************************************************************************/
+PRIVATE void count_down(int * countdown, int n, int task)
+{
+	if (!*countdown)
+		return;
+
+	*countdown -= min(n, *countdown);
+	if (*countdown == 0)
+		defer_inform(task);
+}
+
+/*****************************************************************************
+ *                                calibrate_tsc
+ *****************************************************************************/
+/**
+ * <Ring 0> Count TSC cycles while PIT channel 2 counts TSC_CALIBRATE_MS
+ * down, and work out tsc_mult from them.
+ * 
+ *****************************************************************************/
+PRIVATE void calibrate_tsc()
+{
+	int count = TIMER_FREQ * TSC_CALIBRATE_MS / 1000;
+
+	/* gate channel 2 on, keep the speaker off */
+	out_byte(PORT_B, (in_byte(PORT_B) & ~PORT_B_SPKR) | PORT_B_GATE2);
+
+	out_byte(TIMER_MODE, ONE_SHOT2);
+	out_byte(TIMER2, (u8) count);
+	out_byte(TIMER2, (u8) (count >> 8));
+
+	u64 t0 = read_tsc();
+	while (!(in_byte(PORT_B) & PORT_B_OUT2)) {}
+	u32 cycles = (u32)(read_tsc() - t0);
+
+	out_byte(PORT_B, in_byte(PORT_B) & ~PORT_B_GATE2);
+
+	tsc_khz = max(cycles / TSC_CALIBRATE_MS, 1);
+
+	/**
+	 * tsc_mult = (1000000 << TSC_SHIFT) / tsc_khz, by long division:
+	 * the dividend does not fit in 32 bits.
+	 */
+	u64 rem = 0;
+	int i;
+	tsc_mult = 0;
+	for (i = 63; i >= 0; i--) {
+		rem = (rem << 1) |
+		      ((((u64)1000000 << TSC_SHIFT) >> i) & 1);
+		tsc_mult <<= 1;
+		if (rem >= tsc_khz) {
+			rem -= tsc_khz;
+			tsc_mult |= 1;
+		}
+	}
+
+	mono_ns = 0;
+	mono_tsc = read_tsc();
+}
+
+/*****************************************************************************
+ *                                read_tsc
+ *****************************************************************************/
+/**
+ * <Ring 0~3> Read the Time Stamp Counter.
+ * 
+ * @return The TSC.
+ *****************************************************************************/
+PRIVATE u64 read_tsc()
+{
+	u64 t;
+	__asm__ __volatile__("rdtsc" : "=A" (t));
+	return t;
+}
 
+/*****************************************************************************
+ *                                mono_now
+ *****************************************************************************/
+/**
+ * <Ring 0> Nanoseconds since the TSC was calibrated. Interrupts must be
+ * disabled.
+ * 
+ * @return The time.
+ *****************************************************************************/
+PRIVATE u64 mono_now()
+{
+	return mono_ns + (((read_tsc() - mono_tsc) * tsc_mult) >> TSC_SHIFT);
+}
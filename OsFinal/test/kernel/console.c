@@ -2,12 +2,22 @@
  *****************************************************************************
  * @file   console.c
  * @brief  Manipulate the console.
+ *
+ * Each console keeps its text in RAM: CONSOLE_LINES lines used as a ring,
+ * the screen being the last SCR_LINES of them. Lines are numbered from 0
+ * as they are printed, so a position (line * SCR_WIDTH + column) never has
+ * to be moved, and scrolling is just a change of CONSOLE::scr_top.
+ *
+ * The video memory shows one screen: render_screen() copies the window of
+ * the current console that is to be seen into it, writing only the cells
+ * that differ from what it already holds.
  * @author Forrest Y. Yu
  * @date   2005
  *****************************************************************************
  *****************************************************************************/
 
 #include "type.h"
+#include "config.h"
 #include "stdio.h"
 #include "const.h"
 #include "protect.h"
@@ -20,14 +30,33 @@
 #include "keyboard.h"
 #include "proto.h"
 
-/* #define __TTY_DEBUG__ */
-
 /* local routines */
 PRIVATE void	set_cursor(unsigned int position);
 PRIVATE void	set_video_start_addr(u32 addr);
-PRIVATE void	flush(CONSOLE* con);
-PRIVATE	void	w_copy(unsigned int dst, const unsigned int src, int size);
-PUBLIC void	clear_screen(int pos, int len);
+PRIVATE void	put_char(CONSOLE* con, char ch);
+PRIVATE void	do_escape(CONSOLE* con, char cmd);
+PRIVATE void	set_attr(CONSOLE* con);
+PRIVATE void	fit_cursor(CONSOLE* con);
+PRIVATE void	do_scroll(CONSOLE* con, int dir);
+PRIVATE void	damage(CONSOLE* con, unsigned int pos, int len);
+PRIVATE void	clear_screen(CONSOLE* con, unsigned int pos, int len);
+
+#define CON_CELLS	(CONSOLE_LINES * SCR_WIDTH)	/* cells per console */
+#define CELL(con, pos)	((con)->text[(pos) % CON_CELLS])
+
+/**
+ * What the video memory holds, so that it never has to be read back: the
+ * window of shown_con from line shown_view on.
+ */
+PRIVATE u16		vshown[SCR_SIZE];
+PRIVATE CONSOLE *	shown_con;
+PRIVATE unsigned int	shown_view;
+PRIVATE unsigned int	shown_cursor = -1;
+PRIVATE int		last_render = -1;	/* ticks */
+
+/* ANSI color nr -> VGA color */
+PRIVATE u8	ansi_color[8] = {BLACK, RED, GREEN, RED | GREEN,
+				 BLUE, RED | BLUE, GREEN | BLUE, WHITE};
 
 /*****************************************************************************
  *                                init_screen
@@ -40,23 +69,40 @@ PUBLIC void	clear_screen(int pos, int len);
 PUBLIC void init_screen(TTY* tty)
 {
 	int nr_tty = tty - tty_table;
-	tty->console = console_table + nr_tty;
+	CONSOLE * con = console_table + nr_tty;
+	tty->console = con;
+
+	assert(CONSOLE_LINES >= SCR_LINES);
+	assert(NR_CONSOLES * CON_CELLS * 2 <= CON_TEXT_SIZE);
 
 	/* 
 	 * NOTE:
 	 *   variables related to `position' and `size' below are
 	 *   in WORDs, but not in BYTEs.
 	 */
-	int v_mem_size = V_MEM_SIZE >> 1; /* size of Video Memory */
-	int size_per_con = v_mem_size / NR_CONSOLES;
-	tty->console->orig = nr_tty * size_per_con;
-	tty->console->con_size = size_per_con / SCR_WIDTH * SCR_WIDTH;
-	tty->console->cursor = tty->console->crtc_start = tty->console->orig;
-	tty->console->is_full = 0;
+	con->text = con_text + nr_tty * CON_CELLS;
+	con->cursor = 0;
+	con->scr_top = con->view_top = 0;
+	con->dirty_lo = -1;
+	con->dirty_hi = 0;
+
+	con->esc_state = ESC_NONE;
+	con->attr = DEFAULT_CHAR_COLOR;
+	con->saved_x = con->saved_y = 0;
+
+	clear_screen(con, 0, SCR_SIZE);
 
 	if (nr_tty == 0) {
-		tty->console->cursor = disp_pos / 2;
+		/* take over what the kernel has printed on the screen */
+		int len = min(disp_pos / 2, SCR_SIZE - 1);
+		phys_copy(con->text, (void*)V_MEM_BASE, len * 2);
+		con->cursor = len;
 		disp_pos = 0;
+
+		phys_copy(vshown, (void*)V_MEM_BASE, SCR_SIZE * 2);
+		shown_con = con;
+		shown_view = 0;
+		set_video_start_addr(0);
 	}
 	else {
 		/* 
@@ -66,10 +112,8 @@ PUBLIC void init_screen(TTY* tty)
 
 		const char * p = prompt;
 		for (; *p; p++)
-			out_char(tty->console, *p == '?' ? nr_tty + '0' : *p);
+			out_char(con, *p == '?' ? nr_tty + '0' : *p);
 	}
-
-	set_cursor(tty->console->cursor);
 }
 
 
@@ -84,75 +128,377 @@ PUBLIC void init_screen(TTY* tty)
  *****************************************************************************/
 PUBLIC void out_char(CONSOLE* con, char ch)
 {
-	u8* pch = (u8*)(V_MEM_BASE + con->cursor * 2);
+	put_char(con, ch);
+}
+
+/*****************************************************************************
+ *                                out_string
+ *****************************************************************************/
+/**
+ * Print a span of chars in a certain console.
+ *
+ * Runs of ordinary chars are stored into CONSOLE::text directly, up to the
+ * point where the screen must scroll or the ring wraps. The screen is
+ * brought up to date later by render_screen().
+ * 
+ * @param con  The console to which the chars are printed.
+ * @param s    The chars, need not be 0-terminated.
+ * @param len  How many chars.
+ *****************************************************************************/
+PUBLIC void out_string(CONSOLE* con, const char * s, int len)
+{
+	while (len > 0) {
+		/* chars that fit before the bottom of the screen or ring */
+		int room = 0;
+		if (con->esc_state == ESC_NONE)
+			room = min((con->scr_top + SCR_LINES) * SCR_WIDTH -
+				   con->cursor,
+				   CON_CELLS - con->cursor % CON_CELLS);
+		u16 * pcell = &CELL(con, con->cursor);
+		u16 attr = con->attr << 8;
+		int n = 0;
+
+		while (n < len && n < room && s[n] != '\n' && s[n] != '\b' &&
+		       s[n] != '\r' && s[n] != '\033') {
+			*pcell++ = attr | (u8)s[n++];
+		}
 
-	assert(con->cursor - con->orig < con->con_size);
+		if (n) {
+			damage(con, con->cursor, n);
+			con->cursor += n;
+			fit_cursor(con);
+		}
+		else {
+			put_char(con, *s);
+			n = 1;
+		}
 
-	/*
-	 * calculate the coordinate of cursor in current console (not in
-	 * current screen)
-	 */
-	int cursor_x = (con->cursor - con->orig) % SCR_WIDTH;
-	int cursor_y = (con->cursor - con->orig) / SCR_WIDTH;
+		s += n;
+		len -= n;
+	}
+}
+
+/*****************************************************************************
+ *                                put_char
+ *****************************************************************************/
+/**
+ * Put a char into CONSOLE::text, or take it as part of an escape sequence.
+ *
+ * These ANSI/VT100 sequences are known, the others are swallowed:
+ *   - ESC[nA ESC[nB ESC[nC ESC[nD  cursor up/down/right/left
+ *   - ESC[y;xH ESC[y;xf            cursor to line y, column x (from 1)
+ *   - ESC[nJ ESC[nK                erase (part of) the screen / line
+ *   - ESC[n;...m                   colors and attributes
+ *   - ESC[s ESC[u                  save / restore the cursor
+ * 
+ * @param con  The console to which the char is printed.
+ * @param ch   The char to print.
+ *****************************************************************************/
+PRIVATE void put_char(CONSOLE* con, char ch)
+{
+	if (con->esc_state == ESC_ESC) {
+		if (ch == '[') {
+			con->esc_state = ESC_CSI;
+			con->esc_params[0] = 0;
+			con->esc_nr_params = 1;
+		}
+		else {
+			con->esc_state = ESC_NONE;
+		}
+		return;
+	}
+	if (con->esc_state == ESC_CSI) {
+		int * param = &con->esc_params[con->esc_nr_params - 1];
+		if (ch >= '0' && ch <= '9') {
+			if (*param < 1000)
+				*param = *param * 10 + ch - '0';
+		}
+		else if (ch == ';') {
+			if (con->esc_nr_params < ESC_MAX_PARAMS)
+				con->esc_params[con->esc_nr_params++] = 0;
+		}
+		else {
+			con->esc_state = ESC_NONE;
+			do_escape(con, ch);
+		}
+		return;
+	}
+
+	/* the line of the cursor in the console (not in the screen) */
+	int cursor_y = con->cursor / SCR_WIDTH;
 
 	switch(ch) {
 	case '\n':
-		con->cursor = con->orig + SCR_WIDTH * (cursor_y + 1);
+		con->cursor = SCR_WIDTH * (cursor_y + 1);
+		break;
+	case '\r':
+		con->cursor = SCR_WIDTH * cursor_y;
 		break;
 	case '\b':
-		if (con->cursor > con->orig) {
+		if (con->cursor > con->scr_top * SCR_WIDTH) {
 			con->cursor--;
-			*(pch - 2) = ' ';
-			*(pch - 1) = DEFAULT_CHAR_COLOR;
+			clear_screen(con, con->cursor, 1);
 		}
 		break;
+	case '\033':
+		con->esc_state = ESC_ESC;
+		return;
 	default:
-		*pch++ = ch;
-		*pch++ = DEFAULT_CHAR_COLOR;
+		CELL(con, con->cursor) = (con->attr << 8) | (u8)ch;
+		damage(con, con->cursor, 1);
 		con->cursor++;
 		break;
 	}
 
-	if (con->cursor - con->orig >= con->con_size) {
-		cursor_x = (con->cursor - con->orig) % SCR_WIDTH;
-		cursor_y = (con->cursor - con->orig) / SCR_WIDTH;
-		int cp_orig = con->orig + (cursor_y + 1) * SCR_WIDTH - SCR_SIZE;
-		w_copy(con->orig, cp_orig, SCR_SIZE - SCR_WIDTH);
-		con->crtc_start = con->orig;
-		con->cursor = con->orig + (SCR_SIZE - SCR_WIDTH) + cursor_x;
-		clear_screen(con->cursor, SCR_WIDTH);
-		if (!con->is_full)
-			con->is_full = 1;
+	fit_cursor(con);
+}
+
+/*****************************************************************************
+ *                                do_escape
+ *****************************************************************************/
+/**
+ * Carry out ESC[...cmd. Positions are on the screen, not in the console.
+ * 
+ * @param con  The console.
+ * @param cmd  The final char of the sequence.
+ *****************************************************************************/
+PRIVATE void do_escape(CONSOLE* con, char cmd)
+{
+	int * param = con->esc_params;
+	int n = param[0] ? param[0] : 1;
+
+	fit_cursor(con);	/* the screen may have been scrolled away */
+
+	int top = con->scr_top * SCR_WIDTH;
+	int nr_lines = SCR_LINES;
+	int x = (con->cursor - top) % SCR_WIDTH;
+	int y = (con->cursor - top) / SCR_WIDTH;
+	int line = top + y * SCR_WIDTH;
+
+	switch (cmd) {
+	case 'A':
+		y = max(y - n, 0);
+		break;
+	case 'B':
+		y = min(y + n, nr_lines - 1);
+		break;
+	case 'C':
+		x = min(x + n, SCR_WIDTH - 1);
+		break;
+	case 'D':
+		x = max(x - n, 0);
+		break;
+	case 'H':
+	case 'f':
+		y = min(n, nr_lines) - 1;
+		x = con->esc_nr_params > 1 ?
+			min(max(param[1], 1), SCR_WIDTH) - 1 : 0;
+		break;
+	case 'J':
+		if (param[0] == 0)
+			clear_screen(con, con->cursor,
+				     top + nr_lines * SCR_WIDTH - con->cursor);
+		else if (param[0] == 1)
+			clear_screen(con, top, con->cursor - top + 1);
+		else
+			clear_screen(con, top, nr_lines * SCR_WIDTH);
+		break;
+	case 'K':
+		if (param[0] == 0)
+			clear_screen(con, con->cursor, SCR_WIDTH - x);
+		else if (param[0] == 1)
+			clear_screen(con, line, x + 1);
+		else
+			clear_screen(con, line, SCR_WIDTH);
+		break;
+	case 'm':
+		set_attr(con);
+		break;
+	case 's':
+		con->saved_x = x;
+		con->saved_y = y;
+		break;
+	case 'u':
+		x = con->saved_x;
+		y = min(con->saved_y, nr_lines - 1);
+		break;
+	default:
+		break;
 	}
 
-	assert(con->cursor - con->orig < con->con_size);
+	con->cursor = top + y * SCR_WIDTH + x;
+}
 
-	while (con->cursor >= con->crtc_start + SCR_SIZE ||
-	       con->cursor < con->crtc_start) {
-		scroll_screen(con, SCR_UP);
+/*****************************************************************************
+ *                                set_attr
+ *****************************************************************************/
+/**
+ * ESC[n;...m: 0 reset, 1 bright, 5 blink, 7 reverse, 22 normal, 25 steady,
+ * 30~37 foreground, 39 default foreground, 40~47 background, 49 default
+ * background.
+ * 
+ * @param con  The console.
+ *****************************************************************************/
+PRIVATE void set_attr(CONSOLE* con)
+{
+	int i;
+	for (i = 0; i < con->esc_nr_params; i++) {
+		int a = con->esc_params[i];
+		u8 attr = con->attr;
+
+		if (a == 0)
+			attr = DEFAULT_CHAR_COLOR;
+		else if (a == 1)
+			attr |= BRIGHT;
+		else if (a == 5)
+			attr |= FLASH;
+		else if (a == 7)
+			attr = (attr & (BRIGHT | FLASH)) |
+				((attr & 0x07) << 4) | ((attr >> 4) & 0x07);
+		else if (a == 22)
+			attr &= ~BRIGHT;
+		else if (a == 25)
+			attr &= ~FLASH;
+		else if (a >= 30 && a <= 37)
+			attr = (attr & ~0x07) | ansi_color[a - 30];
+		else if (a == 39)
+			attr = (attr & ~0x07) | WHITE;
+		else if (a >= 40 && a <= 47)
+			attr = (attr & ~0x70) | (ansi_color[a - 40] << 4);
+		else if (a == 49)
+			attr = (attr & ~0x70) | (BLACK << 4);
+
+		con->attr = attr;
+	}
+}
 
-		clear_screen(con->cursor, SCR_WIDTH);
+/*****************************************************************************
+ *                                fit_cursor
+ *****************************************************************************/
+/**
+ * After the cursor has moved: scroll the screen until the cursor is on it,
+ * and show the screen if the console was scrolled back.
+ *
+ * Each line the screen scrolls is one line taken from the oldest end of the
+ * ring and cleared; nothing else is moved.
+ * 
+ * @param con  The console.
+ *****************************************************************************/
+PRIVATE void fit_cursor(CONSOLE* con)
+{
+	while (con->cursor >= (con->scr_top + SCR_LINES) * SCR_WIDTH) {
+		con->scr_top++;
+		clear_screen(con, (con->scr_top + SCR_LINES - 1) * SCR_WIDTH,
+			     SCR_WIDTH);
 	}
 
-	flush(con);
+	con->view_top = con->scr_top;
 }
 
 /*****************************************************************************
  *                                clear_screen
  *****************************************************************************/
 /**
- * Write whitespaces to the screen.
+ * Write whitespaces to a console.
  * 
+ * @param con  The console.
  * @param pos  Write from here.
  * @param len  How many whitespaces will be written.
  *****************************************************************************/
-PUBLIC void clear_screen(int pos, int len)
+PRIVATE void clear_screen(CONSOLE* con, unsigned int pos, int len)
 {
-	u8 * pch = (u8*)(V_MEM_BASE + pos * 2);
-	while (--len >= 0) {
-		*pch++ = ' ';
-		*pch++ = DEFAULT_CHAR_COLOR;
+	if (len <= 0)
+		return;
+
+	damage(con, pos, len);
+
+	for (; len > 0; len--, pos++)
+		CELL(con, pos) = (DEFAULT_CHAR_COLOR << 8) | ' ';
+}
+
+
+/*****************************************************************************
+ *                                damage
+ *****************************************************************************/
+/**
+ * Mark cells of a console as changed, to be copied by render_screen().
+ * 
+ * @param con  The console the cells belong to.
+ * @param pos  The 1st cell.
+ * @param len  How many cells.
+ *****************************************************************************/
+PRIVATE void damage(CONSOLE* con, unsigned int pos, int len)
+{
+	if (pos < con->dirty_lo)
+		con->dirty_lo = pos;
+	if (pos + len > con->dirty_hi)
+		con->dirty_hi = pos + len;
+}
+
+
+/*****************************************************************************
+ *                                render_screen
+ *****************************************************************************/
+/**
+ * Bring the video memory and the CRTC cursor up to date with the window of
+ * the current console that is to be seen, writing only the cells that
+ * differ from what is shown. When the window has moved (scrolling, another
+ * console selected) every cell of it is compared, otherwise only the ones
+ * damaged since the last time.
+ *
+ * It renders at most once a tick: a program that redraws its screen with
+ * many small writes gets it shown a frame at a time, and cells it redraws
+ * unchanged cost nothing. Damage within the cursor's line (and the line
+ * above, left behind by Enter) is shown at once, so the echo of a key does
+ * not wait for the next tick.
+ * 
+ * @return Non-zero if something is left to render in the next tick.
+ *****************************************************************************/
+PUBLIC int render_screen()
+{
+	CONSOLE * con = &console_table[current_console];
+	unsigned int top = con->view_top * SCR_WIDTH;
+	int moved = con != shown_con || con->view_top != shown_view;
+
+	/* the cursor is hidden below the screen if it is out of the window */
+	unsigned int cursor = con->cursor - top < SCR_SIZE ?
+		con->cursor - top : SCR_SIZE;
+
+	if (!moved && con->dirty_lo >= con->dirty_hi &&
+	    cursor == shown_cursor)
+		return 0;
+
+	unsigned int line = con->cursor - con->cursor % SCR_WIDTH;
+	unsigned int line_above = line >= SCR_WIDTH ? line - SCR_WIDTH : 0;
+	int echo = !moved && con->dirty_lo >= line_above &&
+		con->dirty_hi <= line + SCR_WIDTH;
+
+	if (ticks == last_render && !echo)
+		return 1;
+	last_render = ticks;
+
+	/* take the damage first: it may grow while we are copying */
+	unsigned int lo = moved ? top : max(con->dirty_lo, top);
+	unsigned int hi = moved ? top + SCR_SIZE :
+		min(con->dirty_hi, top + SCR_SIZE);
+	con->dirty_lo = -1;
+	con->dirty_hi = 0;
+
+	u16 * v = (u16*)V_MEM_BASE;
+	for (; lo < hi; lo++) {
+		u16 cell = CELL(con, lo);
+		if (vshown[lo - top] != cell)
+			v[lo - top] = vshown[lo - top] = cell;
+	}
+	shown_con = con;
+	shown_view = con->view_top;
+
+	if (cursor != shown_cursor) {
+		set_cursor(cursor);
+		shown_cursor = cursor;
 	}
+
+	return 0;
 }
 
 
@@ -196,7 +542,8 @@ PRIVATE void set_cursor(unsigned int position)
  *                                set_video_start_addr
  *****************************************************************************/
 /**
- * Routine for hardware screen scrolling.
+ * Set where the screen starts in the video memory. Scrolling is done in
+ * RAM, so it is set to 0 once and for all.
  * 
  * @param addr  Offset in the video memory.
  *****************************************************************************/
@@ -223,7 +570,7 @@ PUBLIC void select_console(int nr_console)
 {
 	if ((nr_console < 0) || (nr_console >= NR_CONSOLES)) return;
 
-	flush(&console_table[current_console = nr_console]);
+	current_console = nr_console;
 }
 
 
@@ -248,101 +595,35 @@ PUBLIC void select_console(int nr_console)
  *****************************************************************************/
 PUBLIC void scroll_screen(CONSOLE* con, int dir)
 {
-	/*
-	 * variables below are all in-console-offsets (based on con->orig)
-	 */
-	int oldest; /* addr of the oldest available line in the console */
-	int newest; /* .... .. ... latest ......... .... .. ... ....... */
-	int scr_top;/* position of the top of current screen */
-
-	newest = (con->cursor - con->orig) / SCR_WIDTH * SCR_WIDTH;
-	oldest = con->is_full ? (newest + SCR_WIDTH) % con->con_size : 0;
-	scr_top = con->crtc_start - con->orig;
-
-	if (dir == SCR_DN) {
-		if (!con->is_full && scr_top > 0) {
-			con->crtc_start -= SCR_WIDTH;
-		}
-		else if (con->is_full && scr_top != oldest) {
-			if (con->cursor - con->orig >= con->con_size - SCR_SIZE) {
-				if (con->crtc_start != con->orig)
-					con->crtc_start -= SCR_WIDTH;
-			}
-			else if (con->crtc_start == con->orig) {
-				scr_top = con->con_size - SCR_SIZE;
-				con->crtc_start = con->orig + scr_top;
-			}
-			else {
-				con->crtc_start -= SCR_WIDTH;
-			}
-		}
-	}
-	else if (dir == SCR_UP) {
-		if (!con->is_full && newest >= scr_top + SCR_SIZE) {
-			con->crtc_start += SCR_WIDTH;
-		}
-		else if (con->is_full && scr_top + SCR_SIZE - SCR_WIDTH != newest) {
-			if (scr_top + SCR_SIZE == con->con_size)
-				con->crtc_start = con->orig;
-			else
-				con->crtc_start += SCR_WIDTH;
-		}
-	}
-	else {
-		assert(dir == SCR_DN || dir == SCR_UP);
-	}
-
-	flush(con);
+	do_scroll(con, dir);
 }
 
 
 /*****************************************************************************
- *                                flush
+ *                                do_scroll
  *****************************************************************************/
 /**
- * Set the cursor and starting address of a console by writing the
- * CRT Controller Registers.
+ * scroll_screen() for the ones inside console.c: move the window over the
+ * lines kept in the ring, a line at a time.
  * 
- * @param con  The console to be set.
+ * @param con   The console whose screen is to be scrolled.
+ * @param dir   SCR_UP or SCR_DN.
  *****************************************************************************/
-PRIVATE void flush(CONSOLE* con)
+PRIVATE void do_scroll(CONSOLE* con, int dir)
 {
-	if (is_current_console(con)) {
-		set_cursor(con->cursor);
-		set_video_start_addr(con->crtc_start);
-	}
+	/* the oldest line still in the ring */
+	unsigned int oldest = con->scr_top + SCR_LINES > CONSOLE_LINES ?
+		con->scr_top + SCR_LINES - CONSOLE_LINES : 0;
 
-#ifdef __TTY_DEBUG__
-	int lineno = 0;
-	for (lineno = 0; lineno < con->con_size / SCR_WIDTH; lineno++) {
-		u8 * pch = (u8*)(V_MEM_BASE +
-				   (con->orig + (lineno + 1) * SCR_WIDTH) * 2
-				   - 4);
-		*pch++ = lineno / 10 + '0';
-		*pch++ = RED_CHAR;
-		*pch++ = lineno % 10 + '0';
-		*pch++ = RED_CHAR;
+	if (dir == SCR_DN) {
+		if (con->view_top > oldest)
+			con->view_top--;
+	}
+	else if (dir == SCR_UP) {
+		if (con->view_top < con->scr_top)
+			con->view_top++;
+	}
+	else {
+		assert(dir == SCR_DN || dir == SCR_UP);
 	}
-#endif
-}
-
-/*****************************************************************************
- *                                w_copy
- *****************************************************************************/
-/**
- * Copy data in WORDS.
- *
- * Note that the addresses of dst and src are not pointers, but integers, 'coz
- * in most cases we pass integers into it as parameters.
- * 
- * @param dst   Addr of destination.
- * @param src   Addr of source.
- * @param size  How many words will be copied.
- *****************************************************************************/
-PRIVATE	void w_copy(unsigned int dst, const unsigned int src, int size)
-{
-	phys_copy((void*)(V_MEM_BASE + (dst << 1)),
-		  (void*)(V_MEM_BASE + (src << 1)),
-		  size << 1);
 }
-
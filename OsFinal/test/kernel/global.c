@@ -23,6 +23,8 @@
 
 PUBLIC	struct proc proc_table[NR_TASKS + NR_PROCS];
 
+PUBLIC	struct mailbox	mailbox_table[NR_MAILBOXES];
+
 /* 注意下面的 TASK 的顺序要与 const.h 中对应 */
 PUBLIC	struct task	task_table[NR_TASKS] = {
 	/* entry        stack size        task name */
@@ -39,7 +41,8 @@ PUBLIC	struct task	user_proc_table[NR_NATIVE_PROCS] = {
 	{Init,   STACK_SIZE_INIT,  "INIT" },
 	{TestA,  STACK_SIZE_TESTA, "TestA"},
 	{TestB,  STACK_SIZE_TESTB, "TestB"},
-	{TestC,  STACK_SIZE_TESTC, "TestC"}};
+	{TestC,  STACK_SIZE_TESTC, "TestC"},
+	{Idle,   STACK_SIZE_IDLE,  "IDLE" }};
 /* PUBLIC	struct task	user_proc_table[NR_PROCS] = { */
 /* 	{TestA, STACK_SIZE_TESTA, "TestA"}, */
 /* 	{TestB, STACK_SIZE_TESTB, "TestB"}, */
@@ -47,13 +50,15 @@ PUBLIC	struct task	user_proc_table[NR_NATIVE_PROCS] = {
 
 PUBLIC	char		task_stack[STACK_SIZE_TOTAL];
 
-PUBLIC	TTY		tty_table[NR_CONSOLES];
+PUBLIC	TTY		tty_table[NR_TTYS];
 PUBLIC	CONSOLE		console_table[NR_CONSOLES];
 
 PUBLIC	irq_handler	irq_table[NR_IRQ];
 
 PUBLIC	system_call	sys_call_table[NR_SYS_CALL] = {sys_printx,
-						       sys_sendrec};
+						       sys_sendrec,
+						       sys_halt,
+						       sys_clock_gettime};
 
 /* FS related below */
 /*****************************************************************************/
@@ -74,6 +79,20 @@ struct dev_drv_map dd_map[] = {
 	{INVALID_DRIVER}	/**< 5 : Reserved for scsi disk driver */
 };
 
+/**
+ * 4MB~5MB: text of the consoles, also in the room the loader leaves for
+ * page tables
+ */
+PUBLIC	u16 *		con_text	= (u16*)0x400000;
+PUBLIC	const int	CON_TEXT_SIZE	= 0x100000;
+
+/**
+ * 5MB+64KB~6MB: page cache for mmap(), in the free memory between the room
+ * the loader leaves for page tables (up to 5MB+4KB) and fsbuf
+ */
+PUBLIC	u8 *		pcache		= (u8*)0x510000;
+PUBLIC	const int	PCACHE_SIZE	= NR_PCACHE_PAGES * PCACHE_PAGE_SIZE;
+
 /**
  * 6MB~7MB: buffer for FS
  */
@@ -61,6 +61,8 @@ PUBLIC void task_hd()
 		send_recv(RECEIVE, ANY, &msg);
 
 		int src = msg.source;
+		if (src == NOTIFICATION) /* HD takes no notify() bits */
+			continue;
 
 		switch (msg.type) {
 		case DEV_OPEN:
@@ -198,8 +200,15 @@ PRIVATE void hd_rdwt(MESSAGE * p)
 		int bytes = min(SECTOR_SIZE, bytes_left);
 		if (p->type == DEV_READ) {
 			interrupt_wait();
-			port_read(REG_DATA, hdbuf, SECTOR_SIZE);
-			phys_copy(la, (void*)va2la(TASK_HD, hdbuf), bytes);
+			if (bytes == SECTOR_SIZE) {
+				/* a whole sector: no need to bounce */
+				port_read(REG_DATA, la, SECTOR_SIZE);
+			}
+			else {
+				port_read(REG_DATA, hdbuf, SECTOR_SIZE);
+				phys_copy(la, (void*)va2la(TASK_HD, hdbuf),
+					  bytes);
+			}
 		}
 		else {
 			if (!waitfor(STATUS_DRQ, STATUS_DRQ, HD_TIMEOUT))
@@ -498,7 +507,7 @@ PRIVATE int waitfor(int mask, int val, int timeout)
 {
 	int t = get_ticks();
 
-	while(((get_ticks() - t) * 1000 / HZ) < timeout)
+	while(((get_ticks() - t) * 1000 / system_hz) < timeout)
 		if ((in_byte(REG_STATUS) & mask) == val)
 			return 1;
 
@@ -523,5 +532,5 @@ PUBLIC void hd_handler(int irq)
 	 */
 	hd_status = in_byte(REG_STATUS);
 
-	inform_int(TASK_HD);
+	defer_inform(TASK_HD);
 }
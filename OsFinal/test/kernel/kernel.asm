@@ -14,6 +14,11 @@ extern	kernel_main
 extern	exception_handler
 extern	spurious_irq
 extern	clock_handler
+extern	ap_clock_handler
+extern	resched_handler
+extern	do_softirq
+extern	irqoff_begin
+extern	irqoff_end
 extern	disp_str
 extern	delay
 extern	irq_table
@@ -21,16 +26,18 @@ extern	irq_table
 ; 导入全局变量
 extern	gdt_ptr
 extern	idt_ptr
-extern	p_proc_ready
-extern	tss
+extern	cpu_table
 extern	disp_pos
-extern	k_reenter
 extern	sys_call_table
+extern	apic_mode
+extern	lapic_eoi
 
 bits 32
 
 [SECTION .data]
 clock_int_msg		db	"^", 0
+bkl			dd	0	; 大内核锁, bit 0
+bkl_owner		dd	0	; 持有它的 struct cpu
 
 [SECTION .bss]
 StackSpace		resb	4 * 1024
@@ -39,9 +46,12 @@ StackTop:		; 栈顶
 [section .text]	; 代码在此
 
 global _start	; 导出 _start
+global StackTop	; BSP 的内核栈
 
 global restart
 global sys_call
+global lock_kernel
+global unlock_kernel
 
 global	divide_error
 global	single_step_exception
@@ -75,6 +85,9 @@ global	hwint12
 global	hwint13
 global	hwint14
 global	hwint15
+global	ap_tick
+global	resched
+global	apic_spurious
 
 
 _start:
@@ -180,24 +193,70 @@ csinit:		; “这个跳转指令强制使用刚刚初始化的结构”——<<O
 	;hlt
 
 
+; 大内核锁 (BKL): 同时只有一个 CPU 在内核 (Ring 0) 里。最外层进入内核时
+; (save) 拿到, 最外层返回时 (restart) 放开; 嵌套的中断已经持有它。
+; edi 为本 CPU, 只用标志位, 系统调用的参数 (eax~edx) 不能动.
+%macro	take_bkl	0
+%%try:
+	lock bts dword [bkl], 0
+	jnc	%%got
+%%spin:
+	pause
+	test	dword [bkl], 1
+	jnz	%%spin
+	jmp	%%try
+%%got:
+	mov	[bkl_owner], edi
+%endmacro
+
+%macro	drop_bkl	0
+	mov	dword [bkl_owner], 0
+	mov	dword [bkl], 0
+%endmacro
+
+
 ; 中断和异常 -- 硬件中断
+; ---------------------------------
+; With the APICs (apic_mode), the handler runs with interrupts on and the
+; EOI is written to the local APIC after it: no 8259A port is touched. All
+; the IRQ vectors are in one APIC priority class, so the local APIC holds
+; the others back until the EOI, as masking the current one did.
+%macro	hwint_apic	1
+	call	irqoff_end
+	sti
+	push	%1			; `.
+	call	[irq_table + 4 * %1]	;  | 中断处理程序
+	pop	ecx			; /
+	cli
+	call	irqoff_begin
+	mov	eax, [lapic_eoi]	; `. EOI
+	mov	dword [eax], 0		; /
+	ret
+%endmacro
+
 ; ---------------------------------
 %macro	hwint_master	1
 	call	save
+	cmp	dword [apic_mode], 0
+	jne	%%apic
 	in	al, INT_M_CTLMASK	; `.
 	or	al, (1 << %1)		;  | 屏蔽当前中断
 	out	INT_M_CTLMASK, al	; /
 	mov	al, EOI			; `. 置EOI位
 	out	INT_M_CTL, al		; /
+	call	irqoff_end		; 中断门关掉的中断到此打开
 	sti	; CPU在响应中断的过程中会自动关中断，这句之后就允许响应新的中断
 	push	%1			; `.
 	call	[irq_table + 4 * %1]	;  | 中断处理程序
 	pop	ecx			; /
 	cli
+	call	irqoff_begin		; 直到 iretd 或 softirq 的 sti
 	in	al, INT_M_CTLMASK	; `.
 	and	al, ~(1 << %1)		;  | 恢复接受当前中断
 	out	INT_M_CTLMASK, al	; /
 	ret
+%%apic:
+	hwint_apic	%1
 %endmacro
 
 
@@ -236,6 +295,8 @@ hwint07:		; Interrupt routine for irq 7 (printer)
 ; ---------------------------------
 %macro	hwint_slave	1
 	call	save
+	cmp	dword [apic_mode], 0
+	jne	%%apic
 	in	al, INT_S_CTLMASK	; `.
 	or	al, (1 << (%1 - 8))	;  | 屏蔽当前中断
 	out	INT_S_CTLMASK, al	; /
@@ -243,15 +304,19 @@ hwint07:		; Interrupt routine for irq 7 (printer)
 	out	INT_M_CTL, al		; /
 	nop				; `. 置EOI位(slave)
 	out	INT_S_CTL, al		; /  一定注意：slave和master都要置EOI
+	call	irqoff_end		; 中断门关掉的中断到此打开
 	sti	; CPU在响应中断的过程中会自动关中断，这句之后就允许响应新的中断
 	push	%1			; `.
 	call	[irq_table + 4 * %1]	;  | 中断处理程序
 	pop	ecx			; /
 	cli
+	call	irqoff_begin		; 直到 iretd 或 softirq 的 sti
 	in	al, INT_S_CTLMASK	; `.
 	and	al, ~(1 << (%1 - 8))	;  | 恢复接受当前中断
 	out	INT_S_CTLMASK, al	; /
 	ret
+%%apic:
+	hwint_apic	%1
 %endmacro
 ; ---------------------------------
 
@@ -287,6 +352,28 @@ ALIGN	16
 hwint15:		; Interrupt routine for irq 15
 	hwint_slave	15
 
+; ---------------------------------
+; IPI, 由本地 APIC 送来, 处理完写它的 EOI 寄存器
+ALIGN	16
+ap_tick:		; BSP 每个 tick 发给 AP 的 (INT_VECTOR_AP_TICK)
+	call	save
+	call	ap_clock_handler
+	mov	eax, [lapic_eoi]	; `. EOI
+	mov	dword [eax], 0		; /
+	ret
+
+ALIGN	16
+resched:		; AP 叫醒 BSP 的 (INT_VECTOR_RESCHED)
+	call	save
+	call	resched_handler
+	mov	eax, [lapic_eoi]	; `. EOI
+	mov	dword [eax], 0		; /
+	ret
+
+ALIGN	16
+apic_spurious:		; local APIC spurious interrupt, no EOI for it
+	iretd
+
 
 
 ; 中断和异常 -- 异常
@@ -364,7 +451,7 @@ save:
         push    fs      ;  |
         push    gs      ; /
 
-	;; 注意，从这里开始，一直到 `mov esp, StackTop'，中间坚决不能用 push/pop 指令，
+	;; 注意，从这里开始，一直到切换到内核栈，中间坚决不能用 push/pop 指令，
 	;; 因为当前 esp 指向 proc_table 里的某个位置，push 会破坏掉进程表，导致灾难性后果！
 
 	mov	esi, edx	; 保存 edx，因为 edx 里保存了系统调用的参数
@@ -378,13 +465,21 @@ save:
 
         mov     esi, esp                    ;esi = 进程表起始地址
 
-        inc     dword [k_reenter]           ;k_reenter++;
-        cmp     dword [k_reenter], 0        ;if(k_reenter ==0)
+	this_cpu                            ;edi = 本 CPU
+        inc     dword [edi + CPU_REENTER]   ;k_reenter++;
+        cmp     dword [edi + CPU_REENTER], 0;if(k_reenter ==0)
         jne     .1                          ;{
-        mov     esp, StackTop               ;  mov esp, StackTop <--切换到内核栈
-        push    restart                     ;  push restart
+        mov     esp, [edi + CPU_STACKTOP]   ;  <--切换到本 CPU 的内核栈
+	call	irqoff_begin                ;  中断门已关中断, 开始计时
+	take_bkl                            ;  拿到 BKL
+        push    softirq_restart             ;  push softirq_restart
         jmp     [esi + RETADR - P_STACKBASE];  return;
 .1:                                         ;} else { 已经在内核栈，不需要再切换
+	call	irqoff_begin
+	cmp	[bkl_owner], edi            ;  BKL 只在 sys_halt() 的 hlt 时
+	je	.2                          ;  放开, 打断它的中断拿回来,
+	take_bkl                            ;  返回后 sys_halt() 接着持有
+.2:
         push    restart_reenter             ;  push restart_reenter
         jmp     [esi + RETADR - P_STACKBASE];  return;
                                             ;}
@@ -396,10 +491,12 @@ save:
 sys_call:
         call    save
 
+	call	irqoff_end
         sti
 	push	esi
 
-	push	dword [p_proc_ready]
+	this_cpu
+	push	dword [edi + CPU_PROC]
 	push	edx
 	push	ecx
 	push	ebx
@@ -409,6 +506,7 @@ sys_call:
 	pop	esi
         mov     [esi + EAXREG - P_STACKBASE], eax
         cli
+	call	irqoff_begin
 
         ret
 
@@ -416,13 +514,27 @@ sys_call:
 ; ====================================================================================
 ;                                   restart
 ; ====================================================================================
+softirq_restart:
+	this_cpu
+	cmp	dword [edi + CPU_SOFTIRQ], 0	; `. 最外层的中断/系统调用返回前，
+	je	restart				;  | 开中断运行本 CPU 的 softirq
+	call	do_softirq			; /  (见 softirq.c)
 restart:
-	mov	esp, [p_proc_ready]
+	call	irqoff_end		; iretd 会开中断, 趁还在内核栈上结束计时
+	this_cpu
+	mov	esp, [edi + CPU_PROC]
+	test	esp, esp
+	jz	cpu_idle
 	lldt	[esp + P_LDT_SEL] 
 	lea	eax, [esp + P_STACKTOP]
-	mov	dword [tss + TSS3_S_SP0], eax
+	mov	dword [edi + CPU_TSS + TSS3_S_SP0], eax
+	drop_bkl
+	jmp	restart_reenter.pop
 restart_reenter:
-	dec	dword [k_reenter]
+	call	irqoff_end
+	this_cpu
+.pop:
+	dec	dword [edi + CPU_REENTER]
 	pop	gs
 	pop	fs
 	pop	es
@@ -431,3 +543,36 @@ restart_reenter:
 	add	esp, 4
 	iretd
 
+cpu_idle:			; 没有进程可运行的 AP, 在内核栈上停下来
+	mov	esp, [edi + CPU_STACKTOP]
+	dec	dword [edi + CPU_REENTER]	; 像是从进程里被打断, 中断走最外层的路,
+	drop_bkl				; 从栈顶重来, 不会回到这里
+.halt:
+	sti
+	hlt
+	cli			; 除了 apic_spurious (它直接 iretd)
+	jmp	.halt
+
+
+; ====================================================================================
+;                                 lock_kernel
+; ====================================================================================
+; void lock_kernel(): 拿到 BKL, 已经持有就什么也不做。须关中断.
+lock_kernel:
+	push	edi
+	this_cpu
+	cmp	[bkl_owner], edi
+	je	.held
+	take_bkl
+.held:
+	pop	edi
+	ret
+
+; ====================================================================================
+;                                 unlock_kernel
+; ====================================================================================
+; void unlock_kernel()
+unlock_kernel:
+	drop_bkl
+	ret
+
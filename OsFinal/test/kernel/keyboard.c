@@ -22,6 +22,7 @@
 #include "global.h"
 #include "keyboard.h"
 #include "keymap.h"
+#include "smp.h"
 #include "proto.h"
 
 PRIVATE	struct kb_inbuf	kb_in;
@@ -41,13 +42,15 @@ PRIVATE u8	get_byte_from_kb_buf();
 PRIVATE void	set_leds();
 PRIVATE void	kb_wait();
 PRIVATE void	kb_ack();
+PRIVATE void	kb_softirq();
 
 
 /*****************************************************************************
  *                                keyboard_handler
  *****************************************************************************/
 /**
- * <Ring 0> Handles the interrupts generated by the keyboard controller.
+ * <Ring 0> Handles the interrupts generated by the keyboard controller:
+ * the scan code is queued in kb_in, TTY is woken up by kb_softirq().
  * 
  * @param irq The IRQ corresponding to the keyboard, unused here.
  *****************************************************************************/
@@ -91,7 +94,23 @@ PUBLIC void keyboard_handler(int irq)
 		printl("================================\n");
 	}
 #endif
-	key_pressed = 1;
+
+	raise_softirq(SOFTIRQ_KBD);
+}
+
+
+/*****************************************************************************
+ *                                kb_softirq
+ *****************************************************************************/
+/**
+ * <Ring 0> SOFTIRQ_KBD: wake TTY up and run it now instead of on the next
+ * clock tick.
+ *****************************************************************************/
+PRIVATE void kb_softirq()
+{
+	inform_int(TASK_TTY);
+	if (proc_table[TASK_TTY].p_flags == 0)
+		set_proc_ready(&proc_table[TASK_TTY]);
 }
 
 
@@ -119,6 +138,7 @@ PUBLIC void init_keyboard()
 
 	set_leds();
 
+	put_softirq_handler(SOFTIRQ_KBD, kb_softirq);
 	put_irq_handler(KEYBOARD_IRQ, keyboard_handler);
 	enable_irq(KEYBOARD_IRQ);
 }
@@ -44,6 +44,7 @@ PUBLIC void get_boot_params(struct boot_params * pbp)
 
 	pbp->mem_size = p[BI_MEM_SIZE];
 	pbp->kernel_file = (unsigned char *)(p[BI_KERNEL_FILE]);
+	pbp->hz = p[BI_HZ];
 
 	/**
 	 * the kernel file should be a ELF executable,
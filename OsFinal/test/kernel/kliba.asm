@@ -9,6 +9,12 @@
 
 ; 导入全局变量
 extern	disp_pos
+extern	apic_mode
+extern	cpu_table
+
+; 导入函数
+extern	ioapic_enable_irq
+extern	ioapic_disable_irq
 
 
 [SECTION .text]
@@ -22,6 +28,8 @@ global	enable_irq
 global	disable_irq
 global	enable_int
 global	disable_int
+global	irqoff_begin
+global	irqoff_end
 global	port_read
 global	port_write
 global	glitter
@@ -161,10 +169,13 @@ port_write:
 ;	else{
 ;		out_byte(INT_S_CTLMASK, in_byte(INT_S_CTLMASK) | (1 << irq));
 ;	}
+; With the APICs (apic_mode), ioapic_disable_irq() does it.
 disable_irq:
 	mov	ecx, [esp + 4]		; irq
 	pushf
 	cli
+	cmp	dword [apic_mode], 0
+	jne	disable_apic
 	mov	ah, 1
 	rol	ah, cl			; ah = (1 << (irq % 8))
 	cmp	cl, 8
@@ -191,6 +202,12 @@ dis_already:
 	popf
 	xor	eax, eax		; already disabled
 	ret
+disable_apic:
+	push	ecx
+	call	ioapic_disable_irq	; eax = 1 or 0 as above
+	pop	ecx
+	popf
+	ret
 
 ; ========================================================================
 ;		   void enable_irq(int irq);
@@ -203,11 +220,14 @@ dis_already:
 ;	else{
 ;		out_byte(INT_S_CTLMASK, in_byte(INT_S_CTLMASK) & ~(1 << irq));
 ;	}
+; With the APICs (apic_mode), ioapic_enable_irq() does it.
 ;
 enable_irq:
 	mov	ecx, [esp + 4]		; irq
 	pushf
 	cli
+	cmp	dword [apic_mode], 0
+	jne	enable_apic
 	mov	ah, ~1
 	rol	ah, cl			; ah = ~(1 << (irq % 8))
 	cmp	cl, 8
@@ -224,21 +244,94 @@ enable_8:
 	out	INT_S_CTLMASK, al	; clear bit at slave 8259
 	popf
 	ret
+enable_apic:
+	push	ecx
+	call	ioapic_enable_irq
+	pop	ecx
+	popf
+	ret
 
 ; ========================================================================
 ;		   void disable_int();
 ; ========================================================================
+; If interrupts were on, irqoff_begin() starts timing how long they stay off.
 disable_int:
+	pushfd
 	cli
+	test	dword [esp], 0x200	; IF
+	jz	.already
+	call	irqoff_begin
+.already:
+	add	esp, 4
 	ret
 
 ; ========================================================================
 ;		   void enable_int();
 ; ========================================================================
+; Ends what disable_int() has timed, see irqoff_end().
 enable_int:
+	pushad
+	mov	ebx, [esp + 32]		; who
+	call	irqoff_stop
+	popad
 	sti
 	ret
 
+; ========================================================================
+;		   void irqoff_begin();
+; ========================================================================
+; Interrupts are off: start timing how long, in the struct cpu of this
+; processor, unless it is timing already. Changes no register, so that the
+; kernel.asm stubs can call it where an interrupt gate or a cli has turned
+; interrupts off.
+irqoff_begin:
+	pushad
+	this_cpu
+	mov	eax, [edi + CPU_IRQOFF_SINCE]
+	or	eax, [edi + CPU_IRQOFF_SINCE + 4]
+	jnz	.timing
+	rdtsc
+	mov	[edi + CPU_IRQOFF_SINCE], eax
+	mov	[edi + CPU_IRQOFF_SINCE + 4], edx
+.timing:
+	popad
+	ret
+
+; ========================================================================
+;		   void irqoff_end();
+; ========================================================================
+; Interrupts are about to go on (sti, iretd): end the timing. The longest
+; stretch so far goes to irqoff_max of this processor, with the return
+; address of the call that ended it in irqoff_where. Changes no register.
+irqoff_end:
+	pushad
+	mov	ebx, [esp + 32]		; who
+	call	irqoff_stop
+	popad
+	ret
+
+; irqoff_stop: irqoff_end() for ebx being where, changes eax, edx and edi.
+irqoff_stop:
+	this_cpu
+	mov	eax, [edi + CPU_IRQOFF_SINCE]
+	or	eax, [edi + CPU_IRQOFF_SINCE + 4]
+	jz	.done			; not timing
+	rdtsc
+	sub	eax, [edi + CPU_IRQOFF_SINCE]
+	sbb	edx, [edi + CPU_IRQOFF_SINCE + 4]
+	mov	dword [edi + CPU_IRQOFF_SINCE], 0
+	mov	dword [edi + CPU_IRQOFF_SINCE + 4], 0
+	test	edx, edx
+	jz	.fits
+	mov	eax, 0xFFFFFFFF
+.fits:
+	cmp	eax, [edi + CPU_IRQOFF_MAX]
+	jbe	.done
+	mov	[edi + CPU_IRQOFF_MAX], eax
+	mov	[edi + CPU_IRQOFF_WHERE], ebx
+.done:
+	ret
+
 ; ========================================================================
 ;                  void glitter(int row, int col);
 ; ========================================================================
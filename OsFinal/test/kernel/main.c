@@ -9,6 +9,7 @@
 #include "tty.h"
 #include "console.h"
 #include "global.h"
+#include "smp.h"
 #include "proto.h"
 #include "keyboard.h"
 #include "stdlib.h"
@@ -53,7 +54,7 @@ PUBLIC int kernel_main()
 			priv = PRIVILEGE_USER;
 			rpl = RPL_USER;
 			eflags = 0x202;	/* IF=1, bit 2 is always 1 */
-			prio = 5;
+			prio = i == IDLE ? 0 : 5; /* IDLE runs only if nobody else can */
 		}
 
 		strcpy(p->name, t->name);	/* name of the process */
@@ -100,14 +101,20 @@ PUBLIC int kernel_main()
 		p->regs.eflags = eflags;
 
 		p->ticks = p->priority = prio;
+		p->p_level = 0;
+		p->p_pass = 0;
+		p->p_runtime = 0;
 
 		p->p_flags = 0;
 		p->p_msg = 0;
 		p->p_recvfrom = NO_TASK;
 		p->p_sendto = NO_TASK;
 		p->has_int_msg = 0;
+		p->notify_pending = 0;
+		p->p_mailbox = 0;
 		p->q_sending = 0;
 		p->next_sending = 0;
+		p->p_cpu = 0;
 
 		for (j = 0; j < NR_FILES; j++)
 			p->filp[j] = 0;
@@ -115,14 +122,30 @@ PUBLIC int kernel_main()
 		stk -= t->stacksize;
 	}
 
-	k_reenter = 0;
+	/* requests to TASK_SYS are queued, the callers go on to RECEIVE */
+	memset(mailbox_table, 0, sizeof(struct mailbox) * NR_MAILBOXES);
+	proc_table[TASK_SYS].p_mailbox = &mailbox_table[0];
+	/**
+	 * TASK_TTY's RESUME_PROC and the driver's completion of a parked read
+	 * are SENDs nobody waits a reply for: with a mailbox they no longer
+	 * wait for FS to RECEIVE either.
+	 */
+	proc_table[TASK_FS].p_mailbox = &mailbox_table[1];
+
+	this_cpu()->reenter = 0;
 	ticks = 0;
 
-	p_proc_ready = proc_table;
+	set_proc_ready(proc_table);
 
+	init_softirq();
 	init_clock();
+	init_smp();
+	init_apic();
 	init_keyboard();
+	init_serial();
 
+	lock_kernel();
+	run_aps();
 	restart();
 
 	while (1) {}
@@ -351,6 +374,7 @@ double my_atof(const char *str)
 }
 
 #define clrscr() clear()
+void home();
 char snake_Array[17][30] =
 {
 	{ '=','=','=','=','=','=','=','=','=','=','=','=','=','=','=','=','=','=','=','=','=','=','=','=','=','=','=','=','\n','\0' },
@@ -375,20 +399,18 @@ int snake_area_width = 30;
 int snake_area_height = 17;
 int move_direction = 4;
 
+/* a unit is a third of a second: sleep(9) is "exit in 3 seconds" */
 void sleep(int pauseTime)
 {
-	int i = 0;
-	for (i = 0; i<pauseTime * 1000000; i++)
-	{
-		;
-	}
+	sleep_ms(pauseTime * 1000 / 3);
 }
 void diplaySnakeArea() {
-	clear();
+	home();
 	int i;
 	for (i = 0; i<snake_area_height; i++) {
 		printf(snake_Array[i]);
 	}
+	printf("\033[J");
 }
 
 
@@ -396,6 +418,7 @@ void diplaySnakeArea() {
 
 int snake_state = 0;
 void Maze() {
+	clear();
 	while (snake_head[0] != snake_area_height - 1 && snake_head[1] != snake_area_width - 3 && snake_head[0] != 0 && snake_head[1] != 0) {
 		snake_Array[snake_head[0]][snake_head[1]] = 'o';
 		//up
@@ -464,21 +487,18 @@ PUBLIC void judgeInpt(u32 key)
 		if (output[0] == 's') changeToDown();
 		if (output[0] == 'd') changeToRight();
 		if (output[0] == 'w') changeToUp();
-		if (output[0] == 'j') Achess();
 	}
 }
 
 
 //snake game code
 PUBLIC int listenerStart = 0;
-PUBLIC char chessMan = 'n';
 struct Snake {   //every node of the snake 
 	int x, y;
 	int now;   //0,1,2,3 means left right up down   
 }Snake[8 * 16];  //Snake[0] is the head，and the other nodes are recorded in inverted order，eg: Snake[1] is the tail
 				 //change the direction of circle
 void changeToLeft() {
-
 	if (snakeControl == 1)
 	{
 		move_direction = 3;
@@ -487,12 +507,6 @@ void changeToLeft() {
 			listenerStart = 0;
 		}
 	}
-	else
-	{
-		chessMan = 'a';
-	}
-
-
 }
 void changeToDown() {
 	if (snakeControl == 1)
@@ -503,10 +517,6 @@ void changeToDown() {
 			listenerStart = 0;
 		}
 	}
-	else {
-		chessMan = 's';
-	}
-
 }
 void changeToRight() {
 	if (snakeControl == 1)
@@ -517,10 +527,6 @@ void changeToRight() {
 			listenerStart = 0;
 		}
 	}
-	else {
-		chessMan = 'd';
-	}
-
 }
 void changeToUp() {
 	if (snakeControl == 1)
@@ -531,20 +537,6 @@ void changeToUp() {
 			listenerStart = 0;
 		}
 	}
-	else {
-		chessMan = 'w';
-	}
-
-}
-void Achess()
-{
-	if (snakeControl == 1)
-	{
-		return;
-	}
-	else {
-		chessMan = 'j';
-	}
 }
 const int mapH = 8;
 const int mapW = 16;
@@ -660,7 +652,7 @@ void show() {
 			help();
 			break;
 		}
-		clear();
+		home();
 		for (i = 0; i < mapH; i++)
 		{
 			for (j = 0; j < mapW; j++)
@@ -670,6 +662,7 @@ void show() {
 
 		printf("Have fun!\n");
 		printf("You have ate:%d\n", eat);
+		printf("\033[J");
 		/*for(i=0; i < sLength; i++){
 		printf("x:%d",Snake[i].x);
 		printf("\n");
@@ -862,6 +855,73 @@ void untar(const char * filename)
 	//printf(" done, %d files extracted]\n", i);
 }
 
+/*****************************************************************************
+*                                run_pipeline
+*****************************************************************************/
+/**
+* Run `cmd0 | cmd1 | ...': every command gets a child, and the stdout of one
+* is connected to the stdin of the next by a pipe, so the data never leaves
+* the memory of TASK_FS.
+*
+* @param cmd      argv of each command.
+* @param nr_cmds  How many commands.
+*****************************************************************************/
+void run_pipeline(char ** cmd[], int nr_cmds)
+{
+	int i;
+	for (i = 0; i < nr_cmds; i++) {
+		int fd = cmd[i][0] ? open(cmd[i][0], O_RDWR) : -1;
+		if (fd == -1) {
+			printf("{%s}: bad command in pipeline\n",
+			       cmd[i][0] ? cmd[i][0] : "");
+			return;
+		}
+		close(fd);
+	}
+
+	int fd_in = -1;	/* read end of the pipe from the previous command */
+	for (i = 0; i < nr_cmds; i++) {
+		int fd_pipe[2];
+		if (i < nr_cmds - 1 && pipe(fd_pipe) != 0) {
+			printf("{pipe() failed}\n");
+			break;
+		}
+
+		int pid = fork();
+		if (pid == 0) {	/* child */
+			if (fd_in != -1) {
+				dup2(fd_in, 0);
+				close(fd_in);
+			}
+			if (i < nr_cmds - 1) {
+				dup2(fd_pipe[1], 1);
+				close(fd_pipe[1]);
+				close(fd_pipe[0]);
+			}
+			execv(cmd[i][0], cmd[i]);
+			/* not reached unless execv() failed */
+			exit(1);
+		}
+
+		/* parent */
+		if (fd_in != -1)
+			close(fd_in);
+		if (i < nr_cmds - 1) {
+			close(fd_pipe[1]);
+			fd_in = fd_pipe[0];
+		}
+	}
+
+	if (fd_in != -1)
+		close(fd_in);
+
+	int n;
+	for (n = 0; n < i; n++) {
+		int s;
+		wait(&s);
+	}
+}
+
 /*****************************************************************************
 *                                shabby_shell
 *****************************************************************************/
@@ -892,19 +952,35 @@ void shabby_shell(const char * tty_name)
 		char ch;
 		do {
 			ch = *p;
-			if (*p != ' ' && *p != 0 && !word) {
+			if (*p != ' ' && *p != '|' && *p != 0 && !word) {
 				s = p;
 				word = 1;
 			}
-			if ((*p == ' ' || *p == 0) && word) {
+			if ((*p == ' ' || *p == '|' || *p == 0) && word) {
 				word = 0;
 				argv[argc++] = s;
 				*p = 0;
 			}
+			if (ch == '|')	/* ends the argv of one command */
+				argv[argc++] = 0;
 			p++;
 		} while (ch);
 		argv[argc] = 0;
 
+		/* each command needs at least one char and a `|' */
+		char ** cmd[sizeof(rdbuf) / 2];
+		int nr_cmds = 1;
+		int i;
+		cmd[0] = argv;
+		for (i = 0; i < argc; i++)
+			if (argv[i] == 0)
+				cmd[nr_cmds++] = &argv[i + 1];
+
+		if (nr_cmds > 1) {
+			run_pipeline(cmd, nr_cmds);
+			continue;
+		}
+
 		int fd = open(argv[0], O_RDWR);
 		if (fd == -1) {
 			if (rdbuf[0]) {
@@ -980,10 +1056,11 @@ void Init()
 
 void clear()
 {
-	clear_screen(0, console_table[current_console].cursor);
-	console_table[current_console].crtc_start = 0;
-	console_table[current_console].cursor = 0;
-
+	printf("\033[H\033[2J");	/* cursor home, erase the screen */
+}
+void home()
+{
+	printf("\033[H");	/* cursor home: the next frame overwrites this one */
 }
 void help()
 {
@@ -999,8 +1076,154 @@ void help()
 	printf("8. snake         : Play a greedy eating Snake\n");
 	printf("9. 2048          : Play a 2048 game\n");
 	printf("10.box           : Play a push box game\n");
+	printf("11.ttybench      : Measure how fast the console prints\n");
+	printf("12.irqoff        : Show the longest time interrupts were off\n");
+	printf("13.mailbox       : Show how the kernel mailboxes are used\n");
+	printf("14.falloctest    : Create a file after fallocate() left a short hole\n");
 	printf("==============================================================================\n");
 }
+/*****************************************************************************
+*                                TtyBench
+*****************************************************************************/
+/**
+* Print screenfuls of text to fd 1, one line per write() and then one
+* screenful per write(), and report the chars per second of each.
+*****************************************************************************/
+void TtyBench()
+{
+	char text[SCR_SIZE];
+	int nr_screens = 8;
+	int i, j;
+
+	for (i = 0; i < SCR_SIZE; i++)
+		text[i] = i % SCR_WIDTH == SCR_WIDTH - 1 ? '\n' :
+			'!' + (i / SCR_WIDTH + i) % ('~' - '!' + 1);
+
+	int t0 = get_ticks();
+	for (i = 0; i < nr_screens; i++)
+		for (j = 0; j < SCR_SIZE; j += SCR_WIDTH)
+			write(1, text + j, SCR_WIDTH);
+	int t_line = get_ticks() - t0;
+
+	t0 = get_ticks();
+	for (i = 0; i < nr_screens; i++)
+		write(1, text, SCR_SIZE);
+	int t_screen = get_ticks() - t0;
+
+	int nr_chars = nr_screens * SCR_SIZE;
+	printf("ttybench: %d chars per run\n", nr_chars);
+	printf("  a line per write    : %d ticks, %d chars/s\n", t_line,
+	       t_line ? nr_chars * system_hz / t_line : 0);
+	printf("  a screen per write  : %d ticks, %d chars/s\n", t_screen,
+	       t_screen ? nr_chars * system_hz / t_screen : 0);
+}
+
+/*****************************************************************************
+*                                IrqOff
+*****************************************************************************/
+/**
+* Report, for each processor online, the longest stretch with interrupts
+* off since the last report, and start over.
+*****************************************************************************/
+void IrqOff()
+{
+	int i;
+	for (i = 0; i < NR_CPUS; i++) {
+		struct cpu * c = &cpu_table[i];
+		if (!c->online)
+			continue;
+
+		u32 cycles = c->irqoff_max;
+		u32 where = c->irqoff_where;
+		c->irqoff_max = 0;
+
+		printf("irqoff: cpu %d longest %d cycles, %d us, ended at 0x%x\n",
+		       i, cycles, cycles / max(tsc_khz / 1000, 1), where);
+	}
+}
+
+/*****************************************************************************
+*                                MailboxStat
+*****************************************************************************/
+/**
+* Report the mailbox of every proc that has one.
+*****************************************************************************/
+void MailboxStat()
+{
+	int i;
+	for (i = 0; i < NR_TASKS + NR_PROCS; i++) {
+		struct mailbox * mb = proc_table[i].p_mailbox;
+		if (!mb)
+			continue;
+		printf("%s: %d/%d queued, high water %d\n", proc_table[i].name,
+		       mb->count, MAILBOX_SIZE, mb->high_water);
+		printf("  %d messages, %d senders blocked, %d dropped\n",
+		       mb->nr_queued, mb->nr_full, mb->nr_dropped);
+	}
+}
+
+/*****************************************************************************
+*                                FallocTest
+*****************************************************************************/
+/**
+* Create A, B and C, unlink B, fallocate A by 100 sectors, which grows it in
+* place into the front of B's extent, and create D: the hole left behind is
+* shorter than a file, D must go somewhere else and leave C alone.
+*****************************************************************************/
+void FallocTest()
+{
+	char * names[] = {"/ft_a", "/ft_b", "/ft_c", "/ft_d"};
+	int fd[4];
+	char buf[SECTOR_SIZE];
+	int i;
+	int ok = 1;
+
+	for (i = 0; i < 3; i++) {
+		fd[i] = open(names[i], O_CREAT | O_RDWR);
+		assert(fd[i] != -1);
+	}
+
+	memset(buf, 'C', SECTOR_SIZE);
+	write(fd[2], buf, SECTOR_SIZE);
+
+	close(fd[1]);
+	unlink(names[1]);
+
+	if (fallocate(fd[0], (NR_DEFAULT_FILE_SECTS + 100) * SECTOR_SIZE) != 0) {
+		printf("falloctest: fallocate() failed\n");
+		ok = 0;
+	}
+
+	fd[3] = open(names[3], O_CREAT | O_RDWR);
+	if (fd[3] == -1) {
+		printf("falloctest: creating %s failed\n", names[3]);
+		ok = 0;
+	}
+	else {
+		memset(buf, 'D', SECTOR_SIZE);
+		write(fd[3], buf, SECTOR_SIZE);
+		close(fd[3]);
+		unlink(names[3]);
+	}
+
+	lseek(fd[2], 0, SEEK_SET);
+	read(fd[2], buf, SECTOR_SIZE);
+	for (i = 0; i < SECTOR_SIZE; i++)
+		if (buf[i] != 'C')
+			break;
+	if (i < SECTOR_SIZE) {
+		printf("falloctest: %s was overwritten\n", names[2]);
+		ok = 0;
+	}
+
+	close(fd[0]);
+	unlink(names[0]);
+	close(fd[2]);
+	unlink(names[2]);
+
+	printf("falloctest: %s\n", ok ? "ok" : "FAILED");
+}
+
 void ShowOsScreen()
 {
 	clear();
@@ -1020,7 +1243,8 @@ void ShowOsScreen()
 }
 void printProcess()
 {
-	if (schedule_flag == RR_SCHEDULE)
+	/* MLFQ and STRIDE are done by schedule() itself, shown the RR way */
+	if (schedule_flag != PRIO_SCHEDULE)
 	{
 		for (int i = 6; i < 9; i++)
 		{
@@ -1116,9 +1340,19 @@ void ProcessManage()
 			printf("RR===========\n");
 		}
 
+		else if (schedule_flag == MLFQ_SCHEDULE)
+			printf("MLFQ=========\n");
+		else if (schedule_flag == STRIDE_SCHEDULE)
+			printf("STRIDE=======\n");
 		else
 			printf("PRIO=========\n");
 	}
+	int total = proc_table[6].p_runtime + proc_table[7].p_runtime +
+		    proc_table[8].p_runtime;
+	for (int i = 6; i < 9; i++)
+		printf("          ===== %s ran %d ticks, %d%%\n",
+		       proc_table[i].name, proc_table[i].p_runtime,
+		       total ? proc_table[i].p_runtime * 100 / total : 0);
 	printf("===============================================================================\n");
 	printf("=                               command tips:                                 =\n");
 	printf("=                   YOU SHOULD use 'run' to BEGIN YOUR TEST                   =\n");
@@ -1130,6 +1364,8 @@ void ProcessManage()
 	printf("=                  'up a/b/c' -> higher process priority                      =\n");
 	printf("=                 'down a/b/c' -> lower process priority                      =\n");
 	printf("=       'RR schedule' or 'PRIO schedule' -> change the schedule method        =\n");
+	printf("=            'MLFQ schedule' -> multilevel feedback queue in kernel           =\n");
+	printf("=       'STRIDE schedule' -> CPU share in proportion to the priorities        =\n");
 
 	printf("===============================================================================\n");
 }
@@ -1337,31 +1573,17 @@ void FileSystem(int fd_stdin, int fd_stdout)
 			}
 			else if (strcmp(cmd, "rename") == 0)
 			{
-				int n_fd;
-				int n1;
-				int n2;
-				fd = open(filename, O_RDWR);
-				if (fd == -1)
-				{
-					printf("File not exit! Please check the fileaname!\n");
-					continue;
-				}
 				printf("Please input new filename: ");
 				m = read(fd_stdin, rdbuf, 80);
 				rdbuf[m] = 0;
-				printf("new file name:%s\n", rdbuf);
-				n_fd = open(rdbuf, O_CREAT | O_RDWR);
-				if (n_fd == -1)
+				if (rename(filename, rdbuf) == 0)
 				{
-					printf("FileName has exit! Please try another fileaname!\n");
-					continue;
+					printf("Rename file '%s' -> '%s' successful!\n", filename, rdbuf);
+				}
+				else
+				{
+					printf("Failed to rename the file,please try again!\n");
 				}
-				n1 = read(fd, buf, 1024);
-				printf("buf:%s\n", buf);
-				n2 = write(n_fd, buf, n1 + 1);
-				close(n_fd);
-				close(fd);
-				//re_flag = 1;
 			}
 			else if (strcmp(cmd, "lseek") == 0)
 			{
@@ -1560,6 +1782,18 @@ void TestA()
 					schedule_flag = PRIO_SCHEDULE;
 					ProcessManage();
 
+				}
+				else if (strcmp(rdbuf, "MLFQ schedule") == 0)
+				{
+					schedule_flag = MLFQ_SCHEDULE;
+					ProcessManage();
+
+				}
+				else if (strcmp(rdbuf, "STRIDE schedule") == 0)
+				{
+					schedule_flag = STRIDE_SCHEDULE;
+					ProcessManage();
+
 				}
 				else if (strcmp(rdbuf, "resume c") == 0)
 				{
@@ -1630,6 +1864,18 @@ void TestA()
 			else if (strcmp(rdbuf, "box") == 0) {
 				Sokoban(fd_stdin);
 			}
+			else if (strcmp(rdbuf, "ttybench") == 0) {
+				TtyBench();
+			}
+			else if (strcmp(rdbuf, "irqoff") == 0) {
+				IrqOff();
+			}
+			else if (strcmp(rdbuf, "mailbox") == 0) {
+				MailboxStat();
+			}
+			else if (strcmp(rdbuf, "falloctest") == 0) {
+				FallocTest();
+			}
 			else
 				printf("Command not found,please check!For more command information please use 'help' command.\n");
 		}
@@ -1672,7 +1918,24 @@ TestB
 *======================================================================*/
 void TestC()
 {
-	for (;;);
+	MESSAGE msg;
+
+	/* nothing to do: wait for a message that never comes */
+	for (;;)
+		send_recv(RECEIVE, ANY, &msg);
+}
+
+/*======================================================================*
+                               Idle
+ *======================================================================*/
+/**
+ * Run when no other proc is runnable. halt() keeps the CPU stopped until an
+ * interrupt makes someone runnable again.
+ */
+void Idle()
+{
+	for (;;)
+		halt();
 }
 
 /*****************************************************************************
@@ -1695,17 +1958,77 @@ PUBLIC void panic(const char *fmt, ...)
 }
 
 
+/* the TTY settings to go back to, while a game keeps the TTY raw */
+struct termios game_cooked;
+int game_raw = 0;
+
+/*****************************************************************************
+*                                raw_begin
+*****************************************************************************/
+/**
+* Put the TTY in raw mode for a whole game, so that getch() does not have to
+* switch modes for every key.
+*
+* @param fd_stdin  The TTY.
+*****************************************************************************/
+void raw_begin(int fd_stdin)
+{
+	struct termios raw;
+
+	if (game_raw || tcgetattr(fd_stdin, &game_cooked) != 0)
+		return;
+	raw = game_cooked;
+	raw.c_lflag &= ~(ICANON | ECHO);
+	raw.c_vmin = 1;
+	raw.c_vtime = 0;
+	tcsetattr(fd_stdin, &raw);
+	game_raw = 1;
+}
+
+/*****************************************************************************
+*                                raw_end
+*****************************************************************************/
+/**
+* Give the TTY back the settings raw_begin() found.
+*
+* @param fd_stdin  The TTY.
+*****************************************************************************/
+void raw_end(int fd_stdin)
+{
+	if (!game_raw)
+		return;
+	tcsetattr(fd_stdin, &game_cooked);
+	game_raw = 0;
+}
+
+/*****************************************************************************
+*                                getch
+*****************************************************************************/
+/**
+* Wait for one key, in raw mode so that neither Enter nor echo is needed.
+* Outside raw_begin()/raw_end(), raw mode is entered for this key only.
+*
+* @param fd_stdin  The TTY.
+*
+* @return The key, or 'n' if nothing could be read.
+*****************************************************************************/
 char getch(int fd_stdin)
 {
-	//char rdbuf[128];
-	//int r = read(fd_stdin, rdbuf, 70);
-	//rdbuf[r] = 0;
-	//return my_atoi(rdbuf);
-	//printf("rdbuf is :%c\n.",rdbuf);
-	//printf("ChessMan is :%c\n.",chessMan);
-	char s = chessMan;
-	chessMan = 'n';
-	return s;
+	char ch;
+	int once = !game_raw;
+
+	if (once) {
+		raw_begin(fd_stdin);
+		if (!game_raw)
+			return 'n';
+	}
+
+	int r = read(fd_stdin, &ch, 1);
+
+	if (once)
+		raw_end(fd_stdin);
+
+	return r == 1 ? ch : 'n';
 }
 
 
@@ -1881,6 +2204,7 @@ void Gameplay(int fd_stdin)
 	int i, j, g, e, a, b[4];
 	appear();
 	appear();
+	raw_begin(fd_stdin);
 	while (1)
 	{
 		key = getch(fd_stdin);
@@ -2065,6 +2389,7 @@ void Gameplay(int fd_stdin)
 		gamefaile(fd_stdin);
 	else
 		gamewin(fd_stdin);
+	raw_end(fd_stdin);
 }
 void menu(int fd_stdin)
 {
@@ -2151,12 +2476,14 @@ int box_map[8][8] = {
 
 void Sokoban(int fd_stdin)
 {
+	raw_begin(fd_stdin);
 	while (!check() && !SokobanGame) {
 		clrscr();
 		draw_box_map();
 		sleep(3);
 		box_move(fd_stdin);
 	}
+	raw_end(fd_stdin);
 }
 
 void draw_box_map()
@@ -15,41 +15,240 @@
 #include "fs.h"
 #include "proc.h"
 #include "global.h"
+#include "smp.h"
 #include "proto.h"
 
+PRIVATE struct proc * rr_schedule(struct cpu * c);
+PRIVATE struct proc * mlfq_schedule(struct cpu * c);
+PRIVATE struct proc * stride_schedule(struct cpu * c);
+PRIVATE int  runnable_on(struct proc * p, struct cpu * c);
 PRIVATE void block(struct proc* p);
 PRIVATE void unblock(struct proc* p);
 PRIVATE int  msg_send(struct proc* current, int dest, MESSAGE* m);
 PRIVATE int  msg_receive(struct proc* current, int src, MESSAGE* m);
+PRIVATE int  msg_notify(struct proc* current, int dest, u32 bits);
+PRIVATE int  mailbox_put(struct proc* p_dest, int src, MESSAGE* m);
+PRIVATE int  mailbox_get(struct proc* p_who_wanna_recv, int src, MESSAGE* m);
 PRIVATE int  deadlock(int src, int dest);
 
+PRIVATE int  mlfq_last_boost;	/* `ticks' of the last MLFQ boost */
+PRIVATE u64  stride_pass;	/* pass of the last proc stride picked */
+
 /*****************************************************************************
  *                                schedule
  *****************************************************************************/
 /**
- * <Ring 0> Choose one proc to run.
+ * <Ring 0> Choose one proc for this processor to run. If none is runnable,
+ * IDLE is chosen on the BSP, and an AP runs none.
  * 
  *****************************************************************************/
 PUBLIC void schedule()
+{
+	struct cpu *	c = this_cpu();
+	struct proc *	p;
+
+	if (schedule_flag == MLFQ_SCHEDULE)
+		p = mlfq_schedule(c);
+	else if (schedule_flag == STRIDE_SCHEDULE)
+		p = stride_schedule(c);
+	else
+		p = rr_schedule(c);
+
+	if (!p && c->bsp)
+		p = &proc_table[IDLE];
+
+	set_proc_ready(p);
+}
+
+/*****************************************************************************
+ *                                set_proc_ready
+ *****************************************************************************/
+/**
+ * <Ring 0> Make a proc the one this processor runs when it leaves the
+ * kernel, and the one it ran free for the others.
+ * 
+ * @param p  The proc, 0 for none.
+ *****************************************************************************/
+PUBLIC void set_proc_ready(struct proc * p)
+{
+	struct cpu * c = this_cpu();
+
+	if (c->proc)
+		c->proc->p_cpu = 0;
+	c->proc = p;
+	if (p)
+		p->p_cpu = c;
+}
+
+/*****************************************************************************
+ *                                runnable_on
+ *****************************************************************************/
+/**
+ * <Ring 0> Whether a processor may pick a proc: the proc is runnable and not
+ * running on another processor. Tasks and IDLE are kept on the BSP (see
+ * smp.c).
+ * 
+ * @param p  The proc.
+ * @param c  The processor.
+ * 
+ * @return Non-zero if it may.
+ *****************************************************************************/
+PRIVATE int runnable_on(struct proc * p, struct cpu * c)
+{
+	if (p->p_flags != 0 || (p->p_cpu && p->p_cpu != c))
+		return 0;
+
+	return c->bsp || (p >= &proc_table[NR_TASKS] &&
+			  p != &proc_table[IDLE]);
+}
+
+/*****************************************************************************
+ *                                rr_schedule
+ *****************************************************************************/
+/**
+ * <Ring 0> schedule() of RR_SCHEDULE: the proc with the most ticks left
+ * runs, and all get their priority back as ticks when none has any.
+ * 
+ * @param c  The processor it is for.
+ * 
+ * @return The proc, 0 if none is runnable.
+ *****************************************************************************/
+PRIVATE struct proc * rr_schedule(struct cpu * c)
 {
 	struct proc*	p;
+	struct proc*	best = 0;
 	int		greatest_ticks = 0;
+	int		runnable = 0;
 
 	while (!greatest_ticks) {
 		for (p = &FIRST_PROC; p <= &LAST_PROC; p++) {
-			if (p->p_flags == 0) {
+			if (runnable_on(p, c) && p != &proc_table[IDLE]) {
+				runnable = 1;
 				if (p->ticks > greatest_ticks) {
 					greatest_ticks = p->ticks;
-					p_proc_ready = p;
+					best = p;
 				}
 			}
 		}
 
+		if (!runnable)
+			return 0;
+
 		if (!greatest_ticks)
 			for (p = &FIRST_PROC; p <= &LAST_PROC; p++)
 				if (p->p_flags == 0)
 					p->ticks = p->priority;
 	}
+
+	return best;
+}
+
+/*****************************************************************************
+ *                                mlfq_schedule
+ *****************************************************************************/
+/**
+ * <Ring 0> schedule() of MLFQ_SCHEDULE, called by clock_handler() every tick.
+ *
+ *   - The proc of the highest level runs, round robin within a level.
+ *   - A proc that has used up MLFQ_QUANTUM of its level drops a level. One
+ *     that blocks before keeps its level and what is left of its quantum,
+ *     so CPU-bound procs sink and the ones waiting on I/O stay on top.
+ *   - Every MLFQ_BOOST_TICKS all procs go back to level 0, so that the
+ *     sunk ones are not starved.
+ * 
+ * @param c  The processor it is for.
+ * 
+ * @return The proc, 0 if none is runnable.
+ *****************************************************************************/
+PRIVATE struct proc * mlfq_schedule(struct cpu * c)
+{
+	struct proc *	cur = c->proc;
+	struct proc *	idle = &proc_table[IDLE];
+	struct proc *	p;
+	struct proc *	best = 0;
+	int		k;
+
+	if (ticks - mlfq_last_boost >= MLFQ_BOOST_TICKS || ticks < mlfq_last_boost) {
+		for (p = &FIRST_PROC; p <= &LAST_PROC; p++) {
+			p->p_level = 0;
+			p->ticks = MLFQ_QUANTUM(0);
+		}
+		mlfq_last_boost = ticks;
+	}
+
+	if (!cur)	/* an idle AP */
+		cur = idle;
+
+	if (cur != idle && cur->ticks == 0) {
+		if (cur->p_level < NR_MLFQ_LEVELS - 1)
+			cur->p_level++;
+		cur->ticks = MLFQ_QUANTUM(cur->p_level);
+	}
+
+	/* look at the others, starting from the one after cur */
+	for (k = 1; k < NR_TASKS + NR_PROCS; k++) {
+		p = proc_table + (proc2pid(cur) + k) % (NR_TASKS + NR_PROCS);
+		if (runnable_on(p, c) && p != idle &&
+		    (!best || p->p_level < best->p_level))
+			best = p;
+	}
+
+	if (runnable_on(cur, c) && cur != idle &&
+	    (!best || cur->p_level < best->p_level ||
+	     (cur->p_level == best->p_level &&
+	      cur->ticks < MLFQ_QUANTUM(cur->p_level))))
+		best = cur;	/* in the middle of its quantum */
+
+	return best;
+}
+
+/*****************************************************************************
+ *                                stride_tick
+ *****************************************************************************/
+/**
+ * <Ring 0> Charge a tick to the proc running under STRIDE_SCHEDULE.
+ * 
+ * @param p  The proc.
+ *****************************************************************************/
+PUBLIC void stride_tick(struct proc * p)
+{
+	p->p_pass += STRIDE1 / max(p->priority, 1);
+}
+
+/*****************************************************************************
+ *                                stride_schedule
+ *****************************************************************************/
+/**
+ * <Ring 0> schedule() of STRIDE_SCHEDULE, called by clock_handler() every
+ * tick. The runnable proc of the smallest pass runs, and each tick it runs
+ * adds STRIDE1 / priority to its pass, so procs get CPU in proportion to
+ * their priorities.
+ *
+ * A proc that has been blocked comes back with the pass of the latest
+ * pick: it must not make up for the time it did not want the CPU.
+ * 
+ * @param c  The processor it is for.
+ * 
+ * @return The proc, 0 if none is runnable.
+ *****************************************************************************/
+PRIVATE struct proc * stride_schedule(struct cpu * c)
+{
+	struct proc *	p;
+	struct proc *	best = 0;
+
+	for (p = &FIRST_PROC; p <= &LAST_PROC; p++) {
+		if (!runnable_on(p, c) || p == &proc_table[IDLE])
+			continue;
+		if (p->p_pass < stride_pass)
+			p->p_pass = stride_pass;
+		if (!best || p->p_pass < best->p_pass)
+			best = p;
+	}
+
+	if (best)
+		stride_pass = best->p_pass;
+
+	return best;
 }
 
 /*****************************************************************************
@@ -58,7 +257,7 @@ PUBLIC void schedule()
 /**
  * <Ring 0> The core routine of system call `sendrec()'.
  * 
- * @param function SEND or RECEIVE
+ * @param function SEND, RECEIVE or NOTIFY
  * @param src_dest To/From whom the message is transferred.
  * @param m        Ptr to the MESSAGE body.
  * @param p        The caller proc.
@@ -67,10 +266,11 @@ PUBLIC void schedule()
  *****************************************************************************/
 PUBLIC int sys_sendrec(int function, int src_dest, MESSAGE* m, struct proc* p)
 {
-	assert(k_reenter == 0);	/* make sure we are not in ring0 */
+	assert(this_cpu()->reenter == 0);	/* make sure we are not in ring0 */
 	assert((src_dest >= 0 && src_dest < NR_TASKS + NR_PROCS) ||
 	       src_dest == ANY ||
-	       src_dest == INTERRUPT);
+	       src_dest == INTERRUPT ||
+	       src_dest == NOTIFICATION);
 
 	int ret = 0;
 	int caller = proc2pid(p);
@@ -95,9 +295,15 @@ PUBLIC int sys_sendrec(int function, int src_dest, MESSAGE* m, struct proc* p)
 		if (ret != 0)
 			return ret;
 	}
+	else if (function == NOTIFY) {
+		ret = msg_notify(p, src_dest, mla->NOTIFY_BITS);
+		if (ret != 0)
+			return ret;
+	}
 	else {
 		panic("{sys_sendrec} invalid function: "
-		      "%d (SEND:%d, RECEIVE:%d).", function, SEND, RECEIVE);
+		      "%d (SEND:%d, RECEIVE:%d, NOTIFY:%d).",
+		      function, SEND, RECEIVE, NOTIFY);
 	}
 
 	return 0;
@@ -182,14 +388,18 @@ PRIVATE void block(struct proc* p)
  *                                unblock
  *****************************************************************************/
 /**
- * <Ring 0> This is a dummy routine. It does nothing actually. When it is
- * called, the `p_flags' should have been cleared (== 0).
+ * <Ring 0> When it is called, the `p_flags' should have been cleared (== 0).
+ * A task runs on the BSP only: if an AP has unblocked it, the BSP may be
+ * halted, and is woken up.
  * 
  * @param p The unblocked proc.
  *****************************************************************************/
 PRIVATE void unblock(struct proc* p)
 {
 	assert(p->p_flags == 0);
+
+	if (p < &proc_table[NR_TASKS] && !this_cpu()->bsp)
+		kick_bsp();
 }
 
 /*****************************************************************************
@@ -239,14 +449,19 @@ PRIVATE int deadlock(int src, int dest)
  *****************************************************************************/
 /**
  * <Ring 0> Send a message to the dest proc. If dest is blocked waiting for
- * the message, copy the message to it and unblock dest. Otherwise the caller
- * will be blocked and appended to the dest's sending queue.
+ * the message, copy the message to it and unblock dest. If dest has a
+ * mailbox with room in it, the message is queued there and the caller goes
+ * on. Otherwise the caller will be blocked and appended to the dest's
+ * sending queue.
+ *
+ * Only a caller that is to be blocked can be part of a deadlock. If dest has
+ * a mailbox, such a message is dropped instead of panicking.
  * 
  * @param current  The caller, the sender.
  * @param dest     To whom the message is sent.
  * @param m        The message.
  * 
- * @return Zero if success.
+ * @return Zero if success, -1 if the message is dropped.
  *****************************************************************************/
 PRIVATE int msg_send(struct proc* current, int dest, MESSAGE* m)
 {
@@ -255,11 +470,6 @@ PRIVATE int msg_send(struct proc* current, int dest, MESSAGE* m)
 
 	assert(proc2pid(sender) != dest);
 
-	/* check for deadlock here */
-	if (deadlock(proc2pid(sender), dest)) {
-		panic(">>DEADLOCK<< %s->%s", sender->name, p_dest->name);
-	}
-
 	if ((p_dest->p_flags & RECEIVING) && /* dest is waiting for the msg */
 	    (p_dest->p_recvfrom == proc2pid(sender) ||
 	     p_dest->p_recvfrom == ANY)) {
@@ -283,7 +493,21 @@ PRIVATE int msg_send(struct proc* current, int dest, MESSAGE* m)
 		assert(sender->p_recvfrom == NO_TASK);
 		assert(sender->p_sendto == NO_TASK);
 	}
+	else if (mailbox_put(p_dest, proc2pid(sender), m) == 0) {
+		/* queued, the sender goes on */
+	}
 	else { /* dest is not waiting for the msg */
+		/* check for deadlock here */
+		if (deadlock(proc2pid(sender), dest)) {
+			if (p_dest->p_mailbox) {
+				p_dest->p_mailbox->nr_dropped++;
+				return -1;
+			}
+			panic(">>DEADLOCK<< %s->%s", sender->name, p_dest->name);
+		}
+		if (p_dest->p_mailbox)
+			p_dest->p_mailbox->nr_full++;
+
 		sender->p_flags |= SENDING;
 		assert(sender->p_flags == SENDING);
 		sender->p_sendto = dest;
@@ -321,6 +545,10 @@ PRIVATE int msg_send(struct proc* current, int dest, MESSAGE* m)
  * <Ring 0> Try to get a message from the src proc. If src is blocked sending
  * the message, copy the message from it and unblock src. Otherwise the caller
  * will be blocked.
+ *
+ * Pending interrupts come first, then the bits notify() has set (for src
+ * being ANY or NOTIFICATION), then the mailbox, then the procs in the
+ * sending queue.
  * 
  * @param current The caller, the proc who wanna receive.
  * @param src     From whom the message will be received.
@@ -367,6 +595,26 @@ PRIVATE int msg_receive(struct proc* current, int src, MESSAGE* m)
 	}
 
 
+	if (p_who_wanna_recv->notify_pending &&
+	    ((src == ANY) || (src == NOTIFICATION))) {
+		MESSAGE msg;
+		reset_msg(&msg);
+		msg.source = NOTIFICATION;
+		msg.type = NOTIFY_MSG;
+		msg.NOTIFY_BITS = p_who_wanna_recv->notify_pending;
+		assert(m);
+		phys_copy(va2la(proc2pid(p_who_wanna_recv), m), &msg,
+			  sizeof(MESSAGE));
+
+		p_who_wanna_recv->notify_pending = 0;
+
+		return 0;
+	}
+
+	if (mailbox_get(p_who_wanna_recv, src, m) == 0)
+		return 0;
+
+
 	/* Arrives here if no interrupt for p_who_wanna_recv. */
 	if (src == ANY) {
 		/* p_who_wanna_recv is ready to receive messages from
@@ -388,7 +636,7 @@ PRIVATE int msg_receive(struct proc* current, int src, MESSAGE* m)
 			assert(p_from->p_sendto == proc2pid(p_who_wanna_recv));
 		}
 	}
-	else {
+	else if (src != INTERRUPT && src != NOTIFICATION) {
 		/* p_who_wanna_recv wants to receive a message from
 		 * a certain proc: src.
 		 */
@@ -464,10 +712,7 @@ PRIVATE int msg_receive(struct proc* current, int src, MESSAGE* m)
 
 		p_who_wanna_recv->p_msg = m;
 
-		if (src == ANY)
-			p_who_wanna_recv->p_recvfrom = ANY;
-		else
-			p_who_wanna_recv->p_recvfrom = proc2pid(p_from);
+		p_who_wanna_recv->p_recvfrom = src;
 
 		block(p_who_wanna_recv);
 
@@ -481,6 +726,145 @@ PRIVATE int msg_receive(struct proc* current, int src, MESSAGE* m)
 	return 0;
 }
 
+/*****************************************************************************
+ *                                mailbox_put
+ *****************************************************************************/
+/**
+ * <Ring 0> Queue a message in the mailbox of dest.
+ * 
+ * @param p_dest  To whom the message is sent.
+ * @param src     Who sends it.
+ * @param m       The message, in the address space of src.
+ * 
+ * @return Zero if it is queued, -1 if dest has no mailbox or it is full.
+ *****************************************************************************/
+PRIVATE int mailbox_put(struct proc* p_dest, int src, MESSAGE* m)
+{
+	struct mailbox * mb = p_dest->p_mailbox;
+
+	if (!mb || mb->count == MAILBOX_SIZE)
+		return -1;
+
+	phys_copy(&mb->slot[(mb->head + mb->count) % MAILBOX_SIZE],
+		  va2la(src, m),
+		  sizeof(MESSAGE));
+	mb->count++;
+	mb->nr_queued++;
+	mb->high_water = max(mb->high_water, mb->count);
+
+	return 0;
+}
+
+/*****************************************************************************
+ *                                mailbox_get
+ *****************************************************************************/
+/**
+ * <Ring 0> Take the oldest message from src out of the mailbox of the
+ * receiver. The room it leaves is given to the 1st proc blocked sending to
+ * the receiver, which then goes on.
+ * 
+ * @param p_who_wanna_recv  The receiver.
+ * @param src               ANY, or from whom.
+ * @param m                 Where the message goes, in the receiver's
+ *                          address space.
+ * 
+ * @return Zero if a message is taken, -1 if there is none.
+ *****************************************************************************/
+PRIVATE int mailbox_get(struct proc* p_who_wanna_recv, int src, MESSAGE* m)
+{
+	struct mailbox * mb = p_who_wanna_recv->p_mailbox;
+
+	if (!mb || src == INTERRUPT || src == NOTIFICATION)
+		return -1;
+
+	int i;
+	for (i = 0; i < mb->count; i++)
+		if (src == ANY ||
+		    mb->slot[(mb->head + i) % MAILBOX_SIZE].source == src)
+			break;
+	if (i == mb->count)
+		return -1;
+
+	phys_copy(va2la(proc2pid(p_who_wanna_recv), m),
+		  &mb->slot[(mb->head + i) % MAILBOX_SIZE],
+		  sizeof(MESSAGE));
+
+	/* close the gap by moving the older ones up */
+	for (; i > 0; i--)
+		phys_copy(&mb->slot[(mb->head + i) % MAILBOX_SIZE],
+			  &mb->slot[(mb->head + i - 1) % MAILBOX_SIZE],
+			  sizeof(MESSAGE));
+	mb->head = (mb->head + 1) % MAILBOX_SIZE;
+	mb->count--;
+
+	struct proc* p_from = p_who_wanna_recv->q_sending;
+	if (p_from) {
+		assert(p_from->p_flags == SENDING);
+		mailbox_put(p_who_wanna_recv, proc2pid(p_from), p_from->p_msg);
+
+		p_who_wanna_recv->q_sending = p_from->next_sending;
+		p_from->next_sending = 0;
+		p_from->p_msg = 0;
+		p_from->p_sendto = NO_TASK;
+		p_from->p_flags &= ~SENDING;
+		unblock(p_from);
+	}
+
+	return 0;
+}
+
+/*****************************************************************************
+ *                                msg_notify
+ *****************************************************************************/
+/**
+ * <Ring 0> Set bits at dest without blocking the caller. If dest is waiting
+ * for them, it gets NOTIFY_MSG right away; otherwise the bits add up in
+ * notify_pending until its next RECEIVE from ANY or NOTIFICATION.
+ *
+ * As nobody ever waits for a notification to be taken, it can not be part
+ * of a deadlock, and deadlock() is not consulted.
+ * 
+ * @param current  The caller, the proc who notifies.
+ * @param dest     Whom to notify.
+ * @param bits     The bits, their meaning is up to dest.
+ * 
+ * @return Zero if success.
+ *****************************************************************************/
+PRIVATE int msg_notify(struct proc* current, int dest, u32 bits)
+{
+	assert(dest >= 0 && dest < NR_TASKS + NR_PROCS);
+	assert(proc2pid(current) != dest);
+
+	struct proc* p_dest = proc_table + dest;
+
+	p_dest->notify_pending |= bits;
+	if (!p_dest->notify_pending)
+		return 0;
+
+	if ((p_dest->p_flags & RECEIVING) && /* dest is waiting for it */
+	    ((p_dest->p_recvfrom == NOTIFICATION) ||
+	     (p_dest->p_recvfrom == ANY))) {
+		MESSAGE msg;
+		reset_msg(&msg);
+		msg.source = NOTIFICATION;
+		msg.type = NOTIFY_MSG;
+		msg.NOTIFY_BITS = p_dest->notify_pending;
+		assert(p_dest->p_msg);
+		phys_copy(va2la(dest, p_dest->p_msg), &msg, sizeof(MESSAGE));
+
+		p_dest->notify_pending = 0;
+		p_dest->p_msg = 0;
+		p_dest->p_flags &= ~RECEIVING;
+		p_dest->p_recvfrom = NO_TASK;
+		unblock(p_dest);
+
+		assert(p_dest->p_flags == 0);
+		assert(p_dest->p_sendto == NO_TASK);
+	}
+
+	return 0;
+}
+
 /*****************************************************************************
  *                                inform_int
  *****************************************************************************/
@@ -555,6 +939,7 @@ PUBLIC void dump_proc(struct proc* p)
 	/* sprintf(info, "nr_tty: 0x%x.  ", p->nr_tty); disp_color_str(info, text_color); */
 	disp_color_str("\n", text_color);
 	sprintf(info, "has_int_msg: 0x%x.  ", p->has_int_msg); disp_color_str(info, text_color);
+	sprintf(info, "notify_pending: 0x%x.  ", p->notify_pending); disp_color_str(info, text_color);
 }
 
 
@@ -15,6 +15,7 @@
 #include "proc.h"
 #include "string.h"
 #include "global.h"
+#include "smp.h"
 #include "proto.h"
 
 
@@ -55,6 +56,9 @@ void	hwint12();
 void	hwint13();
 void	hwint14();
 void	hwint15();
+void	ap_tick();
+void	resched();
+void	apic_spurious();
 
 
 /*======================================================================*
@@ -166,17 +170,30 @@ PUBLIC void init_prot()
 	init_idt_desc(INT_VECTOR_SYS_CALL,	DA_386IGate,
 		      sys_call,			PRIVILEGE_USER);
 
-	/* Fill the TSS descriptor in GDT */
-	memset(&tss, 0, sizeof(tss));
-	tss.ss0	= SELECTOR_KERNEL_DS;
-	init_desc(&gdt[INDEX_TSS],
-		  makelinear(SELECTOR_KERNEL_DS, &tss),
-		  sizeof(tss) - 1,
-		  DA_386TSS);
-	tss.iobase = sizeof(tss); /* No IO permission bitmap */
+	init_idt_desc(INT_VECTOR_AP_TICK,	DA_386IGate,
+		      ap_tick,			PRIVILEGE_KRNL);
 
-	/* Fill the LDT descriptors of each proc in GDT  */
+	init_idt_desc(INT_VECTOR_RESCHED,	DA_386IGate,
+		      resched,			PRIVILEGE_KRNL);
+
+	init_idt_desc(INT_VECTOR_SPURIOUS,	DA_386IGate,
+		      apic_spurious,		PRIVILEGE_KRNL);
+
+	/* Fill the TSS descriptors in GDT, one for each processor */
 	int i;
+	for (i = 0; i < NR_CPUS; i++) {
+		struct tss * tss = &cpu_table[i].tss;
+		memset(tss, 0, sizeof(struct tss));
+		tss->ss0 = SELECTOR_KERNEL_DS;
+		assert(INDEX_TSS + i < INDEX_LDT_FIRST);
+		init_desc(&gdt[INDEX_TSS + i],
+			  makelinear(SELECTOR_KERNEL_DS, tss),
+			  sizeof(struct tss) - 1,
+			  DA_386TSS);
+		tss->iobase = sizeof(struct tss); /* No IO permission bitmap */
+	}
+
+	/* Fill the LDT descriptors of each proc in GDT  */
 	for (i = 0; i < NR_TASKS + NR_PROCS; i++) {
 		memset(&proc_table[i], 0, sizeof(struct proc));
 
@@ -0,0 +1,294 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   serial.c
+ * @brief  16550 UART driver of COM1, the line behind /dev_ttyS0.
+ *
+ * Both directions are interrupt driven and go through a ring buffer:
+ *   - serial_handler() empties the RX FIFO into ser_in and wakes TTY up,
+ *     serial_read() hands the chars to the TTY as keyboard_read() does.
+ *   - serial_write() queues chars in ser_out and starts the transmitter,
+ *     then serial_handler() refills the TX FIFO, 16 bytes a time, every
+ *     time it runs empty.
+ *
+ * serial_write() is called by TTY and, through sys_printx(), by anyone who
+ * prints, so it runs with interrupts disabled.
+ *
+ * @author Forrest Y. Yu
+ * @date   2008
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "keyboard.h"
+#include "proto.h"
+
+#define SERIAL_IN_BYTES		256	/* serial input queue size */
+#define SERIAL_OUT_BYTES	4096	/* serial output queue size */
+
+/**
+ * @struct ser_ring
+ * @brief  A ring buffer of serial chars.
+ */
+struct ser_ring {
+	int	head;		/**< Index of the 1st char */
+	int	count;		/**< How many chars */
+};
+
+PRIVATE u8		ser_in_buf[SERIAL_IN_BYTES];
+PRIVATE u8		ser_out_buf[SERIAL_OUT_BYTES];
+PRIVATE struct ser_ring	ser_in;
+PRIVATE struct ser_ring	ser_out;
+PRIVATE int		ser_tx_busy;	/* THRE int enabled, TX FIFO busy */
+PRIVATE int		ser_ready;	/* init_serial() has been called */
+
+PRIVATE void	serial_put	(u8 ch);
+PRIVATE void	serial_tx_fill	();
+PRIVATE void	serial_putc_sync(u8 ch);
+
+
+/*****************************************************************************
+ *                                init_serial
+ *****************************************************************************/
+/**
+ * <Ring 0> Program COM1 to SERIAL_BAUD 8N1 with FIFOs on, and set the
+ * interrupt handler.
+ *****************************************************************************/
+PUBLIC void init_serial()
+{
+	int divisor = UART_CLOCK / SERIAL_BAUD;
+
+	ser_in.head = ser_in.count = 0;
+	ser_out.head = ser_out.count = 0;
+	ser_tx_busy = 0;
+
+	out_byte(UART_IER, 0);
+	out_byte(UART_LCR, LCR_DLAB);
+	out_byte(UART_DLL, (u8)divisor);
+	out_byte(UART_DLM, (u8)(divisor >> 8));
+	out_byte(UART_LCR, LCR_8N1);
+	out_byte(UART_FCR, FCR_ENABLE);
+	out_byte(UART_MCR, MCR_DTR_RTS_OUT2);
+
+	/* drop whatever is pending */
+	in_byte(UART_LSR);
+	in_byte(UART_RBR);
+	in_byte(UART_IIR);
+	in_byte(UART_MSR);
+
+	out_byte(UART_IER, IER_RDA);
+
+	put_irq_handler(RS232_IRQ, serial_handler);
+	enable_irq(RS232_IRQ);
+
+	ser_ready = 1;
+}
+
+
+/*****************************************************************************
+ *                                serial_handler
+ *****************************************************************************/
+/**
+ * <Ring 0> Handles the interrupts of COM1: receive data, refill the TX FIFO.
+ *
+ * @param irq  RS232_IRQ, unused here.
+ *****************************************************************************/
+PUBLIC void serial_handler(int irq)
+{
+	int got = 0;
+
+	do {
+		while (in_byte(UART_LSR) & LSR_DR) {
+			u8 ch = in_byte(UART_RBR);
+			if (ser_in.count < SERIAL_IN_BYTES) {
+				ser_in_buf[(ser_in.head + ser_in.count) %
+					   SERIAL_IN_BYTES] = ch;
+				ser_in.count++;
+			}
+			got = 1;
+		}
+
+		if (ser_tx_busy && (in_byte(UART_LSR) & LSR_THRE))
+			serial_tx_fill();
+
+		in_byte(UART_MSR);
+	} while (!(in_byte(UART_IIR) & IIR_NO_INT));
+
+	if (got)
+		defer_inform(TASK_TTY);
+}
+
+
+/*****************************************************************************
+ *                                serial_read
+ *****************************************************************************/
+/**
+ * <Ring 1> Hand the chars received to the TTY of the serial line. The
+ * terminal on the other end sends CR for Enter and DEL for Backspace.
+ *
+ * @param tty  The serial TTY.
+ *****************************************************************************/
+PUBLIC void serial_read(TTY* tty)
+{
+	while (ser_in.count > 0) {
+		disable_int();
+		u8 ch = ser_in_buf[ser_in.head];
+		ser_in.head = (ser_in.head + 1) % SERIAL_IN_BYTES;
+		ser_in.count--;
+		enable_int();
+
+		if (ch == '\r')
+			ch = '\n';
+		else if (ch == 0x7F)
+			ch = '\b';
+		in_process(tty, ch);
+	}
+}
+
+
+/*****************************************************************************
+ *                                serial_write
+ *****************************************************************************/
+/**
+ * Queue chars to be sent. They are rendered the way the console renders
+ * them: `\n' starts a new line, `\b' erases the last char.
+ *
+ * If the queue is full, chars are pushed out by polling until there is room,
+ * so nothing printed is ever lost.
+ *
+ * @param buf  The chars.
+ * @param len  How many.
+ *****************************************************************************/
+PUBLIC void serial_write(const char * buf, int len)
+{
+	if (!ser_ready)
+		return;
+
+	disable_int();
+
+	const char * p;
+	for (p = buf; p < buf + len; p++) {
+		switch (*p) {
+		case '\n':
+			serial_put('\r');
+			serial_put('\n');
+			break;
+		case '\b':
+			serial_put('\b');
+			serial_put(' ');
+			serial_put('\b');
+			break;
+		default:
+			serial_put(*p);
+			break;
+		}
+	}
+
+	if (!ser_tx_busy && (in_byte(UART_LSR) & LSR_THRE))
+		serial_tx_fill();
+
+	enable_int();
+}
+
+
+/*****************************************************************************
+ *                                serial_puts_sync
+ *****************************************************************************/
+/**
+ * <Ring 0> Send the chars queued and then a string by polling, without
+ * interrupts. For panic() only: the system is going to halt.
+ *
+ * @param s  The string.
+ *****************************************************************************/
+PUBLIC void serial_puts_sync(const char * s)
+{
+	if (!ser_ready)
+		return;
+
+	out_byte(UART_IER, 0);
+
+	while (ser_out.count) {
+		serial_putc_sync(ser_out_buf[ser_out.head]);
+		ser_out.head = (ser_out.head + 1) % SERIAL_OUT_BYTES;
+		ser_out.count--;
+	}
+
+	for (; *s; s++) {
+		if (*s == '\n')
+			serial_putc_sync('\r');
+		serial_putc_sync(*s);
+	}
+}
+
+
+/*****************************************************************************
+ *                                serial_put
+ *****************************************************************************/
+/**
+ * Put a char into the output queue, interrupts being disabled.
+ *
+ * @param ch  The char.
+ *****************************************************************************/
+PRIVATE void serial_put(u8 ch)
+{
+	if (ser_out.count == SERIAL_OUT_BYTES) {
+		/* full: make room by hand */
+		serial_putc_sync(ser_out_buf[ser_out.head]);
+		ser_out.head = (ser_out.head + 1) % SERIAL_OUT_BYTES;
+		ser_out.count--;
+	}
+
+	ser_out_buf[(ser_out.head + ser_out.count) % SERIAL_OUT_BYTES] = ch;
+	ser_out.count++;
+}
+
+
+/*****************************************************************************
+ *                                serial_tx_fill
+ *****************************************************************************/
+/**
+ * The TX FIFO is empty: fill it from the output queue, or turn the THRE
+ * interrupt off if there is nothing more to send.
+ *****************************************************************************/
+PRIVATE void serial_tx_fill()
+{
+	int n = min(ser_out.count, UART_FIFO_SIZE);
+
+	if (n == 0) {
+		out_byte(UART_IER, IER_RDA);
+		ser_tx_busy = 0;
+		return;
+	}
+
+	while (n--) {
+		out_byte(UART_THR, ser_out_buf[ser_out.head]);
+		ser_out.head = (ser_out.head + 1) % SERIAL_OUT_BYTES;
+		ser_out.count--;
+	}
+
+	out_byte(UART_IER, IER_RDA | IER_THRE);
+	ser_tx_busy = 1;
+}
+
+
+/*****************************************************************************
+ *                                serial_putc_sync
+ *****************************************************************************/
+/**
+ * Wait for the transmitter and send a char.
+ *
+ * @param ch  The char.
+ *****************************************************************************/
+PRIVATE void serial_putc_sync(u8 ch)
+{
+	while (!(in_byte(UART_LSR) & LSR_THRE)) {}
+	out_byte(UART_THR, ch);
+}
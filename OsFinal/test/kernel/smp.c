@@ -0,0 +1,457 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   smp.c
+ * @brief  Find the processors in the MP table, start the APs and have
+ *         them run procs.
+ *
+ * An AP is woken up by the INIT-SIPI-SIPI sequence through the local APIC,
+ * comes to ap_main() by way of smpboot.asm and reports itself online. When
+ * kernel_main() is done, run_aps() lets it go on to run procs.
+ *
+ * Each processor has its own struct cpu: the proc it runs (what
+ * p_proc_ready was), k_reenter, kernel stack and TSS. The kernel itself is
+ * not made parallel: a big kernel lock (BKL, kernel.asm) lets one
+ * processor at a time in, from the outermost save() to restart(), so the
+ * IPC and the schedulers still run alone. The procs run in parallel.
+ *
+ * The IRQs all go to the BSP (cpu_table[0]), and the tasks and IDLE run on
+ * it only: a task disables interrupts to keep the interrupt handlers off
+ * what they share, and that does not stop another processor. The user
+ * procs run on any processor. An AP has no timer: the BSP passes each of
+ * its ticks on to the APs as an IPI (tick_aps()), and keeps ticking while
+ * they run. An AP that makes a task runnable wakes the BSP up with another
+ * IPI (kick_bsp()), so the task does not wait for the next tick.
+ *
+ * There is one proc_table for all: every processor picks from it under
+ * the BKL, and a proc is taken by one processor at a time (p_cpu). An AP
+ * with nothing to run halts till the next tick.
+ *
+ * The APICs and the ISA IRQ wiring found here are used by apic.c.
+ *
+ * @author Forrest Y. Yu
+ * @date   2008
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "smp.h"
+#include "proto.h"
+
+/* in smpboot.asm */
+extern	char	ap_trampoline[];
+extern	char	ap_tramp_gdt[];
+extern	char	ap_trampoline_end[];
+
+/* in kernel.asm */
+extern	char	StackTop[];
+
+PUBLIC	u32		ap_stack_top;	/* stack of the AP being started */
+PUBLIC	u32		lapic_addr;
+PUBLIC	u32		ioapic_addr;
+PUBLIC	u8		isa_irq_pin[NR_IRQ];
+PUBLIC	int		imcr_present;
+PUBLIC	struct cpu	cpu_table[NR_CPUS];	/* [0]: the BSP */
+PUBLIC	int		nr_aps;
+
+PRIVATE	int		nr_cpus;
+PRIVATE	char		ap_stacks[NR_CPUS - 1][KSTACK_SIZE];
+PRIVATE	volatile int	aps_go;	/* set by run_aps() */
+
+PRIVATE struct mp_conf *	mp_search();
+PRIVATE struct mp_fp *		mp_scan(u32 addr, int len);
+PRIVATE int			mp_sum(void * p, int len);
+PRIVATE void			start_ap(struct cpu * c);
+PRIVATE void			lapic_ipi(int apic_id, u32 icr);
+PRIVATE void			lapic_on();
+
+
+/*****************************************************************************
+ *                                init_smp
+ *****************************************************************************/
+/**
+ * <Ring 0> Read the processors, the APICs and the ISA IRQ wiring from the MP
+ * table, and start the APs. With no MP table, the system is a uniprocessor
+ * one with the 8259A only.
+ *
+ * The TSC must have been calibrated (by init_clock()) for udelay().
+ * The APs are left waiting for run_aps().
+ *
+ * @return How many processors are online.
+ *****************************************************************************/
+PUBLIC int init_smp()
+{
+	struct mp_conf * mc = mp_search();
+	int i;
+
+	assert(sizeof(struct cpu) == CPU_SIZE);
+
+	/* the BSP has loaded the TSS of cpu_table[0] in _start */
+	nr_cpus = 1;
+	cpu_table[0].bsp = 1;
+	cpu_table[0].online = 1;
+	cpu_table[0].stack_top = (u32)StackTop;
+
+	for (i = 0; i < NR_IRQ; i++)
+		isa_irq_pin[i] = i;
+
+	if (!mc)
+		return 1;
+
+	lapic_addr = mc->lapic;
+
+	int isa_bus = -1;
+	u8 * e = (u8*)(mc + 1);
+	for (i = 0; i < mc->nr_entries; i++) {
+		if (*e == MP_PROCESSOR) {
+			struct mp_proc * mp = (struct mp_proc *)e;
+			if (mp->flags & MP_CPU_BSP)
+				cpu_table[0].apic_id = mp->apic_id;
+			else if ((mp->flags & MP_CPU_ENABLED) &&
+				 nr_cpus < NR_CPUS)
+				cpu_table[nr_cpus++].apic_id = mp->apic_id;
+			e += sizeof(struct mp_proc);
+			continue;
+		}
+
+		if (*e == MP_BUS) {
+			struct mp_bus * mb = (struct mp_bus *)e;
+			if (memcmp(mb->bus_type, "ISA", 3) == 0)
+				isa_bus = mb->bus_id;
+		}
+		else if (*e == MP_IOAPIC) {
+			struct mp_ioapic * mi = (struct mp_ioapic *)e;
+			if ((mi->flags & 1) && !ioapic_addr)
+				ioapic_addr = mi->addr;
+		}
+		else if (*e == MP_IOINTR) {
+			/* bus entries come first, isa_bus is known here */
+			struct mp_iointr * mi = (struct mp_iointr *)e;
+			if (mi->intr_type == MP_INTR_INT &&
+			    mi->src_bus == isa_bus && mi->src_irq < NR_IRQ)
+				isa_irq_pin[mi->src_irq] = mi->dst_pin;
+		}
+		e += sizeof(struct mp_ioapic);	/* all the others are 8 bytes */
+	}
+
+	map_apic(lapic_addr);
+	if (ioapic_addr)
+		map_apic(ioapic_addr);
+
+	if (nr_cpus == 1)
+		return 1;
+
+	lapic_eoi = lapic_addr + LAPIC_EOI;
+
+	/* virtual wire: the 8259A still comes in through LINT0 */
+	lapic_on();
+	lapic_write(LAPIC_LVT_LINT0, LVT_EXTINT);
+	lapic_write(LAPIC_LVT_LINT1, LVT_NMI);
+
+	memcpy((void*)AP_TRAMPOLINE, ap_trampoline,
+	       ap_trampoline_end - ap_trampoline);
+	memcpy((void*)(AP_TRAMPOLINE + (ap_tramp_gdt - ap_trampoline)),
+	       gdt_ptr, sizeof(gdt_ptr));
+
+	struct cpu * c;
+	for (c = &cpu_table[1]; c < &cpu_table[nr_cpus]; c++) {
+		start_ap(c);
+		if (c->online)
+			nr_aps++;
+	}
+
+	return nr_aps + 1;
+}
+
+
+/*****************************************************************************
+ *                                run_aps
+ *****************************************************************************/
+/**
+ * <Ring 0> Let the APs go on from ap_main(). kernel_main() calls it holding
+ * the BKL, right before restart(): the APs wait for the BKL till then.
+ *****************************************************************************/
+PUBLIC void run_aps()
+{
+	aps_go = 1;
+}
+
+
+/*****************************************************************************
+ *                                ap_main
+ *****************************************************************************/
+/**
+ * <Ring 0> Where an AP lands from smpboot.asm, with interrupts disabled and
+ * on its kernel stack. It loads its TSS, marks itself online, and waits for
+ * run_aps() to turn its local APIC on and schedule. The stack is started
+ * over by restart(), this never returns.
+ *****************************************************************************/
+PUBLIC void ap_main()
+{
+	int apic_id = lapic_read(LAPIC_ID) >> 24;
+
+	struct cpu * c = &cpu_table[1];
+	while (c->apic_id != apic_id && c < &cpu_table[nr_cpus - 1])
+		c++;
+
+	u16 tss_sel = (INDEX_TSS + (c - cpu_table)) << 3;
+	__asm__ __volatile__("ltr %0" : : "r" (tss_sel));
+	c->online = 1;
+
+	while (!aps_go) {}
+
+	/* the ticks from the BSP only, not the 8259A */
+	lapic_on();
+	lapic_write(LAPIC_LVT_LINT0, LVT_MASKED);
+
+	lock_kernel();
+	c->reenter = 0;
+	c->proc = 0;
+	schedule();
+	restart();
+}
+
+
+/*****************************************************************************
+ *                                this_cpu
+ *****************************************************************************/
+/**
+ * <Ring 0> The processor the caller runs on, found by the TSS it has
+ * loaded, the way kernel.asm does.
+ *
+ * @return Its struct cpu.
+ *****************************************************************************/
+PUBLIC struct cpu * this_cpu()
+{
+	u16 tss_sel;
+	__asm__ __volatile__("str %0" : "=r" (tss_sel));
+	return &cpu_table[(tss_sel >> 3) - INDEX_TSS];
+}
+
+
+/*****************************************************************************
+ *                                tick_aps
+ *****************************************************************************/
+/**
+ * <Ring 0> Pass a tick of the BSP on to the APs, which schedule on it (see
+ * ap_clock_handler()). Called by clock_handler().
+ *****************************************************************************/
+PUBLIC void tick_aps()
+{
+	if (!nr_aps || !aps_go)
+		return;
+
+	/* the last one may not have left yet */
+	while (lapic_read(LAPIC_ICR_LO) & ICR_PENDING) {}
+	lapic_write(LAPIC_ICR_LO,
+		    ICR_ALL_BUT_SELF | ICR_ASSERT | INT_VECTOR_AP_TICK);
+}
+
+
+/*****************************************************************************
+ *                                kick_bsp
+ *****************************************************************************/
+/**
+ * <Ring 0> Called on an AP that has just made a task runnable: the task can
+ * run on the BSP only, which may be halted in sys_halt(). Wake it up.
+ *****************************************************************************/
+PUBLIC void kick_bsp()
+{
+	lapic_ipi(cpu_table[0].apic_id, ICR_ASSERT | INT_VECTOR_RESCHED);
+}
+
+
+/*****************************************************************************
+ *                                resched_handler
+ *****************************************************************************/
+/**
+ * <Ring 0> kick_bsp() has come to the BSP: have it schedule on the way out
+ * (SOFTIRQ_SCHED) rather than at the end of the time slice. If it was
+ * halted, sys_halt() runs the softirq when it wakes up.
+ *****************************************************************************/
+PUBLIC void resched_handler()
+{
+	raise_softirq(SOFTIRQ_SCHED);
+}
+
+
+/*****************************************************************************
+ *                                start_ap
+ *****************************************************************************/
+/**
+ * <Ring 0> INIT, then STARTUP twice, the way the MP spec says; and wait for
+ * the AP to come online, 100ms at most.
+ *
+ * @param c  The AP.
+ *****************************************************************************/
+PRIVATE void start_ap(struct cpu * c)
+{
+	ap_stack_top = (u32)(ap_stacks[c - cpu_table - 1] + KSTACK_SIZE);
+	c->stack_top = ap_stack_top;
+
+	lapic_ipi(c->apic_id, ICR_INIT | ICR_ASSERT);
+	udelay(10000);
+
+	int i;
+	for (i = 0; i < 2; i++) {
+		lapic_ipi(c->apic_id,
+			  ICR_STARTUP | ICR_ASSERT | (AP_TRAMPOLINE >> 12));
+		udelay(200);
+	}
+
+	for (i = 0; i < 100 && !c->online; i++)
+		udelay(1000);
+}
+
+
+/*****************************************************************************
+ *                                lapic_ipi
+ *****************************************************************************/
+/**
+ * <Ring 0> Send an IPI and wait for it to be delivered.
+ *
+ * @param apic_id  To whom.
+ * @param icr      What, the low dword of the ICR.
+ *****************************************************************************/
+PRIVATE void lapic_ipi(int apic_id, u32 icr)
+{
+	lapic_write(LAPIC_ICR_HI, apic_id << 24);
+	lapic_write(LAPIC_ICR_LO, icr);
+	while (lapic_read(LAPIC_ICR_LO) & ICR_PENDING) {}
+}
+
+
+/*****************************************************************************
+ *                                lapic_on
+ *****************************************************************************/
+/**
+ * <Ring 0> Enable the local APIC of the processor calling, so that it takes
+ * IPIs.
+ *****************************************************************************/
+PRIVATE void lapic_on()
+{
+	lapic_write(LAPIC_SVR, SVR_ENABLE | INT_VECTOR_SPURIOUS);
+}
+
+
+/*****************************************************************************
+ *                                map_apic
+ *****************************************************************************/
+/**
+ * <Ring 0> Map the page of an APIC, uncached, at the same linear address.
+ *
+ * The LOADER has mapped the RAM only. The APICs are near 4GB, and their page
+ * table takes the 1st page after the ones of the RAM in the page table area.
+ *
+ * @param addr  Phys addr of the APIC.
+ *****************************************************************************/
+PUBLIC void map_apic(u32 addr)
+{
+	u32 * pde = (u32*)PAGE_DIR_BASE + (addr >> 22);
+
+	if (!(*pde & PG_P)) {
+		struct boot_params bp;
+		get_boot_params(&bp);
+
+		int nr_pdes = (bp.mem_size + 0x3FFFFF) >> 22;
+		u32 table = PAGE_TBL_BASE + nr_pdes * 0x1000;
+
+		memset((void*)table, 0, 0x1000);
+		*pde = table | PG_P | PG_RWW;
+	}
+
+	u32 * pte = (u32*)(*pde & 0xFFFFF000) + ((addr >> 12) & 0x3FF);
+	*pte = (addr & 0xFFFFF000) | PG_P | PG_RWW | PG_PCD | PG_PWT;
+
+	/* flush the TLB */
+	__asm__ __volatile__("mov %%cr3, %%eax\n\tmov %%eax, %%cr3"
+			     : : : "eax", "memory");
+}
+
+
+/*****************************************************************************
+ *                                mp_search
+ *****************************************************************************/
+/**
+ * <Ring 0> Look for the MP table where the spec says it may be: the 1st KB
+ * of the EBDA, the last KB of base memory, and the BIOS ROM.
+ *
+ * @return The MP configuration table, or 0 if there is none.
+ *****************************************************************************/
+PRIVATE struct mp_conf * mp_search()
+{
+	u32 ebda = *(u16*)0x40E << 4;
+	u32 base_kb = *(u16*)0x413;
+
+	struct mp_fp * fp = 0;
+	if (ebda)
+		fp = mp_scan(ebda, 1024);
+	if (!fp)
+		fp = mp_scan(base_kb * 1024 - 1024, 1024);
+	if (!fp)
+		fp = mp_scan(0xF0000, 0x10000);
+
+	if (!fp || !fp->config)	/* type != 0: a default config, no APs */
+		return 0;
+
+	imcr_present = fp->features[1] & 0x80;
+
+	struct mp_conf * mc = (struct mp_conf *)fp->config;
+	if (memcmp(mc->signature, "PCMP", 4) != 0 ||
+	    mp_sum(mc, mc->length) != 0)
+		return 0;
+
+	return mc;
+}
+
+
+/*****************************************************************************
+ *                                mp_scan
+ *****************************************************************************/
+/**
+ * <Ring 0> Look for the MP Floating Pointer in a memory range.
+ *
+ * @param addr  Start of the range, 16-byte aligned.
+ * @param len   Length of the range.
+ *
+ * @return The MP Floating Pointer, or 0 if it is not there.
+ *****************************************************************************/
+PRIVATE struct mp_fp * mp_scan(u32 addr, int len)
+{
+	u8 * p;
+	for (p = (u8*)addr; p < (u8*)addr + len; p += sizeof(struct mp_fp))
+		if (memcmp(p, "_MP_", 4) == 0 &&
+		    mp_sum(p, sizeof(struct mp_fp)) == 0)
+			return (struct mp_fp *)p;
+
+	return 0;
+}
+
+
+/*****************************************************************************
+ *                                mp_sum
+ *****************************************************************************/
+/**
+ * <Ring 0> Add bytes up, MP structures sum to 0.
+ *
+ * @param p    The bytes.
+ * @param len  How many.
+ *
+ * @return The sum, modulo 256.
+ *****************************************************************************/
+PRIVATE int mp_sum(void * p, int len)
+{
+	u8 sum = 0;
+	u8 * q;
+	for (q = (u8*)p; q < (u8*)p + len; q++)
+		sum += *q;
+	return sum;
+}
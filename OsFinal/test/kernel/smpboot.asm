@@ -0,0 +1,65 @@
+
+; ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+;                               smpboot.asm
+; ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+;                                                     Forrest Yu, 2005
+; ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+; An AP (application processor) starts in real mode at the page given by
+; the STARTUP IPI. start_aps() copies the code between ap_trampoline and
+; ap_trampoline_end to AP_TRAMPOLINE, fills ap_tramp_gdt with gdt_ptr and
+; then wakes the AP up. The AP loads the kernel GDT, turns protection and
+; paging on, takes ap_stack_top as its stack and goes to ap_main().
+
+%include "sconst.inc"
+
+extern	idt_ptr
+extern	ap_stack_top
+extern	ap_main
+
+global	ap_trampoline
+global	ap_tramp_gdt
+global	ap_trampoline_end
+
+AP_TRAMPOLINE	equ	0x90000		; corresponding with AP_TRAMPOLINE in smp.h
+PAGE_DIR_BASE	equ	0x100000	; corresponding with boot/include/load.inc
+
+[section .text]
+
+bits 16
+ap_trampoline:
+	cli
+	mov	ax, cs
+	mov	ds, ax
+
+	o32 lgdt [ap_tramp_gdt - ap_trampoline]
+
+	mov	eax, PAGE_DIR_BASE
+	mov	cr3, eax
+
+	mov	eax, cr0
+	or	eax, 0x80000001		; PG | PE
+	mov	cr0, eax
+
+	jmp	dword SELECTOR_KERNEL_CS:(AP_TRAMPOLINE + ap_pm - ap_trampoline)
+
+bits 32
+ap_pm:
+	mov	ax, SELECTOR_KERNEL_DS
+	mov	ds, ax
+	mov	es, ax
+	mov	fs, ax
+	mov	ss, ax
+	mov	gs, ax
+
+	mov	esp, [ap_stack_top]
+	lidt	[idt_ptr]
+
+	mov	eax, ap_main
+	jmp	eax			; never returns
+
+align 4
+ap_tramp_gdt:
+	dw	0			; 0~15:Limit
+	dd	0			; 16~47:Base
+ap_trampoline_end:
@@ -0,0 +1,187 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   softirq.c
+ * @brief  Softirqs: the work an interrupt handler leaves for later.
+ *
+ * An interrupt handler (the top half) only deals with the hardware and
+ * raises a softirq for the rest. Softirqs run in do_softirq(), on the way
+ * out of the outermost interrupt or syscall (see softirq_restart in
+ * kernel.asm), with interrupts enabled. A nested interrupt goes out through
+ * restart_reenter and leaves its softirqs to the outer one, so softirqs are
+ * never run by two at a time, nor while a syscall is being served.
+ *
+ * Each processor has its own softirq_pending in its struct cpu, and runs
+ * what was raised on it, holding the BKL. The IRQs come to the BSP only, so
+ * the tasks to inform (inform_pending) are the BSP's business alone.
+ *
+ * Waking a task up with HARD_INT and schedule() are done here, so they no
+ * longer race with sys_sendrec(), which runs with interrupts enabled.
+ *
+ * @author Forrest Y. Yu
+ * @date   2008
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "smp.h"
+#include "proto.h"
+
+PRIVATE softirq_handler	softirq_table[NR_SOFTIRQS];
+PRIVATE u32		inform_pending;	/* tasks to be sent HARD_INT */
+
+PRIVATE void	softirq_inform();
+PRIVATE void	softirq_sched();
+PRIVATE void	set_bit(u32 * word, int bit);
+
+
+/*****************************************************************************
+ *                                init_softirq
+ *****************************************************************************/
+/**
+ * <Ring 0> Set the handlers of the softirqs the kernel itself raises.
+ *****************************************************************************/
+PUBLIC void init_softirq()
+{
+	inform_pending = 0;
+
+	put_softirq_handler(SOFTIRQ_INFORM, softirq_inform);
+	put_softirq_handler(SOFTIRQ_SCHED, softirq_sched);
+}
+
+
+/*****************************************************************************
+ *                                put_softirq_handler
+ *****************************************************************************/
+/**
+ * <Ring 0> Set the handler of a softirq.
+ *
+ * @param nr       The softirq, SOFTIRQ_*.
+ * @param handler  The handler.
+ *****************************************************************************/
+PUBLIC void put_softirq_handler(int nr, softirq_handler handler)
+{
+	softirq_table[nr] = handler;
+}
+
+
+/*****************************************************************************
+ *                                raise_softirq
+ *****************************************************************************/
+/**
+ * <Ring 0> Have a softirq run on this processor before it goes back to the
+ * procs. Safe to call with interrupts enabled.
+ *
+ * @param nr  The softirq.
+ *****************************************************************************/
+PUBLIC void raise_softirq(int nr)
+{
+	set_bit(&this_cpu()->softirq_pending, nr);
+}
+
+
+/*****************************************************************************
+ *                                defer_inform
+ *****************************************************************************/
+/**
+ * <Ring 0> inform_int() for a top half: the task is sent HARD_INT by the
+ * SOFTIRQ_INFORM softirq.
+ *
+ * @param task_nr  The task which will be informed.
+ *****************************************************************************/
+PUBLIC void defer_inform(int task_nr)
+{
+	set_bit(&inform_pending, task_nr);
+	raise_softirq(SOFTIRQ_INFORM);
+}
+
+
+/*****************************************************************************
+ *                                do_softirq
+ *****************************************************************************/
+/**
+ * <Ring 0> Run the softirqs raised on this processor, in the order of their
+ * numbers, until no more are raised. Called with interrupts disabled and
+ * k_reenter being 0, and returns the same way; interrupts are enabled while
+ * the handlers run.
+ *
+ * The stretch with interrupts off that the caller is in is timed by the
+ * kernel.asm stubs or disable_int(): it ends at the sti here and a new one
+ * starts at the cli.
+ *****************************************************************************/
+PUBLIC void do_softirq()
+{
+	struct cpu * c = this_cpu();
+	u32 pending;
+
+	while ((pending = c->softirq_pending) != 0) {
+		c->softirq_pending = 0;
+		irqoff_end();
+		__asm__ __volatile__("sti");
+
+		int nr;
+		for (nr = 0; nr < NR_SOFTIRQS; nr++)
+			if ((pending & (1 << nr)) && softirq_table[nr])
+				softirq_table[nr]();
+
+		__asm__ __volatile__("cli");
+		irqoff_begin();
+	}
+}
+
+
+/*****************************************************************************
+ *                                softirq_inform
+ *****************************************************************************/
+/**
+ * <Ring 0> SOFTIRQ_INFORM: send HARD_INT to the tasks defer_inform() has
+ * been called for.
+ *****************************************************************************/
+PRIVATE void softirq_inform()
+{
+	disable_int();
+	u32 tasks = inform_pending;
+	inform_pending = 0;
+	enable_int();
+
+	int i;
+	for (i = 0; i < NR_TASKS; i++)
+		if (tasks & (1 << i))
+			inform_int(i);
+}
+
+
+/*****************************************************************************
+ *                                softirq_sched
+ *****************************************************************************/
+/**
+ * <Ring 0> SOFTIRQ_SCHED: the clock has found it is time to schedule.
+ *****************************************************************************/
+PRIVATE void softirq_sched()
+{
+	schedule();
+}
+
+
+/*****************************************************************************
+ *                                set_bit
+ *****************************************************************************/
+/**
+ * <Ring 0> Set a bit with one instruction, so that an interrupt can not
+ * come in between the read and the write.
+ *
+ * @param word  The bits.
+ * @param bit   Which one.
+ *****************************************************************************/
+PRIVATE void set_bit(u32 * word, int bit)
+{
+	__asm__ __volatile__("orl %1, %0" : "+m" (*word) : "r" (1 << bit));
+}
@@ -20,14 +20,32 @@
 #include "keyboard.h"
 #include "proto.h"
 
+/**
+ * @struct sys_timer
+ * @brief  A proc sleeping in sleep_ms(), there is one per proc.
+ */
+PRIVATE struct sys_timer {
+	int			expire;	/**< `ticks' to wake it up at */
+	struct sys_timer *	next;	/**< Next one due, 0: the last */
+} timer_table[NR_TASKS + NR_PROCS];
+
+/* sleepers, the 1st one due first */
+PRIVATE struct sys_timer *	timer_queue;
+
 PRIVATE int read_register(char reg_addr);
 PRIVATE u32 get_rtc_time(struct time *t);
+PRIVATE void add_timer(int proc, int msec);
+PRIVATE void wake_sleepers();
 
 /*****************************************************************************
  *                                task_sys
  *****************************************************************************/
 /**
  * <Ring 1> The main loop of TASK SYS.
+ *
+ * A SLEEP is not replied until it is due: the caller is put in timer_queue,
+ * and sys_countdown has clock_handler() wake TASK SYS up when the 1st
+ * sleeper is due.
  * 
  *****************************************************************************/
 PUBLIC void task_sys()
@@ -38,8 +56,17 @@ PUBLIC void task_sys()
 	while (1) {
 		send_recv(RECEIVE, ANY, &msg);
 		int src = msg.source;
+		if (src == NOTIFICATION) /* SYS takes no notify() bits */
+			continue;
 
 		switch (msg.type) {
+		case HARD_INT:
+			wake_sleepers();
+			break;
+		case SLEEP:
+			add_timer(src, msg.MSEC);
+			wake_sleepers();
+			break;
 		case GET_TICKS:
 			msg.RETVAL = ticks;
 			send_recv(SEND, src, &msg);
@@ -65,6 +92,50 @@ PUBLIC void task_sys()
 }
 
 
+/*****************************************************************************
+ *                                add_timer
+ *****************************************************************************/
+/**
+ * Put a proc into timer_queue, after the ones due no later.
+ * 
+ * @param proc  The proc to sleep.
+ * @param msec  How long, it is rounded up to whole ticks.
+ *****************************************************************************/
+PRIVATE void add_timer(int proc, int msec)
+{
+	struct sys_timer * t = &timer_table[proc];
+	struct sys_timer ** pp = &timer_queue;
+
+	t->expire = ticks + (max(msec, 0) * system_hz + 999) / 1000;
+
+	while (*pp && (*pp)->expire <= t->expire)
+		pp = &(*pp)->next;
+	t->next = *pp;
+	*pp = t;
+}
+
+/*****************************************************************************
+ *                                wake_sleepers
+ *****************************************************************************/
+/**
+ * Reply to the sleepers that are due, and set sys_countdown for the next.
+ * 
+ *****************************************************************************/
+PRIVATE void wake_sleepers()
+{
+	while (timer_queue && timer_queue->expire - ticks <= 0) {
+		struct sys_timer * t = timer_queue;
+		timer_queue = t->next;
+
+		MESSAGE msg;
+		msg.type = SYSCALL_RET;
+		msg.RETVAL = 0;
+		send_recv(SEND, t - timer_table, &msg);
+	}
+
+	sys_countdown = timer_queue ? max(timer_queue->expire - ticks, 1) : 0;
+}
+
 /*****************************************************************************
  *                                get_rtc_time
  *****************************************************************************/
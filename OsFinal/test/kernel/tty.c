@@ -11,11 +11,14 @@
  * Besides, it accepts the other two types of MESSAGE from clock_handler() and
  * a PROC (who is not FS):
  *
- *   - MESSAGE from clock_handler(): HARD_INT
- *      - Every time clock interrupt occurs, the clock handler will check whether
- *        any key has been pressed. If so, it'll invoke inform_int() to wake up
- *        TTY. It is a special message because it is not from a process -- clock
- *        handler is not a process.
+ *   - MESSAGE from keyboard_handler(), serial_handler() or clock_handler():
+ *     HARD_INT
+ *      - Every time a key is pressed, the keyboard handler invokes
+ *        inform_int() to wake up TTY and lets it run right away. It is a
+ *        special message because it is not from a process -- an interrupt
+ *        handler is not a process. The serial handler does the same when
+ *        chars arrive on COM1. The clock handler wakes TTY up when a raw
+ *        read times out, see tty_countdown.
  *
  *   - MESSAGE from a PROC: TTY_WRITE
  *      - TTY is a driver. In most cases MESSAGE is passed from a PROC to FS then
@@ -31,12 +34,21 @@
  *             - tty_do_write() handles DEV_WRITE message
  *             - tty_write() handles TTY_WRITE message
  *
+ * Input goes through a line discipline (see struct termios): in canonical
+ * mode the chars are echoed and edited in TTY::tty_line, and the line is
+ * handed to the reader in one copy when Enter is pressed; in raw mode the
+ * chars are handed over as they come, according to VMIN and VTIME.
+ *
+ * Minors 0 ~ NR_CONSOLES-1 are the consoles, the ones after them are serial
+ * lines (/dev_ttyS0), whose TTY::console is 0.
+ *
  * @author Forrest Y. Yu
  * @date   2008
  *****************************************************************************
  *****************************************************************************/
 
 #include "type.h"
+#include "config.h"
 #include "stdio.h"
 #include "const.h"
 #include "protect.h"
@@ -47,11 +59,12 @@
 #include "console.h"
 #include "global.h"
 #include "keyboard.h"
+#include "smp.h"
 #include "proto.h"
 
 
 #define TTY_FIRST	(tty_table)
-#define TTY_END		(tty_table + NR_CONSOLES)
+#define TTY_END		(tty_table + NR_TTYS)
 
 
 PRIVATE void	init_tty	(TTY* tty);
@@ -59,6 +72,13 @@ PRIVATE void	tty_dev_read	(TTY* tty);
 PRIVATE void	tty_dev_write	(TTY* tty);
 PRIVATE void	tty_do_read	(TTY* tty, MESSAGE* msg);
 PRIVATE void	tty_do_write	(TTY* tty, MESSAGE* msg);
+PRIVATE void	tty_do_ioctl	(TTY* tty, MESSAGE* msg);
+PRIVATE void	tty_canon	(TTY* tty);
+PRIVATE void	tty_raw		(TTY* tty);
+PRIVATE void	tty_resume	(TTY* tty);
+PRIVATE void	tty_set_timer	(int redraw);
+PRIVATE int	tty_pending	(TTY* tty);
+PRIVATE void	tty_output	(TTY* tty, const char * buf, int len);
 PRIVATE void	put_key		(TTY* tty, u32 key);
 
 
@@ -82,16 +102,22 @@ PUBLIC void task_tty()
 
 	while (1) {
 		for (tty = TTY_FIRST; tty < TTY_END; tty++) {
+			if (!tty_pending(tty))
+				continue;
 			do {
 				tty_dev_read(tty);
 				tty_dev_write(tty);
-			} while (tty->ibuf_cnt);
+			} while (tty->ibuf_cnt && tty->tty_left_cnt);
 		}
 
+		tty_set_timer(render_screen());
+
 		send_recv(RECEIVE, ANY, &msg);
 
 		int src = msg.source;
 		assert(src != TASK_TTY);
+		if (src == NOTIFICATION) /* TTY takes no notify() bits */
+			continue;
 
 		TTY* ptty = &tty_table[msg.DEVICE];
 
@@ -107,12 +133,17 @@ PUBLIC void task_tty()
 		case DEV_WRITE:
 			tty_do_write(ptty, &msg);
 			break;
+		case DEV_IOCTL:
+			tty_do_ioctl(ptty, &msg);
+			break;
 		case HARD_INT:
 			/**
-			 * waked up by clock_handler -- a key was just pressed
-			 * @see clock_handler() inform_int()
+			 * waked up by keyboard_handler -- a key was just
+			 * pressed, by clock_handler -- a raw read is timing
+			 * out or the screen is to be rendered, or by
+			 * sys_printx -- something was printed
+			 * @see keyboard_handler() clock_handler() inform_int()
 			 */
-			key_pressed = 0;
 			continue;
 		default:
 			dump_msg("TTY::unknown msg", &msg);
@@ -128,7 +159,7 @@ PUBLIC void task_tty()
 /**
  * Things to be initialized before a tty can be used:
  *   -# the input buffer
- *   -# the corresponding console
+ *   -# the corresponding console, if it is not a serial line
  * 
  * @param tty  TTY stands for teletype, a cool ancient magic thing.
  *****************************************************************************/
@@ -137,7 +168,16 @@ PRIVATE void init_tty(TTY* tty)
 	tty->ibuf_cnt = 0;
 	tty->ibuf_head = tty->ibuf_tail = tty->ibuf;
 
-	init_screen(tty);
+	tty->tty_lflag = ICANON | ECHO;
+	tty->tty_vmin = 1;
+	tty->tty_vtime = 0;
+	tty->tty_expire = 0;
+	tty->tty_line_len = 0;
+
+	if (tty < TTY_FIRST + NR_CONSOLES)
+		init_screen(tty);
+	else
+		tty->console = 0;
 }
 
 
@@ -223,20 +263,41 @@ PRIVATE void put_key(TTY* tty, u32 key)
 }
 
 
+/*****************************************************************************
+ *                                tty_pending
+ *****************************************************************************/
+/**
+ * Whether task_tty() has anything to do for a TTY: keys go only to the
+ * current console, and a raw read may complete without a key (VMIN 0, or
+ * VTIME running out). A serial line is always looked at.
+ * 
+ * @param tty  Ptr to TTY.
+ * 
+ * @return  Non-zero if the TTY needs tty_dev_read()/tty_dev_write().
+ *****************************************************************************/
+PRIVATE int tty_pending(TTY* tty)
+{
+	return !tty->console || is_current_console(tty->console) ||
+		(tty->tty_left_cnt && !(tty->tty_lflag & ICANON));
+}
+
+
 /*****************************************************************************
  *                                tty_dev_read
  *****************************************************************************/
 /**
  * Get chars from the keyboard buffer if the TTY::console is the `current'
- * console.
+ * console, or from COM1 if the TTY is a serial line.
  *
- * @see keyboard_read()
+ * @see keyboard_read() serial_read()
  * 
  * @param tty  Ptr to TTY.
  *****************************************************************************/
 PRIVATE void tty_dev_read(TTY* tty)
 {
-	if (is_current_console(tty->console))
+	if (!tty->console)
+		serial_read(tty);
+	else if (is_current_console(tty->console))
 		keyboard_read(tty);
 }
 
@@ -245,12 +306,34 @@ PRIVATE void tty_dev_read(TTY* tty)
  *                                tty_dev_write
  *****************************************************************************/
 /**
- * Echo the char just pressed and transfer it to the waiting process.
+ * Run the chars just pressed through the line discipline, and transfer them
+ * to the waiting process.
  * 
  * @param tty   Ptr to a TTY struct.
  *****************************************************************************/
 PRIVATE void tty_dev_write(TTY* tty)
 {
+	if (tty->tty_lflag & ICANON)
+		tty_canon(tty);
+	else
+		tty_raw(tty);
+}
+
+
+/*****************************************************************************
+ *                                tty_canon
+ *****************************************************************************/
+/**
+ * Canonical mode: echo and edit the chars in TTY::tty_line, and hand the
+ * line over in one copy when it is complete. As before, chars typed while
+ * nobody is reading are dropped.
+ * 
+ * @param tty   Ptr to a TTY struct.
+ *****************************************************************************/
+PRIVATE void tty_canon(TTY* tty)
+{
+	int echo = tty->tty_lflag & ECHO;
+
 	while (tty->ibuf_cnt) {
 		char ch = *(tty->ibuf_tail);
 		tty->ibuf_tail++;
@@ -258,32 +341,125 @@ PRIVATE void tty_dev_write(TTY* tty)
 			tty->ibuf_tail = tty->ibuf;
 		tty->ibuf_cnt--;
 
-		if (tty->tty_left_cnt) {
-			if (ch >= ' ' && ch <= '~') { /* printable */
-				out_char(tty->console, ch);
-				void * p = tty->tty_req_buf +
-					   tty->tty_trans_cnt;
-				phys_copy(p, (void *)va2la(TASK_TTY, &ch), 1);
-				tty->tty_trans_cnt++;
-				tty->tty_left_cnt--;
-			}
-			else if (ch == '\b' && tty->tty_trans_cnt) {
-				out_char(tty->console, ch);
-				tty->tty_trans_cnt--;
-				tty->tty_left_cnt++;
-			}
+		if (!tty->tty_left_cnt)
+			continue;
 
-			if (ch == '\n' || tty->tty_left_cnt == 0) {
-				out_char(tty->console, '\n');
-				MESSAGE msg;
-				msg.type = RESUME_PROC;
-				msg.PROC_NR = tty->tty_procnr;
-				msg.CNT = tty->tty_trans_cnt;
-				send_recv(SEND, tty->tty_caller, &msg);
-				tty->tty_left_cnt = 0;
-			}
+		if (ch >= ' ' && ch <= '~') { /* printable */
+			if (echo)
+				tty_output(tty, &ch, 1);
+			tty->tty_line[tty->tty_line_len++] = ch;
+		}
+		else if (ch == '\b' && tty->tty_line_len) {
+			if (echo)
+				tty_output(tty, &ch, 1);
+			tty->tty_line_len--;
+		}
+
+		if (ch == '\n' ||
+		    tty->tty_line_len == min(tty->tty_left_cnt, TTY_LINE_LEN)) {
+			if (echo)
+				tty_output(tty, "\n", 1);
+			phys_copy(tty->tty_req_buf,
+				  (void*)va2la(TASK_TTY, tty->tty_line),
+				  tty->tty_line_len);
+			tty->tty_trans_cnt = tty->tty_line_len;
+			tty->tty_line_len = 0;
+			tty_resume(tty);
+		}
+	}
+}
+
+
+/*****************************************************************************
+ *                                tty_raw
+ *****************************************************************************/
+/**
+ * Raw mode: hand over whatever is in the input buffer, a contiguous run at a
+ * time, then decide by VMIN/VTIME whether the read is done. Chars typed while
+ * nobody is reading are kept.
+ * 
+ * @param tty   Ptr to a TTY struct.
+ *****************************************************************************/
+PRIVATE void tty_raw(TTY* tty)
+{
+	if (!tty->tty_left_cnt)
+		return;
+
+	int n = min(tty->ibuf_cnt, tty->tty_left_cnt);
+	int moved = n;
+
+	while (n) {
+		int k = min(n, tty->ibuf + TTY_IN_BYTES - tty->ibuf_tail);
+		if (tty->tty_lflag & ECHO)
+			tty_output(tty, tty->ibuf_tail, k);
+		phys_copy(tty->tty_req_buf + tty->tty_trans_cnt,
+			  (void*)va2la(TASK_TTY, tty->ibuf_tail), k);
+		tty->ibuf_tail += k;
+		if (tty->ibuf_tail == tty->ibuf + TTY_IN_BYTES)
+			tty->ibuf_tail = tty->ibuf;
+		tty->ibuf_cnt -= k;
+		tty->tty_trans_cnt += k;
+		tty->tty_left_cnt -= k;
+		n -= k;
+	}
+
+	/* with VMIN, VTIME counts from the last char */
+	if (moved && tty->tty_vmin && tty->tty_vtime)
+		tty->tty_expire = ticks + tty->tty_vtime * system_hz / 10;
+
+	int vmin = tty->tty_vmin;
+	int trans = tty->tty_trans_cnt;
+
+	if (tty->tty_left_cnt == 0 ||
+	    (vmin && trans >= vmin) ||
+	    (!vmin && (trans || !tty->tty_vtime)) ||
+	    (tty->tty_expire && ticks >= tty->tty_expire))
+		tty_resume(tty);
+}
+
+
+/*****************************************************************************
+ *                                tty_resume
+ *****************************************************************************/
+/**
+ * Finish the read: tell the caller (usually FS) to resume the reader.
+ * 
+ * @param tty   Ptr to a TTY struct.
+ *****************************************************************************/
+PRIVATE void tty_resume(TTY* tty)
+{
+	MESSAGE msg;
+	msg.type = RESUME_PROC;
+	msg.PROC_NR = tty->tty_procnr;
+	msg.CNT = tty->tty_trans_cnt;
+	send_recv(SEND, tty->tty_caller, &msg);
+	tty->tty_left_cnt = 0;
+	tty->tty_expire = 0;
+}
+
+
+/*****************************************************************************
+ *                                tty_set_timer
+ *****************************************************************************/
+/**
+ * Ask clock_handler() to wake TTY up when the first raw read times out, or
+ * in the next tick if the screen is to be rendered again.
+ *
+ * @param redraw  Non-zero if render_screen() has something left.
+ *****************************************************************************/
+PRIVATE void tty_set_timer(int redraw)
+{
+	TTY * tty;
+	int next = redraw ? 1 : 0;
+
+	for (tty = TTY_FIRST; tty < TTY_END; tty++) {
+		if (tty->tty_left_cnt && tty->tty_expire) {
+			int t = max(tty->tty_expire - ticks, 1);
+			next = next ? min(next, t) : t;
 		}
 	}
+
+	tty_countdown = next;
 }
 
 
@@ -309,6 +485,12 @@ PRIVATE void tty_do_read(TTY* tty, MESSAGE* msg)
 				  msg->BUF);/* where the chars should be put */
 	tty->tty_left_cnt = msg->CNT; /* how many chars are requested */
 	tty->tty_trans_cnt= 0; /* how many chars have been transferred */
+	tty->tty_line_len = 0;
+
+	/* without VMIN, VTIME counts from now on */
+	tty->tty_expire = 0;
+	if (!(tty->tty_lflag & ICANON) && !tty->tty_vmin && tty->tty_vtime)
+		tty->tty_expire = ticks + tty->tty_vtime * system_hz / 10;
 
 	msg->type = SUSPEND_PROC;
 	msg->CNT = tty->tty_left_cnt;
@@ -321,24 +503,66 @@ PRIVATE void tty_do_read(TTY* tty, MESSAGE* msg)
  *****************************************************************************/
 /**
  * Invoked when task TTY receives DEV_WRITE message.
+ *
+ * The chars are taken straight from the caller's buffer. They reach the
+ * screen when task_tty() calls render_screen().
  * 
  * @param tty  To which TTY the calller proc is bound.
  * @param msg  The MESSAGE.
  *****************************************************************************/
 PRIVATE void tty_do_write(TTY* tty, MESSAGE* msg)
 {
-	char buf[TTY_OUT_BUF_LEN];
 	char * p = (char*)va2la(msg->PROC_NR, msg->BUF);
-	int i = msg->CNT;
-	int j;
-
-	while (i) {
-		int bytes = min(TTY_OUT_BUF_LEN, i);
-		phys_copy(va2la(TASK_TTY, buf), (void*)p, bytes);
-		for (j = 0; j < bytes; j++)
-			out_char(tty->console, buf[j]);
-		i -= bytes;
-		p += bytes;
+
+	tty_output(tty, p, msg->CNT);
+
+	msg->type = SYSCALL_RET;
+	send_recv(SEND, msg->source, msg);
+}
+
+
+/*****************************************************************************
+ *                                tty_do_ioctl
+ *****************************************************************************/
+/**
+ * Invoked when task TTY receives DEV_IOCTL message: get or set the line
+ * discipline. Switching to canonical mode drops the chars kept in raw mode.
+ * 
+ * @param tty  The TTY.
+ * @param msg  The MESSAGE, REQUEST is TCGETS or TCSETS.
+ *****************************************************************************/
+PRIVATE void tty_do_ioctl(TTY* tty, MESSAGE* msg)
+{
+	struct termios t;
+	void * p = va2la(msg->PROC_NR, msg->BUF);
+	int request = msg->REQUEST;
+
+	msg->RETVAL = 0;
+
+	switch (request) {
+	case TCGETS:
+		t.c_lflag = tty->tty_lflag;
+		t.c_vmin = tty->tty_vmin;
+		t.c_vtime = tty->tty_vtime;
+		phys_copy(p, (void*)va2la(TASK_TTY, &t), sizeof(t));
+		break;
+	case TCSETS:
+		phys_copy((void*)va2la(TASK_TTY, &t), p, sizeof(t));
+		if (t.c_vmin < 0 || t.c_vmin > TTY_IN_BYTES || t.c_vtime < 0) {
+			msg->RETVAL = -1;
+			break;
+		}
+		if ((t.c_lflag & ICANON) && !(tty->tty_lflag & ICANON)) {
+			tty->ibuf_cnt = 0;
+			tty->ibuf_head = tty->ibuf_tail = tty->ibuf;
+		}
+		tty->tty_lflag = t.c_lflag & (ICANON | ECHO);
+		tty->tty_vmin = t.c_vmin;
+		tty->tty_vtime = t.c_vtime;
+		break;
+	default:
+		msg->RETVAL = -1;
+		break;
 	}
 
 	msg->type = SYSCALL_RET;
@@ -346,6 +570,25 @@ PRIVATE void tty_do_write(TTY* tty, MESSAGE* msg)
 }
 
 
+/*****************************************************************************
+ *                                tty_output
+ *****************************************************************************/
+/**
+ * Put chars on the screen of a console, or send them down a serial line.
+ * 
+ * @param tty  The TTY.
+ * @param buf  The chars.
+ * @param len  How many.
+ *****************************************************************************/
+PRIVATE void tty_output(TTY* tty, const char * buf, int len)
+{
+	if (tty->console)
+		out_string(tty->console, buf, len);
+	else
+		serial_write(buf, len);
+}
+
+
 /*****************************************************************************
  *                                sys_printx
  *****************************************************************************/
@@ -362,6 +605,8 @@ PRIVATE void tty_do_write(TTY* tty, MESSAGE* msg)
  * something goes really wrong and the system is to be halted; if it equals
  * MAG_CH_ASSERT, then this syscall was invoked by `assert()', which means
  * an assertion failure has occured. @see kernel/main lib/misc.c.
+ *
+ * @note The output goes to the first console and/or COM1, see LOG_SINK.
  * 
  * @param _unused1  Ignored.
  * @param _unused2  Ignored.
@@ -374,6 +619,7 @@ PUBLIC int sys_printx(int _unused1, int _unused2, char* s, struct proc* p_proc)
 {
 	const char * p;
 	char ch;
+	struct cpu * c = this_cpu();
 
 	char reenter_err[] = "? k_reenter is incorrect for unknown reason";
 	reenter_err[0] = MAG_CH_PANIC;
@@ -391,10 +637,12 @@ PUBLIC int sys_printx(int _unused1, int _unused2, char* s, struct proc* p_proc)
 	 *        by `kernel.asm::save' and be greater than 0.
 	 *   -# printx() is called in Ring 1~3
 	 *      - k_reenter == 0.
+	 *
+	 * k_reenter is the one of the processor running the caller.
 	 */
-	if (k_reenter == 0)  /* printx() called in Ring<1~3> */
+	if (c->reenter == 0)  /* printx() called in Ring<1~3> */
 		p = va2la(proc2pid(p_proc), s);
-	else if (k_reenter > 0) /* printx() called in Ring<0> */
+	else if (c->reenter > 0) /* printx() called in Ring<0> */
 		p = s;
 	else	/* this should NOT happen */
 		p = reenter_err;
@@ -405,7 +653,7 @@ PUBLIC int sys_printx(int _unused1, int _unused2, char* s, struct proc* p_proc)
 	 * does.
 	 */
 	if ((*p == MAG_CH_PANIC) ||
-	    (*p == MAG_CH_ASSERT && p_proc_ready < &proc_table[NR_TASKS])) {
+	    (*p == MAG_CH_ASSERT && c->proc < &proc_table[NR_TASKS])) {
 		disable_int();
 		char * v = (char*)V_MEM_BASE;
 		const char * q = p + 1; /* +1: skip the magic char */
@@ -423,17 +671,31 @@ PUBLIC int sys_printx(int _unused1, int _unused2, char* s, struct proc* p_proc)
 			}
 		}
 
+		if (LOG_SINK & LOG_TO_SERIAL) {
+			serial_puts_sync(p + 1);
+			serial_puts_sync("\n");
+		}
+
 		__asm__ __volatile__("hlt");
 	}
 
-	while ((ch = *p++) != 0) {
-		if (ch == MAG_CH_PANIC || ch == MAG_CH_ASSERT)
+	while ((ch = *p) != 0) {
+		if (ch == MAG_CH_PANIC || ch == MAG_CH_ASSERT) {
+			p++;
 			continue; /* skip the magic char */
+		}
 
-		/* TTY * ptty; */
-		/* for (ptty = TTY_FIRST; ptty < TTY_END; ptty++) */
-		/* 	out_char(ptty->console, ch); /\* output chars to all TTYs *\/ */
-		out_char(TTY_FIRST->console, ch);
+		/* print up to the next magic char in one go */
+		const char * q = p;
+		while (*q && *q != MAG_CH_PANIC && *q != MAG_CH_ASSERT)
+			q++;
+		if (LOG_SINK & LOG_TO_CONSOLE) {
+			out_string(TTY_FIRST->console, p, q - p);
+			inform_int(TASK_TTY);	/* to render it */
+		}
+		if (LOG_SINK & LOG_TO_SERIAL)
+			serial_write(p, q - p);
+		p = q;
 	}
 
 	//__asm__ __volatile__("nop;jmp 1f;ud2;1: nop");
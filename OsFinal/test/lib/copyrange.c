@@ -0,0 +1,47 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   copyrange.c
+ * @brief  copy_file_range()
+ * @author Forrest Y. Yu
+ * @date   2008
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+/*****************************************************************************
+ *                                copy_file_range
+ *****************************************************************************/
+/**
+ * Copy bytes between two opened files inside FS, the data never comes to
+ * user space. Both file offsets are advanced.
+ * 
+ * @param fd_in   File descriptor to copy from.
+ * @param fd_out  File descriptor to copy to.
+ * @param len     How many bytes to copy.
+ * 
+ * @return  On success, the number of bytes copied are returned.
+ *          On error, -1 is returned.
+ *****************************************************************************/
+PUBLIC int copy_file_range(int fd_in, int fd_out, int len)
+{
+	MESSAGE msg;
+	msg.type   = COPY_RANGE;
+	msg.FD     = fd_in;
+	msg.FD_OUT = fd_out;
+	msg.CNT    = len;
+
+	send_recv(BOTH, TASK_FS, &msg);
+
+	return msg.CNT;
+}
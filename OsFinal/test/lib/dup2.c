@@ -0,0 +1,43 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   dup2.c
+ * @brief  dup2()
+ * @author Forrest Y. Yu
+ * @date   2008
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+/*****************************************************************************
+ *                                dup2
+ *****************************************************************************/
+/**
+ * Make newfd a copy of oldfd, closing newfd first if it is open.
+ * 
+ * @param oldfd  An open fd.
+ * @param newfd  The fd to become the copy.
+ * 
+ * @return newfd if successful, otherwise -1.
+ *****************************************************************************/
+PUBLIC int dup2(int oldfd, int newfd)
+{
+	MESSAGE msg;
+	msg.type   = DUP;
+	msg.FD     = oldfd;
+	msg.FD_OUT = newfd;
+
+	send_recv(BOTH, TASK_FS, &msg);
+
+	return msg.RETVAL;
+}
@@ -0,0 +1,45 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   fallocate.c
+ * @brief  fallocate()
+ * @author Forrest Y. Yu
+ * @date   2008
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+/*****************************************************************************
+ *                                fallocate
+ *****************************************************************************/
+/**
+ * Reserve a contiguous extent of at least len bytes for an opened file, so
+ * later writes up to that size neither fail nor get scattered on disk. The
+ * file size is not changed.
+ * 
+ * @param fd   File descriptor.
+ * @param len  How many bytes the file should be able to hold.
+ * 
+ * @return Zero if successful, otherwise -1.
+ *****************************************************************************/
+PUBLIC int fallocate(int fd, int len)
+{
+	MESSAGE msg;
+	msg.type = FALLOCATE;
+	msg.FD   = fd;
+	msg.CNT  = len;
+
+	send_recv(BOTH, TASK_FS, &msg);
+
+	return msg.RETVAL;
+}
@@ -0,0 +1,44 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   ftruncate.c
+ * @brief  ftruncate()
+ * @author Forrest Y. Yu
+ * @date   2008
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+/*****************************************************************************
+ *                                ftruncate
+ *****************************************************************************/
+/**
+ * Set the size of an opened file. The file may shrink or grow, but not past
+ * the sectors it owns (see fallocate()).
+ * 
+ * @param fd      File descriptor.
+ * @param length  The new size in bytes.
+ * 
+ * @return Zero if successful, otherwise -1.
+ *****************************************************************************/
+PUBLIC int ftruncate(int fd, int length)
+{
+	MESSAGE msg;
+	msg.type   = FTRUNCATE;
+	msg.FD     = fd;
+	msg.OFFSET = length;
+
+	send_recv(BOTH, TASK_FS, &msg);
+
+	return msg.RETVAL;
+}
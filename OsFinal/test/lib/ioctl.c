@@ -0,0 +1,78 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   ioctl.c
+ * @brief  ioctl(), tcgetattr(), tcsetattr()
+ * @author Forrest Y. Yu
+ * @date   2008
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+/*****************************************************************************
+ *                                ioctl
+ *****************************************************************************/
+/**
+ * Send a request to the driver of a char device.
+ * 
+ * @param fd       An open char device.
+ * @param request  E.g. TCGETS.
+ * @param argp     Argument of the request.
+ * 
+ * @return What the driver returns, -1 on error.
+ *****************************************************************************/
+PUBLIC int ioctl(int fd, int request, void *argp)
+{
+	MESSAGE msg;
+	msg.type    = IOCTL;
+	msg.FD      = fd;
+	msg.REQUEST = request;
+	msg.BUF     = argp;
+
+	send_recv(BOTH, TASK_FS, &msg);
+	assert(msg.type == SYSCALL_RET);
+
+	return msg.RETVAL;
+}
+
+/*****************************************************************************
+ *                                tcgetattr
+ *****************************************************************************/
+/**
+ * Get the line discipline of a TTY.
+ * 
+ * @param fd  An open TTY.
+ * @param t   Where to put it.
+ * 
+ * @return Zero if successful, otherwise -1.
+ *****************************************************************************/
+PUBLIC int tcgetattr(int fd, struct termios *t)
+{
+	return ioctl(fd, TCGETS, t);
+}
+
+/*****************************************************************************
+ *                                tcsetattr
+ *****************************************************************************/
+/**
+ * Set the line discipline of a TTY.
+ * 
+ * @param fd  An open TTY.
+ * @param t   The new line discipline.
+ * 
+ * @return Zero if successful, otherwise -1.
+ *****************************************************************************/
+PUBLIC int tcsetattr(int fd, const struct termios *t)
+{
+	return ioctl(fd, TCSETS, (void*)t);
+}
@@ -61,6 +61,32 @@ PUBLIC int send_recv(int function, int src_dest, MESSAGE* msg)
 	return ret;
 }
 
+/*****************************************************************************
+ *                                notify
+ *****************************************************************************/
+/**
+ * <Ring 1~3> Set a bit at dest and go on at once. dest gets the bits set
+ * since it last looked in a NOTIFY_MSG from NOTIFICATION, the next time it
+ * receives from ANY or NOTIFICATION. The tasks take no notifications: TTY,
+ * SYS, HD, FS and MM drop a NOTIFY_MSG.
+ *
+ * @param dest  Whom to notify.
+ * @param bit   Which bit, 0~31, agreed upon with dest.
+ * 
+ * @return Zero if success, -1 if bit is out of range.
+ *****************************************************************************/
+PUBLIC int notify(int dest, int bit)
+{
+	if (bit < 0 || bit > 31)
+		return -1;
+
+	MESSAGE msg;
+	memset(&msg, 0, sizeof(MESSAGE));
+	msg.NOTIFY_BITS = 1 << bit;
+
+	return sendrec(NOTIFY, dest, &msg);
+}
+
 /*****************************************************************************
  *                                memcmp
  *****************************************************************************/
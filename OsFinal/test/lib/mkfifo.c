@@ -0,0 +1,43 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   mkfifo.c
+ * @brief  mkfifo()
+ * @author Forrest Y. Yu
+ * @date   2008
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+/*****************************************************************************
+ *                                mkfifo
+ *****************************************************************************/
+/**
+ * Create a FIFO. Open it with O_RDONLY or O_WRONLY.
+ * 
+ * @param pathname  The full path of the FIFO.
+ * 
+ * @return Zero if successful, otherwise -1.
+ *****************************************************************************/
+PUBLIC int mkfifo(const char * pathname)
+{
+	MESSAGE msg;
+	msg.type = MKFIFO;
+
+	msg.PATHNAME	= (void*)pathname;
+	msg.NAME_LEN	= strlen(pathname);
+
+	send_recv(BOTH, TASK_FS, &msg);
+
+	return msg.RETVAL;
+}
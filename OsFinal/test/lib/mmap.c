@@ -0,0 +1,55 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   mmap.c
+ * @brief  mmap()
+ * @author Forrest Y. Yu
+ * @date   2008
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+/*****************************************************************************
+ *                                mmap
+ *****************************************************************************/
+/**
+ * Map a range of an opened file into memory.
+ *
+ * The range lives in the page cache of FS, so reading it needs neither a
+ * message nor a copy. MAP_SHARED mappings of the same range share the pages;
+ * if writable, they are written back to the file by munmap().
+ * 
+ * @param addr    Ignored, FS picks the address.
+ * @param length  How many bytes to map.
+ * @param prot    PROT_READ and/or PROT_WRITE.
+ * @param flags   MAP_SHARED or MAP_PRIVATE.
+ * @param fd      File descriptor.
+ * @param offset  File offset, must be a multiple of 4KB.
+ * 
+ * @return The address of the mapping, or MAP_FAILED.
+ *****************************************************************************/
+PUBLIC void * mmap(void *addr, int length, int prot, int flags,
+		   int fd, int offset)
+{
+	MESSAGE msg;
+	msg.type	= MMAP;
+	msg.FD		= fd;
+	msg.CNT		= length;
+	msg.POSITION	= offset;
+	msg.MMAP_PROT	= prot;
+	msg.MMAP_FLAGS	= flags;
+
+	send_recv(BOTH, TASK_FS, &msg);
+
+	return msg.BUF;
+}
@@ -0,0 +1,43 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   munmap.c
+ * @brief  munmap()
+ * @author Forrest Y. Yu
+ * @date   2008
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+/*****************************************************************************
+ *                                munmap
+ *****************************************************************************/
+/**
+ * Remove a mapping made by mmap().
+ * 
+ * @param addr    What mmap() returned.
+ * @param length  Ignored, the whole mapping is removed.
+ * 
+ * @return Zero if successful, otherwise -1.
+ *****************************************************************************/
+PUBLIC int munmap(void *addr, int length)
+{
+	MESSAGE msg;
+	msg.type = MUNMAP;
+	msg.BUF  = addr;
+	msg.CNT  = length;
+
+	send_recv(BOTH, TASK_FS, &msg);
+
+	return msg.RETVAL;
+}
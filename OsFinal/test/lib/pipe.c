@@ -0,0 +1,41 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   pipe.c
+ * @brief  pipe()
+ * @author Forrest Y. Yu
+ * @date   2008
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+/*****************************************************************************
+ *                                pipe
+ *****************************************************************************/
+/**
+ * Create a pipe.
+ * 
+ * @param fd  fd[0] gets the read end, fd[1] the write end.
+ * 
+ * @return Zero if successful, otherwise -1.
+ *****************************************************************************/
+PUBLIC int pipe(int fd[2])
+{
+	MESSAGE msg;
+	msg.type = PIPE;
+	msg.BUF  = (void*)fd;
+
+	send_recv(BOTH, TASK_FS, &msg);
+
+	return msg.RETVAL;
+}
@@ -0,0 +1,49 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   pread.c
+ * @brief  pread()
+ * @author Forrest Y. Yu
+ * @date   2008
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+/*****************************************************************************
+ *                                pread
+ *****************************************************************************/
+/**
+ * Read from a file descriptor at a given offset. The file offset of the
+ * descriptor is not changed.
+ * 
+ * @param fd      File descriptor.
+ * @param buf     Buffer to accept the bytes read.
+ * @param count   How many bytes to read.
+ * @param offset  From where (in bytes) to read.
+ * 
+ * @return  On success, the number of bytes read are returned.
+ *          On error, -1 is returned.
+ *****************************************************************************/
+PUBLIC int pread(int fd, void *buf, int count, int offset)
+{
+	MESSAGE msg;
+	msg.type     = PREAD;
+	msg.FD       = fd;
+	msg.BUF      = buf;
+	msg.CNT      = count;
+	msg.POSITION = offset;
+
+	send_recv(BOTH, TASK_FS, &msg);
+
+	return msg.CNT;
+}
@@ -0,0 +1,49 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   pwrite.c
+ * @brief  pwrite()
+ * @author Forrest Y. Yu
+ * @date   2008
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+/*****************************************************************************
+ *                                pwrite
+ *****************************************************************************/
+/**
+ * Write to a file descriptor at a given offset. The file offset of the
+ * descriptor is not changed.
+ * 
+ * @param fd      File descriptor.
+ * @param buf     Buffer including the bytes to write.
+ * @param count   How many bytes to write.
+ * @param offset  To where (in bytes) to write.
+ * 
+ * @return  On success, the number of bytes written are returned.
+ *          On error, -1 is returned.
+ *****************************************************************************/
+PUBLIC int pwrite(int fd, const void *buf, int count, int offset)
+{
+	MESSAGE msg;
+	msg.type     = PWRITE;
+	msg.FD       = fd;
+	msg.BUF      = (void*)buf;
+	msg.CNT      = count;
+	msg.POSITION = offset;
+
+	send_recv(BOTH, TASK_FS, &msg);
+
+	return msg.CNT;
+}
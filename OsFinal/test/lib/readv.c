@@ -0,0 +1,46 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   readv.c
+ * @brief  readv()
+ * @author Forrest Y. Yu
+ * @date   2008
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+/*****************************************************************************
+ *                                readv
+ *****************************************************************************/
+/**
+ * Read from a file descriptor into several buffers with one message.
+ * 
+ * @param fd      File descriptor.
+ * @param iov     Array of buffers, filled in order.
+ * @param iovcnt  How many buffers in iov[], at most IOV_MAX.
+ * 
+ * @return  On success, the total number of bytes read are returned.
+ *          On error, -1 is returned.
+ *****************************************************************************/
+PUBLIC int readv(int fd, const struct iovec *iov, int iovcnt)
+{
+	MESSAGE msg;
+	msg.type = READV;
+	msg.FD   = fd;
+	msg.BUF  = (void*)iov;
+	msg.CNT  = iovcnt;
+
+	send_recv(BOTH, TASK_FS, &msg);
+
+	return msg.CNT;
+}
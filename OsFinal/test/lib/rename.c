@@ -0,0 +1,46 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   rename.c
+ * @brief  rename()
+ * @author Forrest Y. Yu
+ * @date   2008
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+/*****************************************************************************
+ *                                rename
+ *****************************************************************************/
+/**
+ * Rename a file.
+ * 
+ * @param oldpath  The full path of the file.
+ * @param newpath  The new full path, which must not exist yet.
+ * 
+ * @return Zero if successful, otherwise -1.
+ *****************************************************************************/
+PUBLIC int rename(const char * oldpath, const char * newpath)
+{
+	MESSAGE msg;
+	msg.type   = RENAME;
+
+	msg.PATHNAME	= (void*)oldpath;
+	msg.NAME_LEN	= strlen(oldpath);
+	msg.BUF		= (void*)newpath;
+	msg.BUF_LEN	= strlen(newpath);
+
+	send_recv(BOTH, TASK_FS, &msg);
+
+	return msg.RETVAL;
+}
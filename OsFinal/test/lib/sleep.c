@@ -0,0 +1,43 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   sleep.c
+ * @brief  sleep_ms()
+ * @author Forrest Y. Yu
+ * @date   2008
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+
+/*****************************************************************************
+ *                                sleep_ms
+ *****************************************************************************/
+/**
+ * Block the caller for some time. It is rounded up to whole ticks.
+ * 
+ * @param msec  How many milliseconds.
+ * 
+ * @return Zero.
+ *****************************************************************************/
+PUBLIC int sleep_ms(int msec)
+{
+	MESSAGE msg;
+	msg.type	= SLEEP;
+	msg.MSEC	= msec;
+
+	send_recv(BOTH, TASK_SYS, &msg);
+	assert(msg.type == SYSCALL_RET);
+
+	return msg.RETVAL;
+}
@@ -10,10 +10,14 @@
 INT_VECTOR_SYS_CALL equ 0x90
 _NR_printx	    equ 0
 _NR_sendrec	    equ 1
+_NR_halt	    equ 2
+_NR_clock_gettime   equ 3
 
 ; 导出符号
 global	printx
 global	sendrec
+global	halt
+global	clock_gettime
 
 bits 32
 [section .text]
@@ -53,3 +57,29 @@ printx:
 
 	ret
 
+; ====================================================================================
+;                          int halt();
+; ====================================================================================
+; For the idle proc only.
+halt:
+	mov	eax, _NR_halt
+	int	INT_VECTOR_SYS_CALL
+
+	ret
+
+; ====================================================================================
+;                  int clock_gettime(int clock_id, struct timespec * tp);
+; ====================================================================================
+clock_gettime:
+	push	ebx		; .
+	push	ecx		; / 8 bytes
+
+	mov	eax, _NR_clock_gettime
+	mov	ebx, [esp + 8 + 4]	; clock_id
+	mov	ecx, [esp + 8 + 8]	; tp
+	int	INT_VECTOR_SYS_CALL
+
+	pop	ecx
+	pop	ebx
+
+	ret
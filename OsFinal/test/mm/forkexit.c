@@ -53,6 +53,10 @@ PUBLIC int do_fork()
 	*p = proc_table[pid];
 	p->ldt_sel = child_ldt_sel;
 	p->p_parent = pid;
+	p->p_runtime = 0;
+	p->p_cpu = 0;
+	p->notify_pending = 0;
+	p->p_mailbox = 0;
 	sprintf(p->name, "%s_%d", proc_table[pid].name, child_pid);
 
 	/* duplicate the process: T, D & S */
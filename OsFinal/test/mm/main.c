@@ -39,6 +39,8 @@ PUBLIC void task_mm()
 	while (1) {
 		send_recv(RECEIVE, ANY, &mm_msg);
 		int src = mm_msg.source;
+		if (src == NOTIFICATION) /* MM takes no notify() bits */
+			continue;
 		int reply = 1;
 
 		int msgtype = mm_msg.type;